@@ -1,8 +1,13 @@
 #pragma once
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <vector>
 
 namespace geo {
 
+static const double EARTH_RADIUS = 6371000; // [m]
+
 struct Coordinates {
     double lat;
     double lng;
@@ -12,10 +17,167 @@ inline double ComputeDistance(Coordinates from, Coordinates to) {
     using namespace std;
 
     static const double dr = M_PI/180.;
-    return 6371000*acos(
+    return EARTH_RADIUS*acos(std::clamp(
         sin(from.lat*dr)*sin(to.lat*dr)
-        + cos(from.lat*dr)*cos(to.lat*dr)*cos(abs(from.lng - to.lng)*dr)
-    );
+        + cos(from.lat*dr)*cos(to.lat*dr)*cos(abs(from.lng - to.lng)*dr),
+        -1., 1.
+    ));
 }
 
-} // namespace geo
\ No newline at end of file
+// ---------- PointColumns ------------
+
+// Points with sin/cos of the latitude precomputed and stored column-wise.
+// The batch distances gather the points in blocks and run a branch-free
+// polynomial cos and acos over each, which the compiler vectorises given
+// -fno-math-errno for the sqrt. They agree with ComputeDistance to rounding
+class PointColumns {
+public:
+    inline void Reserve(const size_t size) {
+        sin_lat_.reserve(size);
+        cos_lat_.reserve(size);
+        lng_.reserve(size);
+    }
+
+    inline void Add(Coordinates point) {
+        static const double dr = M_PI/180.;
+        sin_lat_.push_back(std::sin(point.lat*dr));
+        cos_lat_.push_back(std::cos(point.lat*dr));
+        lng_.push_back(point.lng*dr);
+    }
+
+    inline size_t GetSize() const {
+        return lng_.size();
+    }
+
+    inline size_t GetByteSize() const {
+        return (sin_lat_.capacity() + cos_lat_.capacity() + lng_.capacity())
+               *sizeof(double);
+    }
+
+    inline double ComputeDistance(const size_t from, const size_t to) const {
+        return EARTH_RADIUS*std::acos(std::clamp(
+            sin_lat_[from]*sin_lat_[to]
+            + cos_lat_[from]*cos_lat_[to]*std::cos(lng_[from] - lng_[to]),
+            -1., 1.
+        ));
+    }
+
+    // distances[i] is the distance between the point and ids[i]
+    template <typename Id>
+    void ComputeDistances(Coordinates from,
+                          const Id* ids,
+                          const size_t count,
+                          double* distances) const {
+        static const double dr = M_PI/180.;
+        Block from_block;
+        std::fill_n(from_block.sin_lat, BLOCK_SIZE, std::sin(from.lat*dr));
+        std::fill_n(from_block.cos_lat, BLOCK_SIZE, std::cos(from.lat*dr));
+        std::fill_n(from_block.lng, BLOCK_SIZE, from.lng*dr);
+
+        Block to_block;
+        for (size_t first = 0; first < count; first += BLOCK_SIZE) {
+            const size_t size = std::min(BLOCK_SIZE, count - first);
+            Gather(ids + first, size, to_block);
+            ComputeBlock(from_block, to_block, size, distances + first);
+        }
+    }
+
+    // distances[i] is the distance between ids[i] and ids[i + 1]
+    template <typename Id>
+    void ComputeSequenceDistances(const Id* ids,
+                                  const size_t count,
+                                  double* distances) const {
+        Block from_block;
+        Block to_block;
+        for (size_t first = 0; first + 1 < count; first += BLOCK_SIZE) {
+            const size_t size = std::min(BLOCK_SIZE, count - 1 - first);
+            Gather(ids + first, size, from_block);
+            Gather(ids + first + 1, size, to_block);
+            ComputeBlock(from_block, to_block, size, distances + first);
+        }
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    struct Block {
+        double sin_lat[BLOCK_SIZE];
+        double cos_lat[BLOCK_SIZE];
+        double lng[BLOCK_SIZE]; // [rad]
+    };
+
+    // Taylor series of cos in powers of angle², exact to rounding on [0, pi]
+    static constexpr std::array<double, 16> COS_COEFFICIENTS = [] {
+        std::array<double, 16> coefficients{};
+        double coefficient = 1.;
+        for (size_t k = 0; k < coefficients.size(); ++k) {
+            coefficients[k] = coefficient;
+            coefficient /= -static_cast<double>((2*k + 1)*(2*k + 2));
+        }
+        return coefficients;
+    }();
+
+    std::vector<double> sin_lat_;
+    std::vector<double> cos_lat_;
+    std::vector<double> lng_; // [rad]
+
+    template <typename Id>
+    void Gather(const Id* ids, const size_t size, Block& block) const {
+        for (size_t i = 0; i < size; ++i) {
+            block.sin_lat[i] = sin_lat_[ids[i]];
+            block.cos_lat[i] = cos_lat_[ids[i]];
+            block.lng[i] = lng_[ids[i]];
+        }
+    }
+
+    static void ComputeBlock(const Block& from,
+                             const Block& to,
+                             const size_t size,
+                             double* distances) {
+        for (size_t i = 0; i < size; ++i)
+            distances[i] = EARTH_RADIUS*Acos(
+                from.sin_lat[i]*to.sin_lat[i]
+                + from.cos_lat[i]*to.cos_lat[i]*Cos(from.lng[i] - to.lng[i])
+            );
+    }
+
+    // For |angle| <= 2 pi, folded onto [0, pi]
+    static inline double Cos(const double angle) {
+        const double folded = std::min(std::abs(angle), 2*M_PI - std::abs(angle));
+        const double square = folded*folded;
+        double cos = COS_COEFFICIENTS.back();
+#pragma GCC unroll 16
+        for (size_t k = COS_COEFFICIENTS.size() - 1; k-- > 0;)
+            cos = cos*square + COS_COEFFICIENTS[k];
+        return cos;
+    }
+
+    // Rational asin approximation of fdlibm, with acos(x) = 2 asin(sqrt((1 - x)/2))
+    // for |x| >= 0.5. Both cases are weighted by 0 or 1 rather than selected,
+    // as selects are not if-converted under strict floating point. Arguments
+    // beyond [-1, 1] by rounding are clamped
+    static inline double Acos(const double x) {
+        const double abs_x = std::abs(x);
+        const double is_large = 0.5 + std::copysign(0.5, abs_x - 0.5);
+        const double is_small = 1. - is_large;
+        const double s = is_small*abs_x
+                       + is_large*std::sqrt(std::max(0., 0.5*(1. - abs_x)));
+        const double z = s*s;
+        const double p = z*(1.66666666666666657415e-01
+                       + z*(-3.25565818622400915405e-01
+                       + z*(2.01212532134862925881e-01
+                       + z*(-4.00555345006794114027e-02
+                       + z*(7.91534994289814532176e-04
+                       + z*3.47933107596021167570e-05)))));
+        const double q = 1. + z*(-2.40339491173441421878e+00
+                            + z*(2.02094576023350569471e+00
+                            + z*(-6.88283971605453293030e-01
+                            + z*7.70381505559019352791e-02)));
+        const double asin_s = s + s*(p/q);
+        const double acos_abs_x = is_small*(M_PI_2 - asin_s) + is_large*2*asin_s;
+        // acos(-x) = pi - acos(x)
+        return std::copysign(acos_abs_x, x) + (0.5 - std::copysign(0.5, x))*M_PI;
+    }
+};
+
+} // namespace geo
@@ -49,6 +49,9 @@ public:
 
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    // Heap bytes held by the edges and the incidence lists
+    size_t GetByteSize() const;
+
 private:
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
@@ -83,4 +86,13 @@ DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
     return graph::AsRange(incidence_lists_.at(vertex));
 }
 
+template <typename Weight>
+size_t DirectedWeightedGraph<Weight>::GetByteSize() const {
+    size_t size = edges_.capacity()*sizeof(Edge<Weight>)
+                + incidence_lists_.capacity()*sizeof(IncidenceList);
+    for (const IncidenceList& incidence_list : incidence_lists_)
+        size += incidence_list.capacity()*sizeof(EdgeId);
+    return size;
+}
+
 } // namespace graph
\ No newline at end of file
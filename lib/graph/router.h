@@ -36,6 +36,9 @@ public:
 
     std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
 
+    // Heap bytes held by the all-pairs route table
+    size_t GetByteSize() const;
+
 private:
     const Graph& graph_;
     RoutesInternalData routes_internal_data_;
@@ -120,4 +123,13 @@ std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
     return RouteInfo{weight, std::move(edges)};
 }
 
+template <typename Weight>
+size_t Router<Weight>::GetByteSize() const {
+    size_t size = routes_internal_data_.capacity()
+                  *sizeof(typename RoutesInternalData::value_type);
+    for (const auto& routes : routes_internal_data_)
+        size += routes.capacity()*sizeof(std::optional<RouteInternalData>);
+    return size;
+}
+
 }  // namespace graph
\ No newline at end of file
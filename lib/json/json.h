@@ -3,6 +3,8 @@
 #include <algorithm>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <variant>
 #include <vector>
@@ -10,8 +12,15 @@
 namespace json {
 
 class Node;
-using Dict = std::map<std::string, Node>;
-using Array = std::vector<Node>;
+// Containers take a memory resource, so a document can be laid out in an arena
+using Dict = std::pmr::map<std::string, Node>;
+using Array = std::pmr::vector<Node>;
+
+// Monotonic storage for the arrays and dicts of one document: nothing is
+// freed until the whole arena is released. Strings, dict keys included, stay
+// on the default heap, so destroying a document still visits its nodes to
+// free them; the arena only saves the container allocations
+using Arena = std::pmr::monotonic_buffer_resource;
 
 class ParsingError : public std::runtime_error {
 public:
@@ -71,6 +80,12 @@ public:
         return std::get<Array>(*this);
     }
 
+    inline Array& AsArray() {
+        if (!IsArray())
+            throw std::logic_error("not an array");
+        return std::get<Array>(*this);
+    }
+
     inline bool IsString() const {
         return std::holds_alternative<std::string>(*this);
     }
@@ -92,6 +107,12 @@ public:
         return std::get<Dict>(*this);
     }
 
+    inline Dict& AsDict() {
+        if (!IsDict())
+            throw std::logic_error("not a dict");
+        return std::get<Dict>(*this);
+    }
+
     inline bool operator==(const Node& rhs) const {
         return GetValue() == rhs.GetValue();
     }
@@ -147,15 +168,22 @@ public:
     }
 };
 
+// Keeps the arena, if any, the root containers were allocated from, and
+// releases it once the root is destroyed. Copies of the root are allocated
+// from the default resource
 class Document {
 public:
-    explicit Document(Node root) : root_(std::move(root)) {}
+    explicit Document(Node root, std::shared_ptr<Arena> arena = nullptr)
+        : arena_(std::move(arena))
+        , root_(std::move(root)) {
+    }
 
     const Node& GetRoot() const {
         return root_;
     }
 
 private:
+    std::shared_ptr<Arena> arena_; // outlives the root
     Node root_;
 };
 
@@ -167,10 +195,26 @@ inline bool operator!=(const Document& lhs, const Document& rhs) {
     return !(lhs == rhs);
 }
 
+// Reads the rest of the stream into memory and parses it in one scan
 Document Load(std::istream& input);
 
+// ---------- PrintSettings -----------
+
+struct PrintSettings {
+    // Shortest text that reads back to the same double
+    static constexpr int ROUND_TRIP = 0;
+
+    int precision = 6; // significant digits of doubles
+    bool is_pretty = true; // a line per item indented by two spaces per level
+    // Digits after the point of the doubles under these dict keys
+    std::map<std::string, int, std::less<>> fixed_precision;
+};
+
+// Prints doubles with the precision of the stream
 void Print(const Document& doc, std::ostream& output);
 
+void Print(const Document& doc, std::ostream& output, const PrintSettings& settings);
+
 std::ostream& operator<<(std::ostream& out, const Document& doc);
 
 }  // namespace json
\ No newline at end of file
@@ -5,65 +5,78 @@ namespace json {
 // ---------- Builder -----------------
 
 KeyItemContext Builder::Key(std::string key) {
-    if (!nodes_stack_.back()->IsDict() || nodes_stack_.empty())
+    if (nodes_stack_.empty() || !nodes_stack_.back()->IsDict() || key_)
         throw std::logic_error("not a dict");
+    if (nodes_stack_.back()->AsDict().count(key))
+        throw std::logic_error("duplicate key '" + key + "'");
 
-    nodes_stack_.emplace_back(std::make_unique<Node>(std::move(key)));
+    key_ = std::move(key);
     return KeyItemContext(*this);
 }
 
 Builder& Builder::Value(Node::Value value) {
-    Node node = std::visit(NodeGetter{}, std::move(value));
-
-    if (nodes_stack_.empty()) {
-        nodes_stack_.emplace_back(std::make_unique<Node>(node));
-    } else if (nodes_stack_.back()->IsArray()) {
-        Array array = ReleaseBack().AsArray();
-        array.push_back(std::move(node));
-
-        nodes_stack_.emplace_back(std::make_unique<Node>(array));
-    } else if (level_.dict && nodes_stack_.back()->IsString()) {
-        const std::string key = ReleaseBack().AsString();
-        Dict dict = ReleaseBack().AsDict();
-        dict.insert({key, std::move(node)});
-
-        nodes_stack_.emplace_back(std::make_unique<Node>(dict));
-    } else {
-        throw std::logic_error("not a dict");
-    }
-
+    Add(std::visit(NodeGetter{}, std::move(value)));
     return *this;
 }
 
 ArrayItemContext Builder::StartArray() {
-    if (IsRoot())
-        throw std::logic_error("try to add new root");
-
-    nodes_stack_.emplace_back(std::make_unique<Node>(json::Array{}));
-    ++level_.array;
+    nodes_stack_.push_back(&Add(Array(resource_)));
     return ArrayItemContext(*this);
 }
 
 DictItemContext Builder::StartDict() {
-    if (IsRoot())
-        throw std::logic_error("try to add new root");
-
-    nodes_stack_.emplace_back(std::make_unique<Node>(json::Dict{}));
-    ++level_.dict;
+    nodes_stack_.push_back(&Add(Dict(resource_)));
     return DictItemContext(*this);
 }
 
+Builder& Builder::EndArray() {
+    if (nodes_stack_.empty() || !nodes_stack_.back()->IsArray())
+        throw std::logic_error("not an array");
+
+    nodes_stack_.pop_back();
+    return *this;
+}
+
+Builder& Builder::EndDict() {
+    if (nodes_stack_.empty() || !nodes_stack_.back()->IsDict() || key_)
+        throw std::logic_error("not a dict");
+
+    nodes_stack_.pop_back();
+    return *this;
+}
+
 Node Builder::Build() {
-    if (nodes_stack_.size() != 1)
+    if (!nodes_stack_.empty())
         throw std::logic_error(
-            "root has " + std::to_string(nodes_stack_.size()) + " nodes"
-        );
-    else if (level_.array || level_.dict)
-        throw std::logic_error(
-            std::to_string(level_.array + level_.dict) + " containers are not closed"
+            std::to_string(nodes_stack_.size()) + " containers are not closed"
         );
+    else if (!has_root_)
+        throw std::logic_error("root is empty");
+
+    return std::move(root_);
+}
 
-    return *nodes_stack_.back();
+Node& Builder::Add(Node node) {
+    if (nodes_stack_.empty()) {
+        if (has_root_)
+            throw std::logic_error("try to add new root");
+
+        has_root_ = true;
+        root_ = std::move(node);
+        return root_;
+    }
+
+    // An open container only grows while it is the innermost one, so the
+    // pointers to its items on the stack stay valid
+    Node& parent = *nodes_stack_.back();
+    if (parent.IsArray())
+        return parent.AsArray().emplace_back(std::move(node));
+
+    if (!key_)
+        throw std::logic_error("not a dict");
+    Node& item = parent.AsDict().try_emplace(std::move(*key_), std::move(node)).first->second;
+    key_.reset();
+    return item;
 }
 
 // ---------- ItemContext -------------
@@ -1,7 +1,9 @@
 #pragma once
 #include "json.h"
 
-#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace json {
 
@@ -11,10 +13,18 @@ class KeyItemContext;
 class DictItemContext;
 class ArrayItemContext;
 
+// Containers are built in place: the stack points at the open ones inside
+// the root, so every value is moved into its parent once
 class Builder {
-    struct ContainerLevel { int array = 0; int dict = 0; };
-
 public:
+    // Arrays and dicts are allocated from the resource, which has to outlive
+    // the built node
+    explicit Builder(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+    ) : resource_(resource) {
+    }
+
+    // Throws on a key the dict already has, as the parser does
     KeyItemContext Key(std::string key);
 
     Builder& Value(Node::Value value);
@@ -23,39 +33,21 @@ public:
 
     DictItemContext StartDict();
 
-    inline Builder& EndArray() {
-        if (!nodes_stack_.back()->IsArray() || nodes_stack_.empty())
-            throw std::logic_error("not an array");
-
-        --level_.array;
-        return Value(ReleaseBack().AsArray());
-    }
-
-    inline Builder& EndDict() {
-        if (!nodes_stack_.back()->IsDict() || nodes_stack_.empty())
-            throw std::logic_error("not a dict");
+    Builder& EndArray();
 
-        --level_.dict;
-        return Value(ReleaseBack().AsDict());
-    }
+    Builder& EndDict();
 
     Node Build();
 
 private:
+    std::pmr::memory_resource* resource_;
     Node root_;
-    std::vector<std::unique_ptr<Node>> nodes_stack_;
-    ContainerLevel level_;
+    bool has_root_ = false;
+    std::vector<Node*> nodes_stack_; // open containers, the innermost last
+    std::optional<std::string> key_; // of the next value of the open dict
 
-    inline bool IsRoot() {
-        return !nodes_stack_.empty()
-            && !(nodes_stack_.back()->IsString() || nodes_stack_.back()->IsArray());
-    }
-
-    [[nodiscard]] inline Node ReleaseBack() {
-        Node node = *nodes_stack_.back();
-        nodes_stack_.pop_back();
-        return node;
-    }
+    // Places the node in the innermost open container or makes it the root
+    Node& Add(Node node);
 };
 
 // ---------- ItemContext -------------
@@ -0,0 +1,264 @@
+#include "json_flat.h"
+#include "json_parser.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace json {
+
+// ---------- FlatNode ----------------
+
+std::string_view FlatNode::AsString() const {
+    if (!IsString())
+        throw std::logic_error("not a string");
+    return document_->GetString(*value_);
+}
+
+const FlatValue* FlatNode::GetRun(const FlatValue::Type type) const {
+    if (value_->type != type)
+        throw std::logic_error(type == FlatValue::Type::DICT ? "not a dict" : "not an array");
+    return document_->values_.data() + value_->offset;
+}
+
+size_t FlatNode::Size() const {
+    if (!IsArray() && !IsDict())
+        throw std::logic_error("not an array or a dict");
+    return value_->size;
+}
+
+FlatNode FlatNode::At(const size_t index) const {
+    const FlatValue* run = GetRun(FlatValue::Type::ARRAY);
+    if (index >= value_->size)
+        throw std::out_of_range("index " + std::to_string(index) + " is out of range");
+    return {*document_, run[index]};
+}
+
+FlatNode FlatNode::At(const std::string_view key) const {
+    if (const std::optional<FlatNode> node = Find(key))
+        return *node;
+    throw std::out_of_range("key '" + std::string(key) + "' is not found");
+}
+
+std::optional<FlatNode> FlatNode::Find(const std::string_view key) const {
+    const FlatValue* run = GetRun(FlatValue::Type::DICT);
+    const auto get_key = [this, run](const size_t index) {
+        return document_->GetString(run[2*index]);
+    };
+
+    if (!value_->is_sorted) {
+        for (size_t i = 0; i < value_->size; ++i)
+            if (get_key(i) == key)
+                return FlatNode{*document_, run[2*i + 1]};
+        return std::nullopt;
+    }
+
+    size_t first = 0;
+    size_t last = value_->size;
+    while (first < last) {
+        const size_t middle = first + (last - first)/2;
+        if (get_key(middle) < key)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    if (first != value_->size && get_key(first) == key)
+        return FlatNode{*document_, run[2*first + 1]};
+    return std::nullopt;
+}
+
+std::string_view FlatNode::KeyAt(const size_t index) const {
+    const FlatValue* run = GetRun(FlatValue::Type::DICT);
+    if (index >= value_->size)
+        throw std::out_of_range("index " + std::to_string(index) + " is out of range");
+    return document_->GetString(run[2*index]);
+}
+
+FlatNode FlatNode::ValueAt(const size_t index) const {
+    const FlatValue* run = GetRun(FlatValue::Type::DICT);
+    if (index >= value_->size)
+        throw std::out_of_range("index " + std::to_string(index) + " is out of range");
+    return {*document_, run[2*index + 1]};
+}
+
+Node FlatNode::ToNode() const {
+    switch (value_->type) {
+        case FlatValue::Type::NUL:
+            return Node(nullptr);
+        case FlatValue::Type::BOOL:
+            return Node(value_->as_bool);
+        case FlatValue::Type::INT:
+            return Node(value_->as_int);
+        case FlatValue::Type::DOUBLE:
+            return Node(value_->as_double);
+        case FlatValue::Type::STRING:
+            return Node(std::string(AsString()));
+        case FlatValue::Type::ARRAY: {
+            Array array;
+            array.reserve(value_->size);
+            for (size_t i = 0; i < value_->size; ++i)
+                array.push_back(At(i).ToNode());
+            return Node(std::move(array));
+        }
+        case FlatValue::Type::DICT: {
+            Dict dict;
+            for (size_t i = 0; i < value_->size; ++i)
+                dict.emplace(KeyAt(i), ValueAt(i).ToNode());
+            return Node(std::move(dict));
+        }
+    }
+    return Node();
+}
+
+// ---------- FlatDocument ------------
+
+// SAX handler keeping the values of open arrays and dicts on a stack, each
+// closed one is moved to the document as a run and replaced by its header
+class FlatDocument::Builder {
+public:
+    explicit Builder(FlatDocument& document) : document_(document) {}
+
+    void Null() {
+        stack_.emplace_back();
+    }
+
+    void Bool(const bool value) {
+        FlatValue& item = stack_.emplace_back();
+        item.type = FlatValue::Type::BOOL;
+        item.as_bool = value;
+    }
+
+    void Int(const int value) {
+        FlatValue& item = stack_.emplace_back();
+        item.type = FlatValue::Type::INT;
+        item.as_int = value;
+    }
+
+    void Double(const double value) {
+        FlatValue& item = stack_.emplace_back();
+        item.type = FlatValue::Type::DOUBLE;
+        item.as_double = value;
+    }
+
+    void String(const std::string_view value) {
+        stack_.push_back(MakeString(value));
+    }
+
+    void Key(const std::string_view key) {
+        stack_.push_back(MakeString(key));
+    }
+
+    void StartArray() {
+        levels_.push_back(stack_.size());
+    }
+
+    void EndArray() {
+        Close(FlatValue::Type::ARRAY, stack_.size() - levels_.back());
+    }
+
+    void StartDict() {
+        levels_.push_back(stack_.size());
+    }
+
+    void EndDict() {
+        const size_t first = levels_.back();
+        const size_t size = (stack_.size() - first)/2;
+        const bool is_sorted = size > SORTED_DICT_SIZE;
+        if (is_sorted)
+            SortItems(first, size);
+        else
+            CheckKeys(first, size);
+
+        Close(FlatValue::Type::DICT, size);
+        stack_.back().is_sorted = is_sorted;
+    }
+
+    FlatValue Build() {
+        return stack_.back();
+    }
+
+private:
+    FlatDocument& document_;
+    std::vector<FlatValue> stack_;
+    std::vector<size_t> levels_; // stack size at the start of a run
+
+    // Strings without escapes are handed over as views into the text
+    FlatValue MakeString(const std::string_view value) {
+        const std::string& text = document_.text_;
+        const std::less<const char*> less;
+
+        FlatValue item;
+        item.type = FlatValue::Type::STRING;
+        item.size = static_cast<uint32_t>(value.size());
+        if (!less(value.data(), text.data()) && !less(text.data() + text.size(), value.data())) {
+            item.offset = value.data() - text.data();
+        } else {
+            item.is_pooled = true;
+            item.offset = document_.pool_.size();
+            document_.pool_.append(value);
+        }
+        return item;
+    }
+
+    void Close(const FlatValue::Type type, const size_t size) {
+        const size_t first = levels_.back();
+        levels_.pop_back();
+
+        std::vector<FlatValue>& values = document_.values_;
+        FlatValue run;
+        run.type = type;
+        run.size = static_cast<uint32_t>(size);
+        run.offset = values.size();
+        values.insert(values.end(), stack_.begin() + first, stack_.end());
+
+        stack_.resize(first);
+        stack_.push_back(run);
+    }
+
+    [[noreturn]] void ThrowDuplicate(const std::string_view key) const {
+        throw ParsingError("duplicate key '" + std::string(key) + "' have been found");
+    }
+
+    void CheckKeys(const size_t first, const size_t size) const {
+        for (size_t i = 1; i < size; ++i) {
+            const std::string_view key = document_.GetString(stack_[first + 2*i]);
+            for (size_t j = 0; j < i; ++j)
+                if (document_.GetString(stack_[first + 2*j]) == key)
+                    ThrowDuplicate(key);
+        }
+    }
+
+    void SortItems(const size_t first, const size_t size) {
+        std::vector<std::pair<FlatValue, FlatValue>> items(size);
+        for (size_t i = 0; i < size; ++i)
+            items[i] = {stack_[first + 2*i], stack_[first + 2*i + 1]};
+
+        std::sort(items.begin(), items.end(), [this](const auto& lhs, const auto& rhs) {
+            return document_.GetString(lhs.first) < document_.GetString(rhs.first);
+        });
+
+        for (size_t i = 0; i < size; ++i) {
+            if (i > 0 && document_.GetString(items[i].first)
+                          == document_.GetString(items[i - 1].first))
+                ThrowDuplicate(document_.GetString(items[i].first));
+            stack_[first + 2*i] = items[i].first;
+            stack_[first + 2*i + 1] = items[i].second;
+        }
+    }
+};
+
+FlatDocument::FlatDocument(std::string text) : text_(std::move(text)) {
+    if (text_.size() > std::numeric_limits<uint32_t>::max())
+        throw ParsingError("text is too large");
+
+    Builder builder(*this);
+    Parse(text_, builder);
+    root_ = builder.Build();
+}
+
+size_t FlatDocument::GetByteSize() const {
+    return text_.capacity() + pool_.capacity() + values_.capacity()*sizeof(FlatValue);
+}
+
+} // namespace json
@@ -0,0 +1,168 @@
+#pragma once
+#include "json.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+class FlatDocument;
+
+// ---------- FlatValue ---------------
+
+// 16-byte tagged value of a FlatDocument. A string refers to a slice of the
+// parsed text or, when it had escapes, of the document's string pool. An
+// array or a dict refers to a contiguous run of values, a dict run holds
+// a key string before each value
+struct FlatValue {
+    enum class Type : uint8_t {
+        NUL, BOOL, INT, DOUBLE, STRING, ARRAY, DICT
+    };
+
+    Type type = Type::NUL;
+    bool is_pooled = false; // string lives in the pool
+    bool is_sorted = false; // dict run is ordered by key
+    uint32_t size = 0; // string length or number of items
+    union {
+        bool as_bool;
+        int as_int;
+        double as_double;
+        uint64_t offset; // of the string or the first value of the run
+    };
+
+    FlatValue() : offset(0) {}
+};
+
+static_assert(sizeof(FlatValue) == 16);
+
+// ---------- FlatNode ----------------
+
+// Non-owning view of a value, valid while its document is alive and in place
+class FlatNode {
+public:
+    FlatNode(const FlatDocument& document, const FlatValue& value)
+        : document_(&document)
+        , value_(&value) {
+    }
+
+    inline bool IsNull() const {
+        return value_->type == FlatValue::Type::NUL;
+    }
+
+    inline bool IsBool() const {
+        return value_->type == FlatValue::Type::BOOL;
+    }
+
+    inline bool AsBool() const {
+        if (!IsBool())
+            throw std::logic_error("not a bool");
+        return value_->as_bool;
+    }
+
+    inline bool IsInt() const {
+        return value_->type == FlatValue::Type::INT;
+    }
+
+    inline int AsInt() const {
+        if (!IsInt())
+            throw std::logic_error("not an int");
+        return value_->as_int;
+    }
+
+    inline bool IsPureDouble() const {
+        return value_->type == FlatValue::Type::DOUBLE;
+    }
+
+    inline bool IsDouble() const {
+        return IsInt() || IsPureDouble();
+    }
+
+    inline double AsDouble() const {
+        if (!IsDouble())
+            throw std::logic_error("not a double");
+        return IsPureDouble() ? value_->as_double : value_->as_int;
+    }
+
+    inline bool IsString() const {
+        return value_->type == FlatValue::Type::STRING;
+    }
+
+    std::string_view AsString() const;
+
+    inline bool IsArray() const {
+        return value_->type == FlatValue::Type::ARRAY;
+    }
+
+    inline bool IsDict() const {
+        return value_->type == FlatValue::Type::DICT;
+    }
+
+    // Number of items of an array or a dict
+    size_t Size() const;
+
+    // Array item, throws std::out_of_range past the end
+    FlatNode At(const size_t index) const;
+
+    // Dict item, throws std::out_of_range for a missing key
+    FlatNode At(const std::string_view key) const;
+
+    std::optional<FlatNode> Find(const std::string_view key) const;
+
+    // Dict items by position, in the order of the text unless the dict is
+    // large enough to be sorted by key
+    std::string_view KeyAt(const size_t index) const;
+
+    FlatNode ValueAt(const size_t index) const;
+
+    // Copies the value into a regular node tree
+    Node ToNode() const;
+
+private:
+    const FlatDocument* document_;
+    const FlatValue* value_;
+
+    const FlatValue* GetRun(const FlatValue::Type type) const;
+};
+
+// ---------- FlatDocument ------------
+
+// Compact document: every value is kept in one array and strings are not
+// copied out of the text unless they had escapes
+class FlatDocument {
+public:
+    // Dicts of more items are sorted by key to be searched in halves, smaller
+    // ones are scanned
+    static constexpr uint32_t SORTED_DICT_SIZE = 8;
+
+    explicit FlatDocument(std::string text);
+
+    inline FlatNode GetRoot() const {
+        return {*this, root_};
+    }
+
+    inline size_t GetValueCount() const {
+        return values_.size();
+    }
+
+    // Heap footprint of the text, the pool and the values
+    size_t GetByteSize() const;
+
+private:
+    friend class FlatNode;
+    class Builder;
+
+    std::string text_;
+    std::string pool_; // strings with escapes, decoded
+    std::vector<FlatValue> values_;
+    FlatValue root_;
+
+    inline std::string_view GetString(const FlatValue& value) const {
+        const std::string& source = value.is_pooled ? pool_ : text_;
+        return {source.data() + value.offset, value.size};
+    }
+};
+
+} // namespace json
@@ -0,0 +1,85 @@
+#include "json_parser.h"
+
+namespace json {
+
+// ---------- DomBuilder --------------
+
+void DomBuilder::Null() {
+    Add(Node(nullptr));
+}
+
+void DomBuilder::Bool(const bool value) {
+    Add(Node(value));
+}
+
+void DomBuilder::Int(const int value) {
+    Add(Node(value));
+}
+
+void DomBuilder::Double(const double value) {
+    Add(Node(value));
+}
+
+void DomBuilder::String(const std::string_view value) {
+    Add(Node(std::string(value)));
+}
+
+void DomBuilder::Key(const std::string_view key) {
+    levels_.back().key.assign(key.data(), key.size());
+}
+
+void DomBuilder::StartArray() {
+    levels_.push_back({false, Array(resource_), Dict(resource_), {}});
+}
+
+void DomBuilder::EndArray() {
+    Array array = std::move(levels_.back().array);
+    levels_.pop_back();
+    Add(Node(std::move(array)));
+}
+
+void DomBuilder::StartDict() {
+    levels_.push_back({true, Array(resource_), Dict(resource_), {}});
+}
+
+void DomBuilder::EndDict() {
+    Dict dict = std::move(levels_.back().dict);
+    levels_.pop_back();
+    Add(Node(std::move(dict)));
+}
+
+void DomBuilder::Add(Node node) {
+    if (levels_.empty()) {
+        root_ = std::move(node);
+        return;
+    }
+
+    Level& level = levels_.back();
+    if (!level.is_dict) {
+        level.array.push_back(std::move(node));
+    } else if (!level.dict.try_emplace(level.key, std::move(node)).second) {
+        throw ParsingError("duplicate key '" + level.key + "' have been found");
+    }
+}
+
+Node DomBuilder::Build() {
+    return std::move(root_);
+}
+
+// ------------------------------------
+
+std::string ReadAll(std::istream& input) {
+    std::string text;
+    char chunk[1 << 16];
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0)
+        text.append(chunk, static_cast<size_t>(input.gcount()));
+    return text;
+}
+
+Document Load(const std::string_view text, std::shared_ptr<Arena> arena) {
+    DomBuilder builder(arena ? arena.get() : std::pmr::get_default_resource());
+    Parse(text, builder);
+    return Document{builder.Build(), std::move(arena)};
+}
+
+} // namespace json
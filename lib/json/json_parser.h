@@ -0,0 +1,369 @@
+#pragma once
+#include "json.h"
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+// ---------- Parser ------------------
+
+// Scans a JSON text held in memory with a pointer and reports it as SAX
+// events to the handler:
+//     Null(), Bool(bool), Int(int), Double(double), String(std::string_view),
+//     Key(std::string_view), StartArray(), EndArray(), StartDict(), EndDict()
+// String views point into the text unless the string has escapes, either way
+// they are valid during the call only
+template <typename Handler>
+class Parser {
+public:
+    Parser(std::string_view text, Handler& handler)
+        : begin_(text.data())
+        , it_(text.data())
+        , end_(text.data() + text.size())
+        , handler_(handler) {
+    }
+
+    // The text must hold exactly one value surrounded by whitespace
+    void Parse() {
+        ParseValue();
+        SkipWhitespace();
+        if (it_ != end_)
+            Throw("unexpected trailing character");
+    }
+
+private:
+    const char* begin_;
+    const char* it_;
+    const char* end_;
+    Handler& handler_;
+    std::string unescaped_;
+
+    [[noreturn]] void Throw(const std::string& message) const {
+        throw ParsingError(message + " at offset " + std::to_string(it_ - begin_));
+    }
+
+    inline void SkipWhitespace() {
+        while (it_ != end_ && (*it_ == ' ' || *it_ == '\n' || *it_ == '\r' || *it_ == '\t'))
+            ++it_;
+    }
+
+    // Skips whitespace and returns the next character without consuming it
+    inline char Peek() {
+        SkipWhitespace();
+        if (it_ == end_)
+            Throw("unexpected end of input");
+        return *it_;
+    }
+
+    void ParseValue() {
+        switch (Peek()) {
+            case '{':
+                ParseDict();
+                break;
+            case '[':
+                ParseArray();
+                break;
+            case '"':
+                handler_.String(ParseString());
+                break;
+            case 't':
+                ParseLiteral("true");
+                handler_.Bool(true);
+                break;
+            case 'f':
+                ParseLiteral("false");
+                handler_.Bool(false);
+                break;
+            case 'n':
+                ParseLiteral("null");
+                handler_.Null();
+                break;
+            default:
+                ParseNumber();
+        }
+    }
+
+    void ParseLiteral(const std::string_view literal) {
+        if (static_cast<size_t>(end_ - it_) < literal.size()
+            || std::string_view(it_, literal.size()) != literal)
+            Throw("failed to parse '" + std::string(literal) + "'");
+        it_ += literal.size();
+    }
+
+    void ParseArray() {
+        ++it_;
+        handler_.StartArray();
+        if (Peek() == ']') {
+            ++it_;
+            handler_.EndArray();
+            return;
+        }
+
+        while (true) {
+            ParseValue();
+            const char c = Peek();
+            ++it_;
+            if (c == ']')
+                break;
+            if (c != ',')
+                Throw("',' or ']' is expected");
+        }
+        handler_.EndArray();
+    }
+
+    void ParseDict() {
+        ++it_;
+        handler_.StartDict();
+        if (Peek() == '}') {
+            ++it_;
+            handler_.EndDict();
+            return;
+        }
+
+        while (true) {
+            if (Peek() != '"')
+                Throw("key is expected");
+            handler_.Key(ParseString());
+
+            if (Peek() != ':')
+                Throw("':' is expected");
+            ++it_;
+            ParseValue();
+
+            const char c = Peek();
+            ++it_;
+            if (c == '}')
+                break;
+            if (c != ',')
+                Throw("',' or '}' is expected");
+        }
+        handler_.EndDict();
+    }
+
+    std::string_view ParseString() {
+        const char* first = ++it_;
+        while (it_ != end_ && *it_ != '"' && *it_ != '\\' && *it_ != '\n' && *it_ != '\r')
+            ++it_;
+        if (it_ == end_)
+            Throw("string parsing error");
+        if (*it_ == '"')
+            return {first, static_cast<size_t>(it_++ - first)};
+        if (*it_ != '\\')
+            Throw("unexpected end of line");
+
+        // Escaped strings are decoded into a scratch buffer from here on
+        unescaped_.assign(first, it_);
+        while (true) {
+            if (it_ == end_)
+                Throw("string parsing error");
+
+            const char c = *it_++;
+            if (c == '"')
+                return unescaped_;
+            if (c == '\n' || c == '\r')
+                Throw("unexpected end of line");
+            if (c != '\\') {
+                unescaped_.push_back(c);
+                continue;
+            }
+
+            if (it_ == end_)
+                Throw("string parsing error");
+            switch (const char escaped = *it_++) {
+                case '"':
+                case '\\':
+                case '/':
+                    unescaped_.push_back(escaped);
+                    break;
+                case 'b':
+                    unescaped_.push_back('\b');
+                    break;
+                case 'f':
+                    unescaped_.push_back('\f');
+                    break;
+                case 'n':
+                    unescaped_.push_back('\n');
+                    break;
+                case 'r':
+                    unescaped_.push_back('\r');
+                    break;
+                case 't':
+                    unescaped_.push_back('\t');
+                    break;
+                case 'u':
+                    AppendCodePoint(ParseCodePoint());
+                    break;
+                default:
+                    Throw(std::string("unrecognized escape sequence \\") + escaped);
+            }
+        }
+    }
+
+    unsigned ParseHex() {
+        if (end_ - it_ < 4)
+            Throw("incomplete unicode escape");
+
+        unsigned code = 0;
+        for (const char* last = it_ + 4; it_ != last; ++it_) {
+            const char c = *it_;
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= c - '0';
+            else if (c >= 'a' && c <= 'f')
+                code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                code |= c - 'A' + 10;
+            else
+                Throw("invalid unicode escape");
+        }
+        return code;
+    }
+
+    unsigned ParseCodePoint() {
+        const unsigned code = ParseHex();
+        if (code < 0xD800 || code > 0xDBFF)
+            return code;
+
+        // A high surrogate must be followed by an escaped low one
+        if (end_ - it_ < 2 || it_[0] != '\\' || it_[1] != 'u')
+            Throw("unpaired surrogate");
+        it_ += 2;
+        const unsigned low = ParseHex();
+        if (low < 0xDC00 || low > 0xDFFF)
+            Throw("unpaired surrogate");
+        return 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    void AppendCodePoint(const unsigned code) {
+        if (code < 0x80) {
+            unescaped_.push_back(static_cast<char>(code));
+        } else if (code < 0x800) {
+            unescaped_.push_back(static_cast<char>(0xC0 | (code >> 6)));
+            unescaped_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            unescaped_.push_back(static_cast<char>(0xE0 | (code >> 12)));
+            unescaped_.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            unescaped_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        } else {
+            unescaped_.push_back(static_cast<char>(0xF0 | (code >> 18)));
+            unescaped_.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+            unescaped_.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+            unescaped_.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+        }
+    }
+
+    inline bool IsDigit() const {
+        return it_ != end_ && *it_ >= '0' && *it_ <= '9';
+    }
+
+    void SkipDigits() {
+        if (!IsDigit())
+            Throw("a digit is expected");
+        while (IsDigit())
+            ++it_;
+    }
+
+    void ParseNumber() {
+        const char* first = it_;
+        if (*it_ == '-')
+            ++it_;
+        // JSON allows no other digits after a leading zero
+        if (it_ != end_ && *it_ == '0')
+            ++it_;
+        else
+            SkipDigits();
+
+        bool is_int = true;
+        if (it_ != end_ && *it_ == '.') {
+            ++it_;
+            SkipDigits();
+            is_int = false;
+        }
+        if (it_ != end_ && (*it_ == 'e' || *it_ == 'E')) {
+            ++it_;
+            if (it_ != end_ && (*it_ == '+' || *it_ == '-'))
+                ++it_;
+            SkipDigits();
+            is_int = false;
+        }
+
+        if (is_int) {
+            int value = 0;
+            if (std::from_chars(first, it_, value).ec != std::errc{})
+                Throw("failed to convert " + std::string(first, it_) + " to int");
+            handler_.Int(value);
+            return;
+        }
+
+        double value = 0;
+        if (std::from_chars(first, it_, value).ec != std::errc{})
+            Throw("failed to convert " + std::string(first, it_) + " to double");
+        handler_.Double(value);
+    }
+};
+
+template <typename Handler>
+void Parse(const std::string_view text, Handler& handler) {
+    Parser<Handler>(text, handler).Parse();
+}
+
+// ---------- DomBuilder --------------
+
+// SAX handler assembling the parsed events into a node tree, the arrays and
+// dicts are allocated from the given resource
+class DomBuilder {
+public:
+    explicit DomBuilder(
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+    ) : resource_(resource) {
+    }
+
+    void Null();
+
+    void Bool(const bool value);
+
+    void Int(const int value);
+
+    void Double(const double value);
+
+    void String(const std::string_view value);
+
+    void Key(const std::string_view key);
+
+    void StartArray();
+
+    void EndArray();
+
+    void StartDict();
+
+    void EndDict();
+
+    Node Build();
+
+private:
+    struct Level {
+        bool is_dict;
+        Array array;
+        Dict dict;
+        std::string key;
+    };
+
+    std::pmr::memory_resource* resource_;
+    std::vector<Level> levels_;
+    Node root_;
+
+    void Add(Node node);
+};
+
+// ------------------------------------
+
+// Reads the rest of the stream into one buffer
+std::string ReadAll(std::istream& input);
+
+// Lays the document out in the arena when one is given
+Document Load(const std::string_view text, std::shared_ptr<Arena> arena = nullptr);
+
+} // namespace json
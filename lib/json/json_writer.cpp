@@ -0,0 +1,261 @@
+#include "json_writer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace json {
+
+namespace {
+
+inline bool NeedsEscape(const char c) {
+    return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+}
+
+// Checks eight bytes at once for a quote, a backslash or a control character
+inline bool HasEscape(const char* it) {
+    constexpr uint64_t ONES = 0x0101010101010101ull;
+    constexpr uint64_t HIGHS = 0x8080808080808080ull;
+
+    uint64_t word;
+    std::memcpy(&word, it, sizeof(word));
+    const uint64_t quotes = word ^ (ONES*'"');
+    const uint64_t backslashes = word ^ (ONES*'\\');
+    return (((quotes - ONES) & ~quotes)
+          | ((backslashes - ONES) & ~backslashes)
+          | ((word - ONES*0x20) & ~word)) & HIGHS;
+}
+
+// Returns the first character to escape, the words before it are skipped
+// whole
+const char* FindEscape(const char* it, const char* end) {
+    while (true) {
+        while (end - it >= 8 && !HasEscape(it))
+            it += 8;
+
+        for (const char* last = std::min(it + 8, end); it != last; ++it)
+            if (NeedsEscape(*it))
+                return it;
+        if (it == end)
+            return end;
+    }
+}
+
+} // namespace
+
+// ---------- Writer ------------------
+
+Writer::Writer(std::ostream& output, PrintSettings settings, const size_t depth)
+    : output_(output)
+    , settings_(std::move(settings))
+    , depth_(depth) {
+    buffer_.reserve(BUFFER_SIZE + BUFFER_SIZE/4);
+}
+
+Writer::~Writer() {
+    Flush();
+}
+
+Writer& Writer::Null() {
+    StartValue();
+    buffer_.append("null");
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::Bool(const bool value) {
+    StartValue();
+    buffer_.append(value ? "true" : "false");
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::Int(const int value) {
+    StartValue();
+    char chars[16];
+    const char* last = std::to_chars(chars, std::end(chars), value).ptr;
+    buffer_.append(chars, last - chars);
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::Double(const double value) {
+    const int fixed_precision = fixed_precision_;
+    StartValue();
+
+    // A fixed notation too long for the local buffer falls back to the
+    // shortest exact one
+    char chars[64];
+    std::to_chars_result result;
+    if (fixed_precision != NO_FIXED_PRECISION)
+        result = std::to_chars(chars, std::end(chars), value,
+                               std::chars_format::fixed, fixed_precision);
+    else if (settings_.precision != PrintSettings::ROUND_TRIP)
+        result = std::to_chars(chars, std::end(chars), value,
+                               std::chars_format::general, settings_.precision);
+    else
+        result = std::to_chars(chars, std::end(chars), value);
+    if (result.ec != std::errc{})
+        result = std::to_chars(chars, std::end(chars), value);
+
+    buffer_.append(chars, result.ptr - chars);
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::String(const std::string_view value) {
+    StartValue();
+    WriteString(value);
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::Key(const std::string_view key) {
+    Level& level = levels_.back();
+    if (level.count++ > 0)
+        buffer_.push_back(',');
+    if (settings_.is_pretty)
+        Indent(levels_.size());
+
+    WriteString(key);
+    buffer_.push_back(':');
+    if (settings_.is_pretty)
+        buffer_.push_back(' ');
+
+    const auto it = settings_.fixed_precision.find(key);
+    fixed_precision_ = (it != settings_.fixed_precision.end()) ? it->second : NO_FIXED_PRECISION;
+    return *this;
+}
+
+Writer& Writer::StartArray() {
+    StartValue();
+    buffer_.push_back('[');
+    levels_.push_back({false, 0});
+    return *this;
+}
+
+Writer& Writer::EndArray() {
+    const size_t count = levels_.back().count;
+    levels_.pop_back();
+    if (settings_.is_pretty && count > 0)
+        Indent(levels_.size());
+    buffer_.push_back(']');
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::StartDict() {
+    StartValue();
+    buffer_.push_back('{');
+    levels_.push_back({true, 0});
+    return *this;
+}
+
+Writer& Writer::EndDict() {
+    const size_t count = levels_.back().count;
+    levels_.pop_back();
+    if (settings_.is_pretty && count > 0)
+        Indent(levels_.size());
+    buffer_.push_back('}');
+    FlushIfFull();
+    return *this;
+}
+
+Writer& Writer::Value(const Node& node) {
+    if (node.IsNull()) {
+        Null();
+    } else if (node.IsBool()) {
+        Bool(node.AsBool());
+    } else if (node.IsInt()) {
+        Int(node.AsInt());
+    } else if (node.IsPureDouble()) {
+        Double(node.AsDouble());
+    } else if (node.IsString()) {
+        String(node.AsString());
+    } else if (node.IsArray()) {
+        StartArray();
+        for (const Node& item : node.AsArray())
+            Value(item);
+        EndArray();
+    } else {
+        StartDict();
+        for (const auto& [key, item] : node.AsDict()) {
+            Key(key);
+            Value(item);
+        }
+        EndDict();
+    }
+    return *this;
+}
+
+Writer& Writer::Raw(const std::string_view text) {
+    StartValue();
+    buffer_.append(text);
+    FlushIfFull();
+    return *this;
+}
+
+void Writer::Flush() {
+    output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
+
+void Writer::StartValue() {
+    fixed_precision_ = NO_FIXED_PRECISION;
+    if (levels_.empty() || levels_.back().is_dict)
+        return;
+
+    if (levels_.back().count++ > 0)
+        buffer_.push_back(',');
+    if (settings_.is_pretty)
+        Indent(levels_.size());
+}
+
+void Writer::Indent(const size_t depth) {
+    buffer_.push_back('\n');
+    buffer_.append(2*(depth_ + depth), ' ');
+}
+
+void Writer::WriteString(const std::string_view value) {
+    buffer_.push_back('"');
+
+    const char* it = value.data();
+    const char* end = value.data() + value.size();
+    while (it != end) {
+        const char* escaped = FindEscape(it, end);
+        buffer_.append(it, escaped - it);
+        if (escaped == end)
+            break;
+
+        switch (const char c = *escaped) {
+            case '"':
+                buffer_.append("\\\"");
+                break;
+            case '\\':
+                buffer_.append("\\\\");
+                break;
+            case '\n':
+                buffer_.append("\\n");
+                break;
+            case '\r':
+                buffer_.append("\\r");
+                break;
+            case '\t':
+                buffer_.append("\\t");
+                break;
+            default: {
+                static const char HEX[] = "0123456789abcdef";
+                const char code[] = {'\\', 'u', '0', '0', HEX[(c >> 4) & 0xF], HEX[c & 0xF]};
+                buffer_.append(code, sizeof(code));
+            }
+        }
+        it = escaped + 1;
+    }
+
+    buffer_.push_back('"');
+}
+
+} // namespace json
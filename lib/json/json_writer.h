@@ -0,0 +1,92 @@
+#pragma once
+#include "json.h"
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace json {
+
+// ---------- Writer ------------------
+
+// Formats values into its own buffer and hands it to the stream in large
+// blocks. Takes the same events the parser reports, so it can also be used
+// as a parser handler to reformat a text. The calls chain as Builder ones do
+// but are not checked: keys go in dicts only, each followed by one value
+class Writer {
+public:
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    // Values of a writer at a nonzero depth are indented as if they were
+    // nested that deep, so that its text can be spliced into another writer
+    explicit Writer(std::ostream& output,
+                    PrintSettings settings = {},
+                    const size_t depth = 0);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer();
+
+    Writer& Null();
+
+    Writer& Bool(const bool value);
+
+    Writer& Int(const int value);
+
+    Writer& Double(const double value);
+
+    Writer& String(const std::string_view value);
+
+    Writer& Key(const std::string_view key);
+
+    Writer& StartArray();
+
+    Writer& EndArray();
+
+    Writer& StartDict();
+
+    Writer& EndDict();
+
+    Writer& Value(const Node& node);
+
+    // Writes a value formatted by another writer as is
+    Writer& Raw(const std::string_view text);
+
+    inline const PrintSettings& GetSettings() const {
+        return settings_;
+    }
+
+    // Writes out the buffered text
+    void Flush();
+
+private:
+    static constexpr int NO_FIXED_PRECISION = -1;
+
+    struct Level {
+        bool is_dict;
+        size_t count;
+    };
+
+    std::ostream& output_;
+    PrintSettings settings_;
+    size_t depth_;
+    std::string buffer_;
+    std::vector<Level> levels_;
+    int fixed_precision_ = NO_FIXED_PRECISION; // of the value after the key
+
+    // Separates the value from the previous one unless it follows a key
+    void StartValue();
+
+    void Indent(const size_t depth);
+
+    void WriteString(const std::string_view value);
+
+    inline void FlushIfFull() {
+        if (buffer_.size() >= BUFFER_SIZE)
+            Flush();
+    }
+};
+
+} // namespace json
@@ -151,12 +151,22 @@ void Text::RenderObject(const RenderContext& context) const {
 // ---------- Document ----------------
 
 void Document::Render(std::ostream& out) const {
-    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
-        << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n";
+    RenderHeader(out);
+    RenderObjects(out);
+    RenderFooter(out);
+}
 
+void Document::RenderObjects(std::ostream& out) const {
     for (const std::unique_ptr<Object>& object : objects_)
         object->Render(RenderContext(out, 2, 2));
+}
+
+void Document::RenderHeader(std::ostream& out) {
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+        << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">\n";
+}
 
+void Document::RenderFooter(std::ostream& out) {
     out << "</svg>";
 }
 
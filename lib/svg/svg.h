@@ -303,6 +303,14 @@ public:
     // Выводит в ostream svg-представление документа
     void Render(std::ostream& out) const;
 
+    // Выводит только объекты документа, чтобы собрать документ из частей,
+    // выведенных по отдельности между заголовком и окончанием
+    void RenderObjects(std::ostream& out) const;
+
+    static void RenderHeader(std::ostream& out);
+
+    static void RenderFooter(std::ostream& out);
+
 private:
     std::vector<std::unique_ptr<Object>> objects_;
 };
@@ -0,0 +1,95 @@
+#include "geo/geo.h"
+#include "json/json_builder.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+static const size_t STOP_COUNT = 10'000;
+static const size_t SEQUENCE_SIZE = 1'000'000;
+
+struct Benchmark {
+    double scalar_ms;
+    double batch_ms;
+    size_t mismatch_count;
+};
+
+template <typename Function>
+double Measure(Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double, std::milli> duration
+        = std::chrono::steady_clock::now() - start;
+    return duration.count();
+}
+
+Benchmark RunBenchmark() {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> lat(55.5, 55.9);
+    std::uniform_real_distribution<double> lng(37.3, 37.9);
+    std::uniform_int_distribution<uint32_t> stop_id(0, STOP_COUNT - 1);
+
+    std::vector<geo::Coordinates> coordinates(STOP_COUNT);
+    geo::PointColumns columns;
+    columns.Reserve(STOP_COUNT);
+    for (geo::Coordinates& point : coordinates) {
+        point = {lat(generator), lng(generator)};
+        columns.Add(point);
+    }
+
+    std::vector<uint32_t> sequence(SEQUENCE_SIZE);
+    for (uint32_t& id : sequence)
+        id = stop_id(generator);
+
+    std::vector<double> scalar(SEQUENCE_SIZE - 1);
+    std::vector<double> batch(SEQUENCE_SIZE - 1);
+
+    Benchmark benchmark;
+    benchmark.scalar_ms = Measure([&] {
+        for (size_t i = 0; i + 1 < SEQUENCE_SIZE; ++i)
+            scalar[i] = geo::ComputeDistance(
+                coordinates[sequence[i]],
+                coordinates[sequence[i + 1]]
+            );
+    });
+    benchmark.batch_ms = Measure([&] {
+        columns.ComputeSequenceDistances(sequence.data(), sequence.size(), batch.data());
+    });
+
+    benchmark.mismatch_count = 0;
+    for (size_t i = 0; i < scalar.size(); ++i)
+        if (!(std::abs(scalar[i] - batch[i]) < 1e-3))
+            ++benchmark.mismatch_count;
+
+    return benchmark;
+}
+
+} // end namespace
+
+int main() {
+    using namespace std;
+
+    const Benchmark benchmark = RunBenchmark();
+    if (benchmark.mismatch_count) {
+        cerr << benchmark.mismatch_count << " batch distances differ from scalar ones" << endl;
+        return 1;
+    }
+    json::Print(
+        json::Document{
+            json::Builder{}
+                .StartDict()
+                    .Key("sequence_size"s).Value(static_cast<int>(SEQUENCE_SIZE))
+                    .Key("scalar_ms"s).Value(benchmark.scalar_ms)
+                    .Key("batch_ms"s).Value(benchmark.batch_ms)
+                .EndDict()
+                .Build()
+        },
+        cout
+    );
+    cout << endl;
+
+    return 0;
+}
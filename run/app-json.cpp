@@ -1,9 +1,13 @@
 #include "json/json_builder.h"
+#include "json/json_flat.h"
+#include "json/json_parser.h"
+#include "json/json_writer.h"
 
-#include <cassert>
 #include <chrono>
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 
 namespace {
 
@@ -31,30 +35,174 @@ int Benchmark() {
     json::Print(Document{arr}, strm);
 
     const auto doc = json::Load(strm);
-    assert(doc.GetRoot() == arr);
+    if (doc.GetRoot() != arr)
+        throw std::runtime_error("printed and loaded array differs");
 
     const auto duration = std::chrono::steady_clock::now() - start;
     return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
 }
 
+// Builds a document shaped like input_generator base requests, each stop
+// with a dict of road distances, and returns the time it took in ms
+double MeasureBuilder(const int stop_count) {
+    const auto start = std::chrono::steady_clock::now();
+
+    Builder builder;
+    builder.StartDict().Key("base_requests").StartArray();
+    for (int i = 0; i < stop_count; ++i) {
+        builder.StartDict()
+            .Key("latitude").Value(55.6 + i*1e-6)
+            .Key("longitude").Value(37.2 + i*1e-6)
+            .Key("name").Value("Stop " + std::to_string(i))
+            .Key("road_distances").StartDict();
+        for (int j = 1; j <= 8; ++j)
+            builder.Key("Stop " + std::to_string((i + j)%stop_count)).Value(1000 + j);
+        builder.EndDict()
+            .Key("type").Value("Stop")
+        .EndDict();
+    }
+    const Node root = builder.EndArray().EndDict().Build();
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+    const size_t built_count = root.AsDict().at("base_requests").AsArray().size();
+    if (built_count != static_cast<size_t>(stop_count))
+        throw std::runtime_error("built " + std::to_string(built_count) + " of "
+                                 + std::to_string(stop_count) + " stops");
+    return duration.count();
+}
+
+// Builds dicts nested depth times, each under the key of its parent, and
+// returns the time it took in ms
+double MeasureNestedBuilder(const int depth) {
+    const auto start = std::chrono::steady_clock::now();
+
+    Builder builder;
+    for (int i = 0; i < depth; ++i)
+        builder.StartDict().Key("child");
+    builder.Value(depth);
+    for (int i = 0; i < depth; ++i)
+        builder.EndDict();
+    const Node root = builder.Build();
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+    const Node* node = &root;
+    for (int i = 0; i < depth; ++i)
+        node = &node->AsDict().at("child");
+    if (node->AsInt() != depth)
+        throw std::runtime_error("nested value is not at depth " + std::to_string(depth));
+    return duration.count();
+}
+
+// Each value is moved into its container once, so four times the items or
+// the depth take about four times as long rather than sixteen
+Dict BenchmarkBuilder() {
+    static const int STOP_COUNT = 50'000;
+    static const int DEPTH = 10'000;
+
+    return Builder{}
+        .StartDict()
+            .Key("depth").Value(DEPTH)
+            .Key("ms").Value(MeasureBuilder(STOP_COUNT))
+            .Key("ms_4x").Value(MeasureBuilder(4*STOP_COUNT))
+            .Key("nested_ms").Value(MeasureNestedBuilder(DEPTH))
+            .Key("nested_ms_4x").Value(MeasureNestedBuilder(4*DEPTH))
+            .Key("stops").Value(STOP_COUNT)
+        .EndDict()
+        .Build()
+        .AsDict();
+}
+
+// Counts the events only, so that the scan itself is measured
+struct EventCounter {
+    size_t count = 0;
+
+    void Null() { ++count; }
+    void Bool(bool) { ++count; }
+    void Int(int) { ++count; }
+    void Double(double) { ++count; }
+    void String(std::string_view) { ++count; }
+    void Key(std::string_view) { ++count; }
+    void StartArray() { ++count; }
+    void EndArray() { ++count; }
+    void StartDict() { ++count; }
+    void EndDict() { ++count; }
+};
+
+template <typename Function>
+double MeasureThroughput(const size_t byte_count, Function function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return byte_count/duration.count()/(1 << 20);
+}
+
+// Parses a file, e.g. input_generator output, with the SAX scanner alone and
+// into both kinds of documents, reporting each in MB/s
+Dict BenchmarkFile(const std::string& file_name) {
+    std::ifstream file(file_name, std::ios::binary);
+    if (!file)
+        throw std::invalid_argument("unable to open " + file_name);
+    const std::string text = ReadAll(file);
+
+    EventCounter counter;
+    const double sax_throughput = MeasureThroughput(text.size(), [&] {
+        Parse(text, counter);
+    });
+    const double dom_throughput = MeasureThroughput(text.size(), [&] {
+        Load(text);
+    });
+    const double arena_throughput = MeasureThroughput(text.size(), [&] {
+        Load(text, std::make_shared<Arena>());
+    });
+    const Document doc = Load(text);
+    PrintSettings compact;
+    compact.is_pretty = false;
+    std::ostringstream out;
+    const double write_throughput = MeasureThroughput(text.size(), [&] {
+        Writer(out, compact).Value(doc.GetRoot());
+    });
+
+    size_t flat_bytes = 0;
+    const double flat_throughput = MeasureThroughput(text.size(), [&] {
+        flat_bytes = FlatDocument(text).GetByteSize();
+    });
+
+    return Builder{}
+        .StartDict()
+            .Key("arena_mb_per_s").Value(arena_throughput)
+            .Key("bytes").Value(static_cast<double>(text.size()))
+            .Key("dom_mb_per_s").Value(dom_throughput)
+            .Key("events").Value(static_cast<double>(counter.count))
+            .Key("flat_bytes").Value(static_cast<double>(flat_bytes))
+            .Key("flat_mb_per_s").Value(flat_throughput)
+            .Key("sax_mb_per_s").Value(sax_throughput)
+            .Key("write_mb_per_s").Value(write_throughput)
+        .EndDict()
+        .Build()
+        .AsDict();
+}
+
 } // end namespace
 
-int main() {
+int main(int argc, char* argv[]) {
     using namespace std;
 
-    json::Print(
-        json::Document{
-            json::Builder{}
-                .StartDict()
-                    .Key("benchmark_ms"s).Value(Benchmark())
-                    .Key("string"s).Value("text"s)
-                    .Key("numeric"s).Value(0.5)
-                    .Key("bool"s).StartArray().Value(true).Value(false).EndArray()
-                .EndDict()
-                .Build()
-        },
-        cout
-    );
+    Builder builder;
+    try {
+        builder.StartDict()
+            .Key("benchmark_ms"s).Value(Benchmark())
+            .Key("string"s).Value("text"s)
+            .Key("numeric"s).Value(0.5)
+            .Key("bool"s).StartArray().Value(true).Value(false).EndArray()
+            .Key("builder"s).Value(BenchmarkBuilder());
+        if (argc > 1)
+            builder.Key("parse"s).Value(BenchmarkFile(argv[1]));
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    json::Print(json::Document{builder.EndDict().Build()}, cout);
     cout << endl;
 
     return 0;
@@ -1,4 +1,8 @@
 #include "json/json.h"
+#include "json/json_builder.h"
+#include "json/json_flat.h"
+#include "json/json_parser.h"
+#include "json/json_writer.h"
 
 #include <cassert>
 #include <sstream>
@@ -141,6 +145,159 @@ TEST(json, Map) {
 
     ASSERT_THROW(LoadJSON("{"), json::ParsingError);
     ASSERT_THROW(LoadJSON("}"), json::ParsingError);
+
+    // A repeated key is rejected rather than overwriting the first value
+    ASSERT_THROW(LoadJSON(R"({"a": 1, "a": 2})"), json::ParsingError);
+    ASSERT_THROW(Builder{}.StartDict().Key("a").Value(1).Key("a"), std::logic_error);
+}
+
+TEST(json, Escapes) {
+    ASSERT_EQ(LoadJSON(R"("a\"b\\c\/d\n")"s).GetRoot().AsString(), "a\"b\\c/d\n"s);
+    ASSERT_EQ(LoadJSON(R"("\u0041\u00e9\u20ac")"s).GetRoot().AsString(), "A\xC3\xA9\xE2\x82\xAC"s);
+    ASSERT_EQ(LoadJSON(R"("\ud83d\ude8c")"s).GetRoot().AsString(), "\xF0\x9F\x9A\x8C"s);
+
+    ASSERT_THROW(LoadJSON(R"("\x")"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON(R"("\ud83d")"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON("[1 2]"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON("[1,]"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON("{\"a\": 1, \"a\": 2}"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON("1 2"s), json::ParsingError);
+    ASSERT_THROW(LoadJSON("99999999999"s), json::ParsingError);
+}
+
+TEST(json, SaxEvents) {
+    struct Recorder {
+        std::vector<std::string> events;
+
+        void Null() { events.push_back("null"); }
+        void Bool(bool value) { events.push_back(value ? "true" : "false"); }
+        void Int(int value) { events.push_back("int " + std::to_string(value)); }
+        void Double(double value) { events.push_back("double " + std::to_string(value)); }
+        void String(std::string_view value) { events.push_back("string " + std::string(value)); }
+        void Key(std::string_view key) { events.push_back("key " + std::string(key)); }
+        void StartArray() { events.push_back("["); }
+        void EndArray() { events.push_back("]"); }
+        void StartDict() { events.push_back("{"); }
+        void EndDict() { events.push_back("}"); }
+    } recorder;
+
+    json::Parse(R"({"a": [1, 0.5, "x\ty"], "b": {}, "c": null, "d": true})"sv, recorder);
+    ASSERT_EQ(recorder.events, (std::vector<std::string>{
+        "{", "key a", "[", "int 1", "double 0.500000", "string x\ty", "]",
+        "key b", "{", "}", "key c", "null", "key d", "true", "}"
+    }));
+}
+
+TEST(json, NumberFormat) {
+    const auto print = [](const Node& node, const PrintSettings& settings) {
+        std::ostringstream out;
+        json::Print(Document{node}, out, settings);
+        return out.str();
+    };
+
+    PrintSettings settings;
+    ASSERT_EQ(print(1.0/3, settings), "0.333333"s);
+    ASSERT_EQ(print(-2147483647 - 1, settings), "-2147483648"s);
+
+    settings.precision = PrintSettings::ROUND_TRIP;
+    ASSERT_EQ(print(0.1 + 0.2, settings), "0.30000000000000004"s);
+    ASSERT_EQ(LoadJSON(print(1.0/3, settings)).GetRoot().AsDouble(), 1.0/3);
+
+    settings.fixed_precision.emplace("total_time", 2);
+    ASSERT_EQ(print(Dict{{"total_time", 11.2351}, {"time", 0.5}, {"count", 3}}, settings),
+              "{\n  \"count\": 3,\n  \"time\": 0.5,\n  \"total_time\": 11.24\n}"s);
+
+    ASSERT_EQ(LoadJSON("-1.5e-3"s).GetRoot().AsDouble(), -0.0015);
+    ASSERT_THROW(LoadJSON("1e400"s), json::ParsingError);
+}
+
+TEST(json, Writer) {
+    PrintSettings compact;
+    compact.is_pretty = false;
+
+    std::ostringstream out;
+    {
+        Writer writer(out, compact);
+        json::Parse(R"({"a": [1, 0.5, "x\ty", {}], "b": [], "c": null})"sv, writer);
+    }
+    ASSERT_EQ(out.str(), R"({"a":[1,0.5,"x\ty",{}],"b":[],"c":null})"s);
+
+    ASSERT_EQ(Print(Dict{{"a", Array{}}, {"b", Array{1}}}), "{\n  \"a\": [],\n  \"b\": [\n    1\n  ]\n}"s);
+
+    // Clean runs longer than a word around every kind of escape
+    const std::string text = "0123456789\"0123456789\\0123456789\x01\xD0\x90"s;
+    ASSERT_EQ(Print(Node{text}), R"("0123456789\"0123456789\\0123456789\u0001)" "\xD0\x90\""s);
+    ASSERT_EQ(LoadJSON(Print(Node{text})).GetRoot().AsString(), text);
+
+    // Values formatted one level deep splice into a pretty array
+    std::ostringstream item;
+    {
+        Writer item_writer(item, {}, 1);
+        item_writer.Value(Array{1});
+    }
+    std::ostringstream spliced;
+    {
+        Writer writer(spliced);
+        writer.StartArray().Raw(item.str()).Raw(item.str()).EndArray();
+    }
+    ASSERT_EQ(spliced.str(), Print(Array{Array{1}, Array{1}}));
+}
+
+TEST(json, FlatDocument) {
+    const std::string text = R"({"a": [1, 0.5, "x\ty", null, true], "b": {}, "c": "plain"})"s;
+    const FlatDocument doc(text);
+    const FlatNode root = doc.GetRoot();
+
+    ASSERT_EQ(root.ToNode(), LoadJSON(text).GetRoot());
+    ASSERT_EQ(root.Size(), 3u);
+    ASSERT_EQ(root.At("a").At(0).AsInt(), 1);
+    ASSERT_EQ(root.At("a").At(1).AsDouble(), 0.5);
+    ASSERT_EQ(root.At("a").At(2).AsString(), "x\ty"sv);
+    ASSERT_TRUE(root.At("a").At(3).IsNull());
+    ASSERT_TRUE(root.At("a").At(4).AsBool());
+    ASSERT_EQ(root.At("b").Size(), 0u);
+    ASSERT_EQ(root.At("c").AsString(), "plain"sv);
+    ASSERT_FALSE(root.Find("d"));
+    ASSERT_THROW(root.At("d"), std::out_of_range);
+    ASSERT_THROW(root.At("a").At(5), std::out_of_range);
+    ASSERT_THROW(root.At("c").AsInt(), std::logic_error);
+
+    // Large dicts are sorted by key and searched in halves
+    std::string large = "{";
+    for (int i = 20; i > 0; --i)
+        large += "\"k" + std::to_string(i) + "\": " + std::to_string(i) + (i > 1 ? ", " : "}");
+    const FlatDocument large_doc(large);
+    const FlatNode large_root = large_doc.GetRoot();
+    ASSERT_EQ(large_root.Size(), 20u);
+    ASSERT_EQ(large_root.KeyAt(0), "k1"sv);
+    for (int i = 1; i <= 20; ++i)
+        ASSERT_EQ(large_root.At("k" + std::to_string(i)).AsInt(), i);
+
+    ASSERT_THROW(FlatDocument("{\"a\": 1, \"a\": 2}"s), json::ParsingError);
+    ASSERT_THROW(FlatDocument("[1,]"s), json::ParsingError);
+}
+
+TEST(json, Arena) {
+    const std::string text = R"({"a": [1, {"b": "c"}], "d": {}})"s;
+    auto arena = std::make_shared<Arena>();
+    const Document doc = json::Load(text, arena);
+    const Dict& root = doc.GetRoot().AsDict();
+    ASSERT_EQ(doc, LoadJSON(text));
+    ASSERT_EQ(root.get_allocator().resource(), arena.get());
+    ASSERT_EQ(root.at("a").AsArray().get_allocator().resource(), arena.get());
+    ASSERT_EQ(root.at("a").AsArray()[1].AsDict().get_allocator().resource(), arena.get());
+
+    // Copies leave the arena
+    const Node copy = doc.GetRoot();
+    ASSERT_EQ(copy.AsDict().get_allocator().resource(), std::pmr::get_default_resource());
+
+    const Node built = Builder(arena.get()).StartDict()
+        .Key("a").StartArray().Value(1).StartDict().Key("b").Value("c").EndDict().EndArray()
+        .Key("d").StartDict().EndDict()
+    .EndDict()
+    .Build();
+    ASSERT_EQ(built, doc.GetRoot());
+    ASSERT_EQ(built.AsDict().at("a").AsArray().get_allocator().resource(), arena.get());
 }
 
 } // end namespace
@@ -1,12 +1,26 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
 #include <iostream>
 #include <fstream>
+#include <random>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 
+#include <unistd.h>
+
 #include <gtest/gtest.h>
+#include <json/json_parser.h>
 
 #include "catalogue.h"
 #include "json_reader.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "service.h"
+#include "shard.h"
+#include "snapshot.h"
+#include "socket.h"
 
 namespace {
 
@@ -17,7 +31,7 @@ using namespace transport;
 transport::Catalogue InitialiseDatabase(const std::string_view input_json) {
     transport::Catalogue db;
 
-    if (std::ifstream file(input_json); file) {
+    if (std::ifstream file{std::string(input_json)}; file) {
         std::stringstream buffer;
         buffer << file.rdbuf();
         io::Populate(db, io::JsonReader{buffer});
@@ -47,15 +61,71 @@ TEST(TransportCatalogue, AddStop) {
     ASSERT_EQ(ptr->coords.lng, 37.208290);
 }
 
+TEST(TransportCatalogue, MakeAdjacent) {
+    transport::Catalogue db;
+    db.AddStop(domain::Stop{.name = "A", .coords = {55.611087, 37.208290}});
+    db.AddStop(domain::Stop{.name = "B", .coords = {55.595884, 37.209755}});
+    db.AddStop(domain::Stop{.name = "C", .coords = {55.632761, 37.333324}});
+
+    const domain::StopPtr a = db.SearchStop("A");
+    const domain::StopPtr b = db.SearchStop("B");
+    const domain::StopPtr c = db.SearchStop("C");
+
+    db.MakeAdjacent(a, b, 3900);
+    ASSERT_EQ(db.GetDistance(a, b), 3900);
+    ASSERT_EQ(db.GetDistance(b, a), 3900);
+
+    db.MakeAdjacent(b, a, 4000);
+    db.MakeAdjacent(a, b, 3800);
+    ASSERT_EQ(db.GetDistance(a, b), 3800);
+    ASSERT_EQ(db.GetDistance(b, a), 4000);
+
+    ASSERT_EQ(db.GetDistance(a, c), std::nullopt);
+}
+
+TEST(TransportCatalogue, MakeAdjacentBulk) {
+    const std::vector<Catalogue::Distance> distances{
+        {0, 1, 3900}, {1, 0, 4000}, {0, 1, 3800}, {2, 1, 100}, {1, 2, 200},
+        {2, 0, 500},
+    };
+
+    transport::Catalogue db;
+    transport::Catalogue bulk_db;
+    for (const std::string name : {"A", "B", "C"}) {
+        db.AddStop(domain::Stop{.name = name, .coords = {55.6, 37.2}});
+        bulk_db.AddStop(domain::Stop{.name = name, .coords = {55.6, 37.2}});
+    }
+
+    for (const auto& [from, to, metres] : distances)
+        db.MakeAdjacent(db.GetStop(from), db.GetStop(to), metres);
+    bulk_db.MakeAdjacent(distances);
+
+    for (size_t from = 0; from < 3; ++from)
+        for (size_t to = 0; to < 3; ++to)
+            ASSERT_EQ(
+                bulk_db.GetDistance(bulk_db.GetStop(from), bulk_db.GetStop(to)),
+                db.GetDistance(db.GetStop(from), db.GetStop(to))
+            ) << from << " -> " << to;
+}
+
+TEST(TransportCatalogue, AddBusResolvesDistances) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const domain::BusPtr bus = db.SearchBus("750");
+
+    ASSERT_NE(bus, nullptr);
+    ASSERT_EQ(bus->distances, (std::vector<int>{3900, 100, 9900}));
+    ASSERT_EQ(bus->reverse_distances, (std::vector<int>{3900, 100, 9500}));
+}
+
 TEST(TransportCatalogue, GetBusLineNotExist) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::BusLine> route = db.GetBusLine("751");
 
     ASSERT_EQ(route, std::nullopt);
 }
 
 TEST(TransportCatalogue, GetBusLineCircular) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::BusLine> route = db.GetBusLine("256");
 
     ASSERT_NE(route, std::nullopt);
@@ -66,7 +136,7 @@ TEST(TransportCatalogue, GetBusLineCircular) {
 }
 
 TEST(TransportCatalogue, GetBusLineNotCircular) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::BusLine> route = db.GetBusLine("750");
 
     ASSERT_NE(route, std::nullopt);
@@ -77,14 +147,14 @@ TEST(TransportCatalogue, GetBusLineNotCircular) {
 }
 
 TEST(TransportCatalogue, GetStopNotExist) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::StopStat> stop_stat = db.GetStop("Z");
 
     ASSERT_EQ(stop_stat, std::nullopt);
 }
 
 TEST(TransportCatalogue, GetStopWithoutBuses) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::StopStat> stop_stat = db.GetStop("J");
 
     ASSERT_NE(stop_stat, std::nullopt);
@@ -93,7 +163,7 @@ TEST(TransportCatalogue, GetStopWithoutBuses) {
 }
 
 TEST(TransportCatalogue, GetStop) {
-    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).json")};
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
     const std::optional<domain::StopStat> stop_stat = db.GetStop("D");
 
     std::vector<std::string> bus_names;
@@ -106,6 +176,164 @@ TEST(TransportCatalogue, GetStop) {
     ASSERT_EQ(bus_names, (std::vector<std::string>{"256", "828"}));
 }
 
+TEST(TransportCatalogue, StopBusIndex) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+
+    // The same buses added one by one, and in bulk with a stored index
+    const auto copy_buses = [&db](Catalogue::StopBusIndex* index) {
+        transport::Catalogue copy;
+        for (const domain::StopPtr& stop : db.GetStops())
+            copy.AddStop(*stop);
+
+        std::vector<domain::Bus> buses;
+        for (const domain::BusPtr& bus : db.GetBuses()) {
+            std::vector<domain::StopPtr> stops;
+            for (const domain::StopPtr& stop : bus->stops)
+                stops.push_back(copy.GetStop(stop->id));
+            buses.push_back({bus->name, std::move(stops), bus->is_roundtrip, bus->velocity});
+        }
+        if (index)
+            copy.AddBuses(std::move(buses), *index);
+        else
+            for (domain::Bus& bus : buses)
+                copy.AddBus(std::move(bus));
+        return copy;
+    };
+    const auto get_names = [](const transport::Catalogue& catalogue) {
+        std::vector<std::string> names;
+        for (const domain::StopPtr& stop : catalogue.GetStops())
+            for (const domain::BusPtr& bus : catalogue.GetStopBuses(stop))
+                names.push_back(stop->name + ":" + bus->name);
+        return names;
+    };
+
+    ASSERT_EQ(get_names(copy_buses(nullptr)), get_names(db));
+
+    // A stored index with ranks in range but out of order or missing ones is
+    // rebuilt
+    Catalogue::StopBusIndex index = db.GetStopBusIndex();
+    const size_t stop = db.SearchStop("D")->id;
+    ASSERT_EQ(index.offsets[stop + 1] - index.offsets[stop], 2u);
+    std::swap(index.bus_ids[index.offsets[stop]], index.bus_ids[index.offsets[stop] + 1]);
+    ASSERT_EQ(get_names(copy_buses(&index)), get_names(db));
+
+    index = db.GetStopBusIndex();
+    index.bus_ids.erase(index.bus_ids.begin() + index.offsets[stop]);
+    for (size_t id = stop + 1; id < index.offsets.size(); ++id)
+        --index.offsets[id];
+    ASSERT_EQ(get_names(copy_buses(&index)), get_names(db));
+}
+
+TEST(TransportCatalogue, GetCommonBuses) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const auto get_names = [&db](const std::vector<std::string>& stop_names) {
+        std::vector<domain::StopPtr> stops;
+        for (const std::string& stop_name : stop_names)
+            stops.push_back(db.SearchStop(stop_name));
+
+        std::vector<std::string> bus_names;
+        for (const domain::BusPtr& bus : db.GetCommonBuses(stops))
+            bus_names.push_back(bus->name);
+        return bus_names;
+    };
+
+    ASSERT_EQ(get_names({"D", "F"}), (std::vector<std::string>{"256", "828"}));
+    ASSERT_EQ(get_names({"D", "F", "I"}), (std::vector<std::string>{"828"}));
+    ASSERT_EQ(get_names({"E", "G"}), (std::vector<std::string>{"256"}));
+    ASSERT_TRUE(get_names({"A", "D"}).empty());
+    ASSERT_TRUE(get_names({}).empty());
+}
+
+TEST(TransportCatalogue, UpdateDistance) {
+    transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    db.UpdateDistance(db.SearchStop("B"), db.SearchStop("C"), 9000);
+    db.UpdateDistance(db.SearchStop("A"), db.SearchStop("B"), 4000);
+
+    const domain::BusPtr bus = db.SearchBus("750");
+    ASSERT_EQ(bus->distances, (std::vector<int>{4000, 100, 9000}));
+    ASSERT_EQ(bus->reverse_distances, (std::vector<int>{4000, 100, 9500}));
+    ASSERT_EQ(db.GetBusLine("750")->length, 26700);
+}
+
+TEST(TransportCatalogue, RemoveAndUpdateBus) {
+    transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    db.RemoveBus("828");
+    db.UpdateBusStops("256", {db.SearchStop("D"), db.SearchStop("E"), db.SearchStop("D")}, true);
+
+    ASSERT_EQ(db.SearchBus("828"), nullptr);
+    ASSERT_EQ(db.GetBusCount(), 2);
+    ASSERT_TRUE(db.GetStop("I")->unique_buses.empty());
+    ASSERT_TRUE(db.GetStop("F")->unique_buses.empty());
+    ASSERT_EQ(db.GetStop("D")->unique_buses.size(), 1);
+    ASSERT_TRUE(db.Suggest("828", 1).empty());
+
+    const std::optional<domain::BusLine> route = db.GetBusLine("256");
+    ASSERT_EQ(route->stops_count, 3);
+    ASSERT_EQ(route->length, 3600);
+    ASSERT_THROW(db.RemoveBus("828"), std::invalid_argument);
+}
+
+TEST(TransportCatalogue, RemoveStop) {
+    transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const domain::StopPtr stop_i = db.SearchStop("I");
+    const domain::StopPtr stop_j = db.SearchStop("J");
+    ASSERT_THROW(db.RemoveStop("I"), std::logic_error);
+
+    db.RemoveBus("828");
+    db.RemoveStop("I");
+    db.RemoveStop("J");
+
+    ASSERT_EQ(db.SearchStop("I"), nullptr);
+    ASSERT_TRUE(db.IsRemoved(stop_i));
+    ASSERT_TRUE(db.GetAdjacent(stop_i->id).empty());
+    for (const char* name : {"D", "F"})
+        for (const auto& adjacent : db.GetAdjacent(db.SearchStop(name)->id))
+            ASSERT_NE(adjacent.id, stop_i->id);
+
+    ASSERT_NE(db.GetNearestStops(stop_j->coords, 1).front().first, stop_j);
+    ASSERT_EQ(db.GetAllStopStats().size(), 8);
+}
+
+TEST(TransportCatalogue, UpdateBatch) {
+    using Delta = Catalogue::Delta;
+    transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+
+    // A failing change leaves the earlier ones unapplied
+    ASSERT_THROW(db.Update({
+        Delta::RemoveBus{"828"},
+        Delta::UpdateDistance{db.SearchStop("A"), nullptr, 10}
+    }), std::invalid_argument);
+    ASSERT_THROW(db.Update({Delta::RemoveBus{"828"}, Delta::RemoveBus{"828"}}),
+                 std::invalid_argument);
+    ASSERT_NE(db.SearchBus("828"), nullptr);
+
+    // Stops are served by the buses as the earlier changes leave them
+    ASSERT_THROW(db.Update({Delta::RemoveStop{"I"}, Delta::RemoveBus{"828"}}), std::logic_error);
+    db.Update({
+        Delta::RemoveBus{"828"},
+        Delta::RemoveStop{"I"},
+        Delta::UpdateDistance{db.SearchStop("A"), db.SearchStop("B"), 4000}
+    });
+    ASSERT_EQ(db.SearchBus("828"), nullptr);
+    ASSERT_EQ(db.SearchStop("I"), nullptr);
+    ASSERT_EQ(db.SearchBus("750")->distances.front(), 4000);
+    ASSERT_EQ(db.GetStop("A")->unique_buses.size(), 1);
+}
+
+TEST(TransportCatalogue, GetMemoryUsage) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const std::vector<MemoryUsage> usage = db.GetMemoryUsage();
+
+    const auto stop_names = std::find_if(usage.begin(), usage.end(), [](const auto& structure) {
+        return structure.name == "catalogue.stop_names";
+    });
+    ASSERT_NE(stop_names, usage.end());
+    ASSERT_EQ(stop_names->count, db.GetStopCount());
+    ASSERT_GT(stop_names->load_factor, 0.);
+    for (const MemoryUsage& structure : usage)
+        ASSERT_GT(structure.bytes, 0) << structure.name;
+}
+
 } // namespace gtest_catalogue
 
 namespace gtest_router {
@@ -300,6 +528,507 @@ TEST(TransportRouter, GetDirectRouteWithReverseSwitch) {
 
 } // namespace gtest_router
 
+namespace gtest_spatial_index {
+
+std::vector<geo::Coordinates> GenerateCoordinates(const size_t count) {
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> lat(55.5, 55.9);
+    std::uniform_real_distribution<double> lng(37.3, 37.9);
+
+    std::vector<geo::Coordinates> points(count);
+    for (geo::Coordinates& point : points)
+        point = {lat(generator), lng(generator)};
+    return points;
+}
+
+TEST(PointColumns, MatchScalarDistance) {
+    const std::vector<geo::Coordinates> points = GenerateCoordinates(100);
+    geo::PointColumns columns;
+    for (const geo::Coordinates& point : points)
+        columns.Add(point);
+
+    std::vector<size_t> ids(points.size());
+    for (size_t i = 0; i < ids.size(); ++i)
+        ids[i] = (i*37) % points.size();
+
+    std::vector<double> sequence(ids.size() - 1);
+    columns.ComputeSequenceDistances(ids.data(), ids.size(), sequence.data());
+    for (size_t i = 0; i + 1 < ids.size(); ++i)
+        ASSERT_NEAR(
+            sequence[i],
+            geo::ComputeDistance(points[ids[i]], points[ids[i + 1]]),
+            1e-3
+        );
+
+    // Across the block boundaries, to the point itself and to the far side
+    std::vector<double> distances(ids.size());
+    columns.ComputeDistances(points[3], ids.data(), ids.size(), distances.data());
+    for (size_t i = 0; i < ids.size(); ++i)
+        ASSERT_NEAR(distances[i], geo::ComputeDistance(points[3], points[ids[i]]), 1e-3);
+
+    const geo::Coordinates far_points[] = {{-55.7, -142.6}, {0., 0.}, {89.9, 180.}};
+    for (const geo::Coordinates& far_point : far_points)
+        columns.Add(far_point);
+    const size_t far_ids[] = {points.size(), points.size() + 1, points.size() + 2, 3};
+    columns.ComputeDistances(points[3], far_ids, 4, distances.data());
+    for (size_t i = 0; i < 3; ++i)
+        ASSERT_NEAR(distances[i], geo::ComputeDistance(points[3], far_points[i]), 1e-3);
+    ASSERT_NEAR(distances[3], 0., 0.1);
+}
+
+TEST(SpatialIndex, FindNearest) {
+    const std::vector<geo::Coordinates> points = GenerateCoordinates(1000);
+    const SpatialIndex index(points);
+
+    SpatialIndex inserted;
+    for (const geo::Coordinates& point : points)
+        inserted.Insert(point);
+
+    for (const geo::Coordinates& query : GenerateCoordinates(20)) {
+        std::vector<double> distances;
+        for (const geo::Coordinates& point : points)
+            distances.push_back(geo::ComputeDistance(query, point));
+        std::sort(distances.begin(), distances.end());
+
+        for (const SpatialIndex* idx : {&index, static_cast<const SpatialIndex*>(&inserted)}) {
+            const auto neighbours = idx->FindNearest(query, 5);
+            ASSERT_EQ(neighbours.size(), 5u);
+            for (size_t i = 0; i < neighbours.size(); ++i)
+                ASSERT_NEAR(neighbours[i].distance, distances[i], 1e-3);
+        }
+    }
+
+    ASSERT_EQ(index.FindNearest({0., 0.}, 2000).size(), points.size());
+    ASSERT_TRUE(SpatialIndex{}.FindNearest({0., 0.}, 1).empty());
+}
+
+TEST(SpatialIndex, FindInBox) {
+    const std::vector<geo::Coordinates> points = GenerateCoordinates(1000);
+    const SpatialIndex::Box box{{55.6, 37.4}, {55.7, 37.5}};
+
+    std::vector<size_t> expected;
+    for (size_t id = 0; id < points.size(); ++id)
+        if (box.min.lat <= points[id].lat && points[id].lat <= box.max.lat
+         && box.min.lng <= points[id].lng && points[id].lng <= box.max.lng)
+            expected.push_back(id);
+
+    const SpatialIndex index(points);
+    std::vector<size_t> ids = index.FindInBox(box);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids, expected);
+
+    const SpatialIndex restored(points, index.GetGrid());
+    ids = restored.FindInBox(box);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids, expected);
+
+    // A stored grid listing an id twice or out of range is rebuilt
+    SpatialIndex::Grid corrupt = index.GetGrid();
+    auto cell = std::find_if(corrupt.cells.begin(), corrupt.cells.end(),
+                             [](const auto& cell) { return cell.size() > 1; });
+    ASSERT_NE(cell, corrupt.cells.end());
+    (*cell)[1] = (*cell)[0];
+    ids = SpatialIndex(points, corrupt).FindInBox(box);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids, expected);
+
+    (*cell)[1] = points.size();
+    ids = SpatialIndex(points, corrupt).FindInBox(box);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(ids, expected);
+}
+
+TEST(SpatialIndex, GetNearestStops) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const auto stops = db.GetNearestStops({55.611087, 37.20829}, 2);
+
+    ASSERT_EQ(stops.size(), 2u);
+    ASSERT_EQ(stops.front().first->name, "A");
+    ASSERT_NEAR(stops.front().second, 0., 1.);
+    ASSERT_EQ(stops.back().first->name, "B");
+
+    // A count beyond the stops returns them all, a negative one is rejected
+    ASSERT_EQ(db.GetNearestStops({55.611087, 37.20829}, size_t{1} << 62).size(),
+              db.GetStopCount());
+    const json::Dict request{
+        {"id", 1}, {"type", "Nearest"}, {"latitude", 55.6}, {"longitude", 37.2}, {"count", -1}
+    };
+    ASSERT_THROW(io::JsonReader::ParseStat(request), std::invalid_argument);
+}
+
+} // namespace gtest_spatial_index
+
+namespace gtest_name_index {
+
+std::vector<std::string_view> GetNames(const std::vector<NameIndex::Match>& matches) {
+    std::vector<std::string_view> names;
+    for (const NameIndex::Match& match : matches)
+        names.push_back(match.name);
+    return names;
+}
+
+TEST(NameIndex, Suggest) {
+    const std::vector<std::string> names{
+        "Biryulyovo Zapadnoye", "Biryusinka", "Biryulyovo Tovarnaya",
+        "Universam", "Apteka", "Pokrovskaya",
+    };
+
+    NameIndex index;
+    index.Add(names.front(), NameIndex::Kind::STOP);
+    std::vector<NameIndex::Match> matches;
+    for (auto it = std::next(names.begin()); it != names.end(); ++it)
+        matches.push_back({*it, NameIndex::Kind::STOP});
+    index.Add(matches);
+
+    ASSERT_EQ(
+        GetNames(index.Suggest("biryu", 5)),
+        (std::vector<std::string_view>{
+            "Biryulyovo Tovarnaya", "Biryulyovo Zapadnoye", "Biryusinka"
+        })
+    );
+    ASSERT_EQ(GetNames(index.Suggest("Biryu", 2)).size(), 2u);
+    ASSERT_EQ(
+        GetNames(index.Suggest("Univresam", 1)),
+        (std::vector<std::string_view>{"Universam"})
+    );
+    ASSERT_TRUE(index.Suggest("xyz", 5).empty());
+
+    // Typos are only looked for in queries long enough to rank the names
+    ASSERT_EQ(GetNames(index.Suggest("Ap", 1)), (std::vector<std::string_view>{"Apteka"}));
+    ASSERT_TRUE(index.Suggest("Pa", 1).empty());
+
+    const json::Dict request{{"id", 1}, {"type", "Suggest"}, {"query", "Bir"}, {"count", -1}};
+    ASSERT_THROW(io::JsonReader::ParseStat(request), std::invalid_argument);
+}
+
+TEST(NameIndex, Remove) {
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; ++i)
+        names.push_back("Stop " + std::to_string(i));
+
+    NameIndex index;
+    std::vector<NameIndex::Match> matches;
+    for (const std::string& name : names)
+        matches.push_back({name, NameIndex::Kind::STOP});
+    index.Add(matches);
+    const size_t byte_size = index.GetByteSize();
+
+    // Most of the names are removed, so their entries and postings are dropped
+    for (int i = 0; i < 90; ++i)
+        index.Remove(names[i], NameIndex::Kind::STOP);
+    ASSERT_EQ(index.GetSize(), 10u);
+    ASSERT_LT(index.GetByteSize(), byte_size);
+
+    ASSERT_EQ(GetNames(index.Suggest("Stop 9", 2)),
+              (std::vector<std::string_view>{"Stop 90", "Stop 91"}));
+    ASSERT_EQ(GetNames(index.Suggest("Stpo 95", 1)),
+              (std::vector<std::string_view>{"Stop 95"}));
+    for (const NameIndex::Match& match : index.Suggest("Stop", 20))
+        ASSERT_GE(match.name, "Stop 90");
+
+    index.Add("Stop 1", NameIndex::Kind::BUS);
+    ASSERT_EQ(GetNames(index.Suggest("stop 1", 1)), (std::vector<std::string_view>{"Stop 1"}));
+}
+
+TEST(NameIndex, CatalogueSuggest) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const std::vector<NameIndex::Match> matches = db.Suggest("75", 5);
+
+    ASSERT_EQ(matches.size(), 1u);
+    ASSERT_EQ(matches.front().name, "750");
+    ASSERT_EQ(matches.front().kind, NameIndex::Kind::BUS);
+}
+
+} // namespace gtest_name_index
+
+namespace gtest_snapshot {
+
+TEST(VersionedCatalogue, UpdateKeepsPinnedSnapshot) {
+    VersionedCatalogue versioned{
+        InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json"),
+        renderer::Settings{}
+    };
+
+    const SnapshotPtr pinned = versioned.Pin();
+    ASSERT_EQ(pinned->version, 0u);
+
+    const SnapshotPtr updated = versioned.Update([](Catalogue& db) {
+        db.MakeAdjacent(db.SearchStop("J"), db.SearchStop("A"), 1000);
+        db.AddBus({"1", {db.SearchStop("J"), db.SearchStop("A")}, false, 40});
+    });
+
+    ASSERT_EQ(versioned.GetVersion(), 1u);
+    ASSERT_EQ(versioned.Pin(), updated);
+
+    ASSERT_EQ(pinned->catalogue.SearchBus("1"), nullptr);
+    ASSERT_TRUE(pinned->handler.GetStopStat("J")->unique_buses.empty());
+
+    ASSERT_EQ(updated->handler.GetBusStat("1")->length, 2000);
+    ASSERT_EQ(updated->handler.GetStopStat("J")->unique_buses.size(), 1u);
+    ASSERT_EQ(
+        updated->catalogue.SearchStop("A"),
+        pinned->catalogue.SearchStop("A")
+    );
+    ASSERT_NE(
+        updated->handler.GetRoute("J", "A"),
+        std::nullopt
+    );
+
+    // Only the indexes the update has changed are copied
+    ASSERT_EQ(&updated->catalogue.GetSpatialIndex(), &pinned->catalogue.GetSpatialIndex());
+    ASSERT_EQ(&updated->catalogue.GetStopsHolder(), &pinned->catalogue.GetStopsHolder());
+    ASSERT_NE(&updated->catalogue.GetBuses(), &pinned->catalogue.GetBuses());
+    ASSERT_NE(&updated->catalogue.GetStopBusIndex(), &pinned->catalogue.GetStopBusIndex());
+}
+
+TEST(VersionedCatalogue, UpdateSharesUnchangedIndexes) {
+    std::ifstream file("../../resources/Route-ex2.json");
+    const io::JsonReader reader(file);
+    Catalogue db;
+    io::Populate(db, reader);
+    VersionedCatalogue versioned{std::move(db), renderer::Settings{}};
+
+    const SnapshotPtr pinned = versioned.Pin();
+    const SnapshotPtr updated = versioned.Update([](Catalogue& db) {
+        db.UpdateDistance(db.SearchStop("Universam"), db.SearchStop("Biryusinka"), 1000);
+    });
+
+    const Catalogue& before = pinned->catalogue;
+    const Catalogue& after = updated->catalogue;
+    ASSERT_EQ(&after.GetStops(), &before.GetStops());
+    ASSERT_EQ(&after.GetSpatialIndex(), &before.GetSpatialIndex());
+    ASSERT_EQ(&after.GetStopBusIndex(), &before.GetStopBusIndex());
+    ASSERT_EQ((*after.GetStopBuses(after.SearchStop("Universam")).begin())->name, "297");
+
+    // The bus passing the stops is re-resolved in the new version only
+    ASSERT_NE(after.SearchBus("297"), before.SearchBus("297"));
+    ASSERT_NE(after.GetBusLine("297")->length, before.GetBusLine("297")->length);
+    ASSERT_EQ(*after.GetDistance(after.SearchStop("Universam"), after.SearchStop("Biryusinka")),
+              1000);
+    ASSERT_NE(*before.GetDistance(before.SearchStop("Universam"), before.SearchStop("Biryusinka")),
+              1000);
+
+    // So the router is rebuilt, while a distance alone leaves the buses and
+    // the routes as they are and the router is shared
+    ASSERT_NE(&updated->handler.GetRouter(), &pinned->handler.GetRouter());
+    const SnapshotPtr unrouted = versioned.Update([](Catalogue& db) {
+        db.MakeAdjacent(db.SearchStop("Universam"), db.SearchStop("Biryusinka"), 2000);
+    });
+    ASSERT_EQ(&unrouted->handler.GetRouter(), &updated->handler.GetRouter());
+    ASSERT_EQ(unrouted->catalogue.GetRouteStamp(), after.GetRouteStamp());
+}
+
+} // namespace gtest_snapshot
+
+namespace gtest_shard {
+
+TEST(Shard, Partition) {
+    const transport::Catalogue db{InitialiseDatabase("../../resources/(Stop|Bus|Map).base.json")};
+    const std::vector<Shard> shards = Partition(db, 2);
+    ASSERT_EQ(shards.size(), 2);
+
+    // Every stop is owned once and its stats are answered by the owner
+    std::vector<size_t> owner_counts(db.GetStopCount(), 0);
+    for (const Shard& shard : shards)
+        for (const domain::StopPtr& stop_ptr : shard.catalogue.GetStops()) {
+            if (shard.info.owners.at(stop_ptr->id) != shard.info.index)
+                continue;
+
+            ++owner_counts[db.GetStopId(stop_ptr->name)];
+            ASSERT_EQ(shard.catalogue.GetStop(stop_ptr->name)->unique_buses.size(),
+                      db.GetStop(stop_ptr->name)->unique_buses.size());
+        }
+    ASSERT_EQ(owner_counts, std::vector<size_t>(db.GetStopCount(), 1));
+
+    // Buses are whole wherever they are present
+    for (const Shard& shard : shards)
+        for (const domain::BusPtr& bus_ptr : shard.catalogue.GetBuses())
+            ASSERT_EQ(shard.catalogue.GetBusLine(bus_ptr->name)->length,
+                      db.GetBusLine(bus_ptr->name)->length);
+}
+
+TEST(Shard, Coordinator) {
+    std::ifstream file("../../resources/Route-ex4.json");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    json::Node root = json::Load(buffer.str()).GetRoot();
+    json::Array stat_requests;
+    for (const json::Node& request : root.AsDict().at("stat_requests").AsArray())
+        if (request.AsDict().at("type").AsString() != "Map")
+            stat_requests.push_back(request);
+    root.AsDict().insert_or_assign("stat_requests", std::move(stat_requests));
+    const io::JsonReader reader(root.AsDict());
+    transport::Catalogue db;
+    io::Populate(db, reader);
+    const io::RequestHandler handler{db, reader.GenerateMapSettings()};
+
+    const std::vector<Shard> shards = Partition(db, 2);
+    std::vector<io::RequestHandler> shard_handlers;
+    for (const Shard& shard : shards)
+        shard_handlers.emplace_back(shard.catalogue, reader.GenerateMapSettings());
+    const std::string file_name = "/tmp/gtest-shard-" + std::to_string(::getpid());
+    std::vector<std::thread> servers;
+    for (size_t i = 0; i < shards.size(); ++i)
+        servers.emplace_back([&, i]() {
+            io::ServeShard(GetShardSocketName(file_name, i), shard_handlers[i], shards[i].info);
+        });
+
+    // An unknown request is answered with an error and the shard goes on
+    {
+        const int socket = io::Connect(GetShardSocketName(file_name, 0));
+        const std::string request = R"({"type": "Unknown"})";
+        const uint32_t size = static_cast<uint32_t>(request.size());
+        io::WriteAll(socket, reinterpret_cast<const char*>(&size), sizeof(size));
+        io::WriteAll(socket, request.data(), request.size());
+
+        uint32_t response_size = 0;
+        EXPECT_TRUE(io::ReadAll(socket, reinterpret_cast<char*>(&response_size),
+                                sizeof(response_size)));
+        std::string response(response_size, '\0');
+        EXPECT_TRUE(io::ReadAll(socket, response.data(), response_size));
+        EXPECT_TRUE(json::Load(response).GetRoot().AsDict().count("error_message"));
+        ::close(socket);
+    }
+
+    const auto search = [&reader](const auto& searcher) {
+        std::ostringstream out;
+        {
+            json::Writer writer(out, reader.GeneratePrintSettings());
+            searcher(writer);
+        }
+        const std::string text = out.str();
+        const json::Document document = json::Load(text);
+        std::vector<json::Dict> responses;
+        for (const json::Node& response : document.GetRoot().AsArray())
+            responses.push_back(response.AsDict());
+        return responses;
+    };
+    std::vector<json::Dict> sharded;
+    {
+        const io::Coordinator coordinator(file_name, shards.size());
+        sharded = search([&](json::Writer& writer) { coordinator.Search(reader, writer); });
+        coordinator.Shutdown();
+    }
+    for (std::thread& server : servers)
+        server.join();
+    const std::vector<json::Dict> single = search([&](json::Writer& writer) {
+        io::Search(handler, reader, writer);
+    });
+
+    // Routes of equal time may take other rides
+    ASSERT_EQ(sharded.size(), reader.GetStats().size());
+    ASSERT_EQ(sharded.size(), single.size());
+    for (size_t i = 0; i < single.size(); ++i) {
+        const json::Dict& response = single[i];
+        const json::Dict& sharded_response = sharded[i];
+        if (response.count("items"))
+            ASSERT_NEAR(sharded_response.at("total_time").AsDouble(),
+                        response.at("total_time").AsDouble(), 1e-4);
+        else
+            ASSERT_EQ(json::Node(sharded_response), json::Node(response));
+    }
+}
+
+} // namespace gtest_shard
+
+namespace gtest_parallel {
+
+TEST(TaskPool, TaskGroup) {
+    TaskPool pool(3);
+
+    // Nested groups are joined by the threads waiting on them
+    std::atomic<int> sum{0};
+    TaskGroup group(pool);
+    for (int i = 0; i < 8; ++i)
+        group.Run([&pool, &sum]() {
+            TaskGroup nested(pool);
+            for (int j = 0; j < 8; ++j)
+                nested.Run([&sum]() { ++sum; });
+            nested.Wait();
+        });
+    group.Wait();
+    ASSERT_EQ(sum, 64);
+
+    // The waiting thread sleeps rather than spins through a long task
+    const std::clock_t cpu_start = std::clock();
+    group.Run([]() { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+    group.Wait();
+    ASSERT_LT(std::clock() - cpu_start, CLOCKS_PER_SEC/10);
+
+    group.Run([]() { throw std::runtime_error("task"); });
+    ASSERT_THROW(group.Wait(), std::runtime_error);
+    ASSERT_NO_THROW(group.Wait());
+
+    std::vector<size_t> order;
+    RunInOrder(pool, 100,
+               [](const size_t index) { return index; },
+               [&order](const size_t index) { order.push_back(index); });
+    ASSERT_EQ(order.size(), 100u);
+    ASSERT_TRUE(std::is_sorted(order.begin(), order.end()));
+
+    // No more than twice the worker count of results wait for the consumer
+    std::atomic<size_t> consumed_count{0};
+    std::atomic<size_t> max_ahead{0};
+    RunInOrder(pool, 100,
+               [&](const size_t index) {
+                   size_t ahead = index - consumed_count;
+                   size_t max = max_ahead;
+                   while (ahead > max && !max_ahead.compare_exchange_weak(max, ahead));
+                   return index;
+               },
+               [&](size_t) { ++consumed_count; });
+    ASSERT_EQ(consumed_count, 100u);
+    ASSERT_LT(max_ahead, 2*pool.GetThreadCount());
+}
+
+} // namespace gtest_parallel
+
+namespace gtest_metrics {
+
+TEST(Metrics, Histogram) {
+    metrics::Histogram histogram;
+    ASSERT_EQ(histogram.GetQuantile(0.5), 0u);
+
+    for (uint64_t nanoseconds = 1; nanoseconds <= 1000; ++nanoseconds)
+        histogram.Record(nanoseconds);
+    ASSERT_EQ(histogram.GetCount(), 1000u);
+    ASSERT_EQ(histogram.GetTotal(), 500500u);
+    ASSERT_EQ(histogram.GetMax(), 1000u);
+
+    // A quantile is off by no more than a sub-bucket, i.e. 1/16 of it
+    for (const double quantile : {0.01, 0.5, 0.9, 0.99}) {
+        const uint64_t expected = static_cast<uint64_t>(quantile*1000);
+        EXPECT_GE(histogram.GetQuantile(quantile), expected);
+        EXPECT_LE(histogram.GetQuantile(quantile), expected + expected/16);
+    }
+    EXPECT_EQ(histogram.GetQuantile(1.), 1000u);
+
+    histogram.Record(UINT64_MAX);
+    EXPECT_EQ(histogram.GetQuantile(1.), UINT64_MAX);
+}
+
+TEST(Metrics, HistogramThreads) {
+    metrics::Histogram histogram;
+
+    // Threads record to shards of their own, the reads sum them all
+    const size_t thread_count = 2*metrics::Histogram::SHARD_COUNT + 1;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i)
+        threads.emplace_back([&histogram, i]() {
+            for (uint64_t nanoseconds = 1; nanoseconds <= 1000; ++nanoseconds)
+                histogram.Record(nanoseconds + i);
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(histogram.GetCount(), 1000*thread_count);
+    ASSERT_EQ(histogram.GetTotal(), 500500*thread_count + 1000*thread_count*(thread_count - 1)/2);
+    ASSERT_EQ(histogram.GetMax(), 1000 + thread_count - 1);
+    EXPECT_EQ(histogram.GetQuantile(1.), 1000 + thread_count - 1);
+}
+
+} // namespace gtest_metrics
+
 namespace gtest_transport {
 
 json::Document LoadJSON(const std::string& json_path) {
@@ -323,7 +1052,12 @@ json::Document ProcessTransport(const std::string& json_path) {
     io::JsonReader reader(buffer);
     io::Populate(db, reader);
 
-    return io::Search({db, reader.GenerateMapSettings()}, reader);
+    std::stringstream out;
+    {
+        json::Writer writer(out);
+        io::Search({db, reader.GenerateMapSettings()}, reader, writer);
+    }
+    return json::Load(out);
 }
 
 void CompareOutputs(const std::string& json_path) {
@@ -400,6 +1134,215 @@ TEST(Transport, CompareJson4) {
     CompareOutputs("../../resources/Route-ex4");
 }
 
+TEST(Transport, StreamMatchesDocument) {
+    std::ifstream file("../../resources/Route-ex4.json");
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    const std::string text = buffer.str();
+
+    std::istringstream stream_input(text);
+    const io::JsonReader streamed(stream_input);
+    std::istringstream document_input(text);
+    const io::JsonReader loaded(json::Load(document_input).GetRoot().AsDict());
+
+    ASSERT_EQ(streamed.GetStops().size(), loaded.GetStops().size());
+    ASSERT_EQ(streamed.GetBuses().size(), loaded.GetBuses().size());
+    ASSERT_EQ(streamed.GetDistances().size(), loaded.GetDistances().size());
+    ASSERT_EQ(streamed.GetStats().size(), loaded.GetStats().size());
+    for (size_t i = 0; i < streamed.GetStats().size(); ++i)
+        ASSERT_EQ(io::ConvertToNode(streamed.GetStats()[i]),
+                  io::ConvertToNode(loaded.GetStats()[i]));
+
+    transport::Catalogue streamed_db;
+    io::Populate(streamed_db, streamed);
+    transport::Catalogue loaded_db;
+    io::Populate(loaded_db, loaded);
+    for (const domain::BusPtr& bus_ptr : loaded_db.GetBuses())
+        ASSERT_EQ(streamed_db.GetBusLine(bus_ptr->name)->length,
+                  loaded_db.GetBusLine(bus_ptr->name)->length);
+}
+
+TEST(Transport, SerializationCallback) {
+    const auto read = [](const std::string& text) {
+        std::vector<std::string> files;
+        std::istringstream input(text);
+        const io::JsonReader reader(input, [&files](const json::Dict& settings) {
+            files.push_back(settings.at("file").AsString());
+        });
+        EXPECT_EQ(reader.GetDatabaseFileName(), "db");
+        return files;
+    };
+
+    // Found past the requests, with the key in a string value before it
+    ASSERT_EQ(read(R"({"stat_requests": [{"id": 1, "type": "Bus", "name": "serialization_settings"},)"
+                   R"( {"id": 2, "type": "Stop", "name": "a\"]}"}],)"
+                   R"( "serialization_settings": {"file": "db"}})"),
+              std::vector<std::string>{"db"});
+    ASSERT_EQ(read(R"({"serialization_settings": {"file": "db"}, "stat_requests": []})"),
+              std::vector<std::string>{"db"});
+    // Found once the document is read
+    ASSERT_EQ(read(R"({"serialization\u005fsettings": {"file": "db"}})"),
+              std::vector<std::string>{"db"});
+}
+
+TEST(Transport, ParallelSearch) {
+    // Maps among the lookups are rendered in parts
+    json::Node root = LoadJSON("../../resources/Route-ex4.json").GetRoot();
+    json::Array& stat_requests = root.AsDict().at("stat_requests").AsArray();
+    for (int id : {-1, -2})
+        stat_requests.insert(stat_requests.begin() + 5*(-id),
+                             json::Dict{{"id", id}, {"type", "Map"}});
+    const io::JsonReader reader(root.AsDict());
+    transport::Catalogue db;
+    io::Populate(db, reader);
+    const io::RequestHandler handler{db, reader.GenerateMapSettings()};
+
+    const auto search = [&](const size_t thread_count) {
+        std::ostringstream out;
+        {
+            json::Writer writer(out, reader.GeneratePrintSettings());
+            io::Search(handler, reader, writer, thread_count);
+        }
+        return out.str();
+    };
+    ASSERT_EQ(search(4), search(1));
+}
+
+TEST(Transport, SearchReusesResponses) {
+    // The requests are asked again with other ids, a Map twice
+    json::Node root = LoadJSON("../../resources/Route-ex2.json").GetRoot();
+    json::Array& stat_requests = root.AsDict().at("stat_requests").AsArray();
+    stat_requests.push_back(json::Dict{{"id", 1000}, {"type", "Map"}});
+    const size_t count = stat_requests.size();
+    for (size_t i = 0; i < count; ++i) {
+        json::Dict request = stat_requests[i].AsDict();
+        request.insert_or_assign("id", static_cast<int>(2000 + i));
+        stat_requests.push_back(std::move(request));
+    }
+    const io::JsonReader reader(root.AsDict());
+    transport::Catalogue db;
+    io::Populate(db, reader);
+    const io::RequestHandler handler{db, reader.GenerateMapSettings()};
+
+    for (const size_t thread_count : {1u, 3u}) {
+        std::stringstream out;
+        {
+            json::Writer writer(out);
+            io::Search(handler, reader, writer, thread_count);
+        }
+        const json::Array responses = json::Load(out).GetRoot().AsArray();
+        ASSERT_EQ(responses.size(), 2*count);
+        for (size_t i = 0; i < count; ++i) {
+            json::Dict response = responses[count + i].AsDict();
+            ASSERT_EQ(response.at("request_id").AsInt(), static_cast<int>(2000 + i));
+            response.insert_or_assign("request_id", responses[i].AsDict().at("request_id"));
+            ASSERT_EQ(json::Node(std::move(response)), responses[i]);
+        }
+    }
+}
+
+TEST(Transport, ServeLines) {
+    std::ifstream file("../../resources/Route-ex2.json");
+    const io::JsonReader reader(file);
+    transport::Catalogue db;
+    io::Populate(db, reader);
+    VersionedCatalogue versioned{std::move(db), reader.GenerateMapSettings()};
+
+    std::istringstream input(
+        R"({"id": 1, "type": "Bus", "name": "297"})" "\n"
+        "\n"
+        R"({"id": 2, "type": "Bus"})" "\n"
+        R"({"id": 3, "type": "Bus", "name": "none"})" "\n"
+        "{\n"
+        R"({"id": 4, "type": "UpdateDistance", "from": "Universam", "to": "Biryusinka", "distance": 1000})" "\n"
+        R"({"id": 5, "type": "RemoveBus", "name": "none"})" "\n"
+        R"({"id": 6, "type": "Bus", "name": "297"})" "\n"
+    );
+    std::ostringstream output;
+    io::ServeLines(versioned, reader, input, output);
+
+    std::istringstream lines(output.str());
+    std::vector<json::Node> responses;
+    for (std::string line; std::getline(lines, line);)
+        responses.push_back(json::Load(line).GetRoot());
+    ASSERT_EQ(responses.size(), 7u);
+
+    EXPECT_EQ(responses[0].AsDict().at("stop_count").AsInt(), 6);
+    EXPECT_EQ(responses[1].AsDict().at("request_id").AsInt(), 2);
+    EXPECT_TRUE(responses[1].AsDict().count("error_message"));
+    EXPECT_EQ(responses[2].AsDict().at("error_message").AsString(), "not found");
+    EXPECT_FALSE(responses[3].AsDict().count("request_id"));
+
+    // Deltas publish a version each, a failed one leaves the latest in place
+    EXPECT_EQ(responses[4].AsDict().at("request_id").AsInt(), 4);
+    EXPECT_EQ(responses[4].AsDict().at("version").AsInt(), 1);
+    EXPECT_EQ(responses[5].AsDict().at("request_id").AsInt(), 5);
+    EXPECT_TRUE(responses[5].AsDict().count("error_message"));
+    EXPECT_EQ(versioned.GetVersion(), 1u);
+    EXPECT_NE(responses[6].AsDict().at("route_length").AsDouble(),
+              responses[0].AsDict().at("route_length").AsDouble());
+}
+
+TEST(Transport, MetricsRequest) {
+    std::ifstream file("../../resources/Route-ex2.json");
+    const io::JsonReader reader(file);
+    transport::Catalogue db;
+    io::Populate(db, reader);
+    VersionedCatalogue versioned{std::move(db), reader.GenerateMapSettings()};
+
+    std::istringstream input(
+        R"({"id": 1, "type": "Stop", "name": "Biryulyovo Zapadnoye"})" "\n"
+        R"({"id": 2, "type": "Metrics"})" "\n"
+    );
+    std::ostringstream output;
+    io::ServeLines(versioned, reader, input, output);
+
+    std::istringstream lines(output.str());
+    std::string line;
+    std::getline(lines, line);
+    std::getline(lines, line);
+    const json::Dict response = json::Load(line).GetRoot().AsDict();
+    ASSERT_EQ(response.at("request_id").AsInt(), 2);
+
+    const json::Array& phases = response.at("phases").AsArray();
+    EXPECT_TRUE(std::any_of(phases.begin(), phases.end(), [](const json::Node& phase) {
+        return phase.AsDict().at("name").AsString() == "populate";
+    }));
+    const json::Array& requests = response.at("requests").AsArray();
+    EXPECT_TRUE(std::any_of(requests.begin(), requests.end(), [](const json::Node& type) {
+        return type.AsDict().at("type").AsString() == "Stop"
+            && type.AsDict().at("count").AsInt() > 0;
+    }));
+}
+
+TEST(Transport, ServeSocket) {
+    // The service runs until the process exits, so what it serves stays
+    static std::ifstream file("../../resources/Route-ex2.json");
+    static const io::JsonReader reader(file);
+    static VersionedCatalogue versioned{
+        InitialiseDatabase("../../resources/Route-ex2.json"),
+        reader.GenerateMapSettings()
+    };
+    const std::string socket_name = "/tmp/gtest-serve-" + std::to_string(::getpid());
+    std::thread([socket_name]() {
+        io::ServeSocket(socket_name, versioned, reader);
+    }).detach();
+
+    // A client which is yet to send anything holds up nobody else
+    const int idle_socket = io::Connect(socket_name);
+    const int socket = io::Connect(socket_name);
+    const std::string request = R"({"id": 1, "type": "Bus", "name": "297"})" "\n";
+    io::WriteAll(socket, request.data(), request.size());
+
+    io::SocketBuffer buffer(socket);
+    std::istream stream(&buffer);
+    std::string line;
+    ASSERT_TRUE(std::getline(stream, line));
+    ASSERT_EQ(json::Load(line).GetRoot().AsDict().at("stop_count").AsInt(), 6);
+    ::close(idle_socket);
+    ::close(socket);
+}
+
 } // namespace gtest_transport
 
 } // namespace
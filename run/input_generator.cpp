@@ -81,7 +81,7 @@ int gen_input(std::ostream& out,
     );
 
     std::uniform_real_distribution<double> coordinate{1, 2};
-    std::uniform_int_distribution<bool> route_selector{0, 1};
+    std::bernoulli_distribution route_selector{0.5};
     std::uniform_int_distribution<size_t> stop_selector{0, stops.size() - 1};
     std::uniform_int_distribution<size_t> rout_size_selector{0, route_size};
 
@@ -135,7 +135,7 @@ int gen_input(std::ostream& out,
 
     if (request_count > stops.size()) {
         stops.reserve(request_count);
-        while (buses.size() != request_count)
+        while (stops.size() != request_count)
             stops.emplace_back(
                 gen_random_string(rand_gen, 20, edge_chars, inner_chars)
             );
@@ -148,7 +148,7 @@ int gen_input(std::ostream& out,
         builder.StartDict()
             .Key("id").Value(static_cast<int>(id))
             .Key("type").Value(id % 2 ? "Stop" : "Bus")
-            .Key("name").Value(id % 2 ? stops[id] : buses[id])
+            .Key("name").Value(id % 2 ? stops[id/2] : buses[id/2])
         .EndDict();
     builder.EndArray().EndDict();
 
@@ -1,50 +1,264 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <fstream>
+#include <future>
+#include <iomanip>
+#include <thread>
 
 #include "json_reader.h"
 #include "map_renderer.h"
+#include "metrics.h"
 #include "request_handler.h"
 #include "serialization.h"
+#include "service.h"
+#include "shard.h"
 
 using namespace std::literals;
 
 void PrintUsage(std::ostream& stream = std::cerr) {
-    stream << "Usage: transport_catalogue [make_base|process_requests]\n"sv;
+    stream << "Usage: transport_catalogue [make_base|update_base|serve_shard]"
+              " [--memory-report] [--metrics]\n"
+              "       transport_catalogue process_requests [--threads N]"
+              " [--memory-report] [--metrics]\n"
+              "       transport_catalogue serve [--socket PATH]"
+              " [--memory-report] [--metrics]\n"sv;
+}
+
+void PrintMemoryReport(const std::vector<transport::MemoryUsage>& usage,
+                       std::ostream& stream = std::cerr) {
+    size_t total_bytes = 0;
+    stream << std::left << std::setw(32) << "structure"sv
+           << std::right << std::setw(16) << "bytes"sv
+           << std::setw(12) << "count"sv
+           << std::setw(8) << "load"sv << '\n';
+    for (const transport::MemoryUsage& structure : usage) {
+        total_bytes += structure.bytes;
+        stream << std::left << std::setw(32) << structure.name
+               << std::right << std::setw(16) << structure.bytes
+               << std::setw(12) << structure.count
+               << std::setw(8) << std::fixed << std::setprecision(2)
+               << structure.load_factor << '\n';
+    }
+    stream << std::left << std::setw(32) << "total"sv
+           << std::right << std::setw(16) << total_bytes << '\n';
+}
+
+void PrintMetrics(std::ostream& stream = std::cerr) {
+    using namespace transport;
+    static const double MICROSECONDS_PER_NANOSECOND = 1e-3;
+    static const double MILLISECONDS_PER_NANOSECOND = 1e-6;
+
+    const metrics::Registry& registry = metrics::GetRegistry();
+    stream << std::fixed << std::setprecision(1)
+           << std::left << std::setw(20) << "phase"sv
+           << std::right << std::setw(12) << "count"sv
+           << std::setw(12) << "total_ms"sv << '\n';
+    for (size_t i = 0; i < metrics::PHASE_COUNT; ++i) {
+        const auto phase = static_cast<metrics::Phase>(i);
+        const metrics::PhaseStat& stat = registry.GetPhase(phase);
+        if (stat.count == 0)
+            continue;
+        stream << std::left << std::setw(20) << metrics::GetPhaseName(phase)
+               << std::right << std::setw(12) << stat.count
+               << std::setw(12) << stat.nanoseconds*MILLISECONDS_PER_NANOSECOND << '\n';
+    }
+
+    stream << std::left << std::setw(20) << "request"sv
+           << std::right << std::setw(12) << "count"sv
+           << std::setw(12) << "reused"sv
+           << std::setw(12) << "mean_us"sv
+           << std::setw(12) << "p50_us"sv
+           << std::setw(12) << "p99_us"sv
+           << std::setw(12) << "max_us"sv << '\n';
+    for (size_t type = 0; type < std::variant_size_v<io::StatRequest::Query>; ++type) {
+        const metrics::Histogram& latency = registry.GetLatency(type);
+        const uint64_t count = latency.GetCount();
+        const uint64_t reused_count = registry.GetReusedCount(type);
+        if (count == 0 && reused_count == 0)
+            continue;
+        stream << std::left << std::setw(20) << io::GetTypeName(type)
+               << std::right << std::setw(12) << count
+               << std::setw(12) << reused_count
+               << std::setw(12)
+               << (count ? latency.GetTotal()/count : 0)*MICROSECONDS_PER_NANOSECOND
+               << std::setw(12) << latency.GetQuantile(0.5)*MICROSECONDS_PER_NANOSECOND
+               << std::setw(12) << latency.GetQuantile(0.99)*MICROSECONDS_PER_NANOSECOND
+               << std::setw(12) << latency.GetMax()*MICROSECONDS_PER_NANOSECOND << '\n';
+    }
 }
 
 int main(int argc, char* argv[]) {
     using namespace transport;
 
-    if (argc != 2) {
+    if (argc < 2) {
         PrintUsage();
         return 1;
     }
 
     const std::string_view mode(argv[1]);
+    bool is_memory_reported = false;
+    bool are_metrics_reported = false;
+    std::string socket_name;
+    size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view option(argv[i]);
+        if (option == "--memory-report"sv) {
+            is_memory_reported = true;
+        } else if (option == "--metrics"sv) {
+            are_metrics_reported = true;
+        } else if (option == "--socket"sv && mode == "serve"sv && i + 1 < argc) {
+            socket_name = argv[++i];
+        } else if (option == "--threads"sv && mode == "process_requests"sv && i + 1 < argc) {
+            thread_count = std::max(1, std::atoi(argv[++i]));
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
 
     transport::Catalogue db;
     // std::ifstream file("../../../resources/(Stop|Bus|Map).stat.json");
     // std::stringstream buffer;
     // buffer << file.rdbuf();
     // io::JsonReader reader(buffer);
-    io::JsonReader reader(std::cin);
+    // A service takes its settings on the first line, the requests follow
+    std::istringstream settings_line;
+    if (mode == "serve"sv) {
+        std::string line;
+        std::getline(std::cin, line);
+        settings_line.str(std::move(line));
+    }
+
+    // process_requests reads the database on its own thread from the moment
+    // serialization_settings are found while the requests are still parsed
+    std::optional<io::RequestHandler> loaded_handler;
+    std::future<void> loading;
+    const auto start_loading = [&](const json::Dict& settings) {
+        const auto shard_count = settings.find("shard_count");
+        if (mode != "process_requests"sv
+         || (shard_count != settings.end() && shard_count->second.AsInt() > 1))
+            return;
+
+        io::RequestHandler& handler = loaded_handler.emplace(db, renderer::Settings{}, Router{});
+        loading = std::async(
+            std::launch::async,
+            [&db, &handler, file_name = settings.at("file").AsString()]() {
+                std::ifstream ifs(file_name, std::ios::binary);
+                io::Bufferiser(handler).Deserialize(ifs, db, true);
+            }
+        );
+    };
+    io::JsonReader reader(
+        mode == "serve"sv ? static_cast<std::istream&>(settings_line) : std::cin,
+        start_loading
+    );
+
+    if (mode == "make_base"sv && reader.GetShardCount() > 1) {
+        io::Populate(db, reader);
+
+        for (Shard& shard : Partition(db, reader.GetShardCount())) {
+            io::RequestHandler handler{shard.catalogue, reader.GenerateMapSettings()};
+            std::ofstream ofs(
+                GetShardFileName(reader.GetDatabaseFileName(), shard.info.index),
+                std::ios::binary
+            );
+            io::Bufferiser(handler).Serialize(ofs, shard.info);
 
-    if (mode == "make_base"sv) {
+            if (is_memory_reported)
+                PrintMemoryReport(io::GetMemoryUsage(handler, reader));
+        }
+    } else if (mode == "make_base"sv) {
         io::Populate(db, reader);
 
         io::RequestHandler handler{db, reader.GenerateMapSettings()};
         std::ofstream ofs(reader.GetDatabaseFileName(), std::ios::binary);
         io::Bufferiser(handler).Serialize(ofs);
+
+        if (is_memory_reported)
+            PrintMemoryReport(io::GetMemoryUsage(handler, reader));
+    } else if (mode == "update_base"sv) {
+        // Routes are computed once the database is changed
+        io::RequestHandler handler{db, reader.GenerateMapSettings(), Router{}};
+        {
+            std::ifstream ifs(reader.GetDatabaseFileName(), std::ios::binary);
+            io::Bufferiser(handler).Deserialize(ifs, db);
+        }
+
+        try {
+            io::Update(db, reader);
+        } catch (const std::exception& e) {
+            std::cerr << "unable to update the database: " << e.what() << std::endl;
+            return 1;
+        }
+        handler.SetRouter(Router(db, false));
+
+        std::ofstream ofs(reader.GetDatabaseFileName(), std::ios::binary);
+        io::Bufferiser(handler).Serialize(ofs);
+
+        if (is_memory_reported)
+            PrintMemoryReport(io::GetMemoryUsage(handler, reader));
+    } else if (mode == "serve_shard"sv) {
+        const std::string& file_name = reader.GetDatabaseFileName();
+        const size_t index = reader.GetShardIndex();
+
+        io::RequestHandler handler{db, reader.GenerateMapSettings(), Router{}};
+        std::optional<ShardInfo> info;
+        {
+            std::ifstream ifs(GetShardFileName(file_name, index), std::ios::binary);
+            info = io::Bufferiser(handler).Deserialize(ifs, db, true);
+        }
+        if (!info)
+            throw std::invalid_argument("database is not a shard");
+
+        if (is_memory_reported)
+            PrintMemoryReport(io::GetMemoryUsage(handler, reader));
+        io::ServeShard(GetShardSocketName(file_name, index), handler, *info);
+    } else if (mode == "process_requests"sv && reader.GetShardCount() > 1) {
+        const io::Coordinator coordinator(
+            reader.GetDatabaseFileName(),
+            reader.GetShardCount()
+        );
+        json::Writer writer(std::cout, reader.GeneratePrintSettings());
+        coordinator.Search(reader, writer);
+        writer.Flush();
+        std::cout << std::endl;
     } else if (mode == "process_requests"sv) {
-        io::RequestHandler handler{db, reader.GenerateMapSettings()};
-        std::ifstream ifs(reader.GetDatabaseFileName(), std::ios::binary);
-        io::Bufferiser(handler).Deserialize(ifs);
+        if (!loading.valid())
+            throw std::invalid_argument("serialization_settings are missing");
+        loading.get();
+        const io::RequestHandler& handler = *loaded_handler;
 
-        json::Print(io::Search(handler, reader), std::cout);
+        json::Writer writer(std::cout, reader.GeneratePrintSettings());
+        io::Search(handler, reader, writer, thread_count);
+        writer.Flush();
         std::cout << std::endl;
+
+        if (is_memory_reported)
+            PrintMemoryReport(io::GetMemoryUsage(handler, reader));
+    } else if (mode == "serve"sv) {
+        io::RequestHandler handler{db, reader.GenerateMapSettings(), Router{}};
+        {
+            std::ifstream ifs(reader.GetDatabaseFileName(), std::ios::binary);
+            io::Bufferiser(handler).Deserialize(ifs, db, true);
+        }
+
+        // Requests are answered from snapshots, delta requests publish new ones
+        VersionedCatalogue versioned(std::make_shared<const Snapshot>(
+            std::move(db), handler.GetRendererSettings(), handler.ShareRouter(), 0
+        ));
+        if (is_memory_reported)
+            PrintMemoryReport(io::GetMemoryUsage(versioned.Pin()->handler, reader));
+        if (socket_name.empty())
+            io::ServeLines(versioned, reader, std::cin, std::cout);
+        else
+            io::ServeSocket(socket_name, versioned, reader);
     } else {
         PrintUsage();
         return 1;
     }
+
+    if (are_metrics_reported)
+        PrintMetrics();
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,15 @@
 #include "catalogue.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "parallel.h"
 
 namespace transport {
 
@@ -9,31 +18,459 @@ using domain::Stop, domain::StopPtr, domain::StopStat;
 
 // ---------- Catalogue ---------------
 
+void Catalogue::StampRoutes() {
+    // Unique among all catalogues, not only the copies of this one
+    static std::atomic<uint64_t> last_stamp{0};
+    route_stamp_ = ++last_stamp;
+}
+
+const StopPtr& Catalogue::EmplaceStop(Stop stop) {
+    StampRoutes();
+    stop.id = stops_->size();
+    const StopPtr& stop_ptr = stops_.Write().emplace_back(
+        std::make_shared<const Stop>(std::move(stop))
+    );
+
+    stop_names_.Write()[stop_ptr->name] = stop_ptr;
+    std::vector<uint32_t>& offsets = stop_buses_.Write().offsets;
+    offsets.push_back(offsets.back());
+    stops_to_distance_.Write().emplace_back();
+    stop_columns_.Write().Add(stop_ptr->coords);
+    return stop_ptr;
+}
+
 void Catalogue::AddStop(Stop stop) {
-    stops_.push_back(std::move(stop));
-    const StopPtr& stop_ptr = std::make_shared<const Stop>(stops_.back());
+    const StopPtr& stop_ptr = EmplaceStop(std::move(stop));
+    spatial_index_.Write().Insert(stop_ptr->coords);
+    name_index_.Write().Add(stop_ptr->name, NameIndex::Kind::STOP);
+}
+
+void Catalogue::AddStops(std::vector<Stop> stops,
+                         std::optional<SpatialIndex::Grid> grid) {
+    const size_t stop_count = stops_->size() + stops.size();
+    stops_.Write().reserve(stop_count);
+    stop_names_.Write().reserve(stop_count);
+    stop_buses_.Write().offsets.reserve(stop_count + 1);
+    stops_to_distance_.Write().reserve(stop_count);
+    stop_columns_.Write().Reserve(stop_count);
 
-    stop_names_[stops_.back().name] = stop_ptr;
-    stop_to_buses_[stop_ptr];
+    std::vector<NameIndex::Match> names;
+    names.reserve(stops.size());
+    for (Stop& stop : stops)
+        names.push_back({EmplaceStop(std::move(stop))->name, NameIndex::Kind::STOP});
+    name_index_.Write().Add(names);
+
+    std::vector<geo::Coordinates> points;
+    points.reserve(stop_count);
+    for (const StopPtr& stop_ptr : *stops_)
+        points.push_back(stop_ptr->coords);
+
+    spatial_index_.Write() = grid
+                     ? SpatialIndex(std::move(points), std::move(*grid))
+                     : SpatialIndex(std::move(points));
 }
 
 void Catalogue::MakeAdjacent(const StopPtr& stop,
                              const StopPtr& adjacent_stop,
                              const int metres) {
-    const auto it = stops_to_distance_.find({adjacent_stop, stop});
-    if (it != stops_to_distance_.end() && it->second == metres)
+    SetDistance(stop->id, {adjacent_stop->id, metres, true});
+    // Road distance is symmetric unless the reverse one is set explicitly
+    SetDistance(adjacent_stop->id, {stop->id, metres, false});
+}
+
+void Catalogue::SetDistance(const size_t id, const Adjacent adjacent) {
+    AdjacentList& adjacent_list = stops_to_distance_.Write().at(id);
+    const auto it = std::lower_bound(
+        adjacent_list.begin(), adjacent_list.end(),
+        adjacent.id,
+        [](const Adjacent& lhs, const size_t rhs) { return lhs.id < rhs; }
+    );
+
+    if (it == adjacent_list.end() || it->id != adjacent.id)
+        adjacent_list.insert(it, adjacent);
+    else if (adjacent.is_explicit || !it->is_explicit)
+        *it = adjacent;
+}
+
+void Catalogue::MakeAdjacent(const std::vector<Distance>& distances) {
+    struct Entry {
+        Adjacent adjacent;
+        size_t order;
+    };
+
+    // Bucket explicit and implied entries by their origin with one counting pass
+    std::vector<AdjacentList>& stops_to_distance = stops_to_distance_.Write();
+    std::vector<size_t> offsets(stops_->size() + 1, 0);
+    for (const Distance& distance : distances) {
+        ++offsets.at(distance.from + 1);
+        ++offsets.at(distance.to + 1);
+    }
+    for (size_t id = 0; id < stops_to_distance.size(); ++id)
+        offsets[id + 1] += stops_to_distance[id].size();
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<Entry> entries(offsets.back());
+    std::vector<size_t> positions(offsets.begin(), std::prev(offsets.end()));
+    for (size_t id = 0; id < stops_to_distance.size(); ++id)
+        for (const Adjacent& adjacent : stops_to_distance[id])
+            entries[positions[id]++] = {adjacent, 0};
+
+    for (size_t i = 0; i < distances.size(); ++i) {
+        const auto& [from, to, metres] = distances[i];
+        entries[positions[from]++] = {{to, metres, true}, i + 1};
+        entries[positions[to]++] = {{from, metres, false}, i + 1};
+    }
+
+    // Per stop, the latest explicit distance wins over the latest implied one
+    for (size_t id = 0; id < stops_to_distance.size(); ++id) {
+        const auto first = entries.begin() + offsets[id];
+        const auto last = entries.begin() + offsets[id + 1];
+        std::stable_sort(first, last, [](const Entry& lhs, const Entry& rhs) {
+            return lhs.adjacent.id < rhs.adjacent.id;
+        });
+
+        AdjacentList& adjacent_list = stops_to_distance[id];
+        adjacent_list.clear();
+        adjacent_list.reserve(std::distance(first, last));
+        for (auto it = first; it != last; ++it) {
+            if (adjacent_list.empty() || adjacent_list.back().id != it->adjacent.id)
+                adjacent_list.push_back(it->adjacent);
+            else if (it->adjacent.is_explicit || !adjacent_list.back().is_explicit)
+                adjacent_list.back() = it->adjacent;
+        }
+    }
+}
+
+std::optional<int> Catalogue::GetDistance(const StopPtr& stop,
+                                          const StopPtr& adjacent_stop) const {
+    const AdjacentList& adjacent_list = stops_to_distance_->at(stop->id);
+    const auto it = std::lower_bound(
+        adjacent_list.begin(), adjacent_list.end(),
+        adjacent_stop->id,
+        [](const Adjacent& lhs, const size_t rhs) { return lhs.id < rhs; }
+    );
+
+    return (it != adjacent_list.end() && it->id == adjacent_stop->id)
+           ? std::optional<int>(it->distance)
+           : std::nullopt;
+}
+
+int Catalogue::ResolveDistance(const StopPtr& stop,
+                               const StopPtr& next_stop) const {
+    if (const std::optional<int> distance = GetDistance(stop, next_stop))
+        return *distance;
+
+    // Fall back to the great-circle distance if the road one is unknown
+    return static_cast<int>(std::lround(domain::ComputeDistance(stop, next_stop)));
+}
+
+void Catalogue::ResolveDistances(Bus& bus) const {
+    const std::vector<StopPtr>& stops = bus.stops;
+    if (stops.empty())
         return;
 
-    stops_to_distance_[{stop, adjacent_stop}] = metres;
+    bus.distances.reserve(stops.size() - 1);
+    for (auto it = stops.begin(); it + 1 != stops.end(); ++it)
+        bus.distances.push_back(ResolveDistance(*it, *std::next(it)));
+
+    if (!bus.is_roundtrip) {
+        bus.reverse_distances.reserve(stops.size() - 1);
+        for (auto it = stops.begin(); it + 1 != stops.end(); ++it)
+            bus.reverse_distances.push_back(ResolveDistance(*std::next(it), *it));
+    }
 }
 
 void Catalogue::AddBus(Bus bus) {
-    buses_.push_back(std::move(bus));
-    const BusPtr& bus_ptr = std::make_shared<const Bus>(buses_.back());
+    StampRoutes();
+    ResolveDistances(bus);
+
+    LinkBus(buses_.Write().emplace_back(std::make_shared<const Bus>(std::move(bus))));
+    index_state_.is_stale.store(true, std::memory_order_release);
+}
+
+void Catalogue::IndexLazily() const {
+    std::lock_guard<std::mutex> guard(index_state_.mutex);
+    if (!index_state_.is_stale.load(std::memory_order_relaxed))
+        return;
+
+    IndexStopBuses();
+    index_state_.is_stale.store(false, std::memory_order_release);
+}
+
+void Catalogue::LinkBus(const BusPtr& bus_ptr) {
+    bus_names_.Write()[bus_ptr->name] = bus_ptr;
+    name_index_.Write().Add(bus_ptr->name, NameIndex::Kind::BUS);
+}
+
+void Catalogue::UnlinkBus(const BusPtr& bus_ptr) {
+    name_index_.Write().Remove(bus_ptr->name, NameIndex::Kind::BUS);
+    bus_names_.Write().erase(bus_ptr->name);
+}
 
-    bus_names_[buses_.back().name] = bus_ptr;
-    for (const StopPtr& stop_ptr : buses_.back().stops)
-        stop_to_buses_.at(stop_ptr).insert(bus_ptr);
+void Catalogue::RankBuses() const {
+    std::vector<BusPtr>& ranked_buses = ranked_buses_.Write();
+    ranked_buses.assign(buses_->begin(), buses_->end());
+    std::sort(ranked_buses.begin(), ranked_buses.end(), domain::Less<BusPtr>{});
+}
+
+void Catalogue::IndexStopBuses() const {
+    RankBuses();
+    const std::vector<BusPtr>& ranked_buses = *ranked_buses_;
+
+    // Count the distinct buses per stop, then place the ranks with a second
+    // walk; visiting buses by rank leaves every stop's slice sorted
+    static constexpr uint32_t NO_RANK = std::numeric_limits<uint32_t>::max();
+    StopBusIndex& stop_buses = stop_buses_.Write();
+    std::vector<uint32_t>& offsets = stop_buses.offsets;
+    offsets.assign(stops_->size() + 1, 0);
+    std::vector<uint32_t> last_ranks(stops_->size(), NO_RANK);
+    for (uint32_t rank = 0; rank < ranked_buses.size(); ++rank)
+        for (const StopPtr& stop_ptr : ranked_buses[rank]->stops)
+            if (last_ranks[stop_ptr->id] != rank) {
+                last_ranks[stop_ptr->id] = rank;
+                ++offsets[stop_ptr->id + 1];
+            }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t>& bus_ids = stop_buses.bus_ids;
+    bus_ids.assign(offsets.back(), 0);
+    bus_ids.shrink_to_fit();
+    std::vector<uint32_t> positions(offsets.begin(), std::prev(offsets.end()));
+    std::fill(last_ranks.begin(), last_ranks.end(), NO_RANK);
+    for (uint32_t rank = 0; rank < ranked_buses.size(); ++rank)
+        for (const StopPtr& stop_ptr : ranked_buses[rank]->stops)
+            if (last_ranks[stop_ptr->id] != rank) {
+                last_ranks[stop_ptr->id] = rank;
+                bus_ids[positions[stop_ptr->id]++] = rank;
+            }
+}
+
+bool Catalogue::IsValid(const StopBusIndex& stop_buses) const {
+    const std::vector<uint32_t>& offsets = stop_buses.offsets;
+    const std::vector<uint32_t>& bus_ids = stop_buses.bus_ids;
+    if (offsets.size() != stops_->size() + 1 || offsets.front() != 0
+        || offsets.back() != bus_ids.size()
+        || !std::is_sorted(offsets.begin(), offsets.end()))
+        return false;
+
+    // Each slice holds distinct ranks in ascending order
+    for (size_t id = 0; id < stops_->size(); ++id)
+        for (uint32_t i = offsets[id]; i < offsets[id + 1]; ++i)
+            if (bus_ids[i] >= buses_->size()
+             || (i > offsets[id] && bus_ids[i - 1] >= bus_ids[i]))
+                return false;
+
+    // and there is one entry per stop of every bus
+    static constexpr size_t NO_BUS = std::numeric_limits<size_t>::max();
+    std::vector<size_t> last_buses(stops_->size(), NO_BUS);
+    size_t entry_count = 0;
+    for (size_t bus = 0; bus < buses_->size(); ++bus)
+        for (const StopPtr& stop_ptr : (*buses_)[bus]->stops)
+            if (last_buses[stop_ptr->id] != bus) {
+                last_buses[stop_ptr->id] = bus;
+                ++entry_count;
+            }
+    return entry_count == bus_ids.size();
+}
+
+void Catalogue::AddBuses(std::vector<Bus> buses,
+                         std::optional<StopBusIndex> stop_buses) {
+    StampRoutes();
+    ForEachChunk(buses.size(), [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i)
+            ResolveDistances(buses[i]);
+    }, 64);
+
+    const size_t first_bus = buses_->size();
+    buses_.Write().reserve(first_bus + buses.size());
+    bus_names_.Write().reserve(first_bus + buses.size());
+    std::vector<NameIndex::Match> names;
+    names.reserve(buses.size());
+    for (Bus& bus : buses) {
+        const BusPtr& bus_ptr = buses_.Write().emplace_back(
+            std::make_shared<const Bus>(std::move(bus))
+        );
+        bus_names_.Write()[bus_ptr->name] = bus_ptr;
+        names.push_back({bus_ptr->name, NameIndex::Kind::BUS});
+    }
+    name_index_.Write().Add(names);
+
+    if (!stop_buses || !IsValid(*stop_buses)) {
+        IndexStopBuses();
+    } else {
+        RankBuses();
+        stop_buses_.Write() = std::move(*stop_buses);
+    }
+    index_state_.is_stale.store(false, std::memory_order_release);
+}
+
+const BusPtr& Catalogue::ReplaceBus(const BusPtr& bus_ptr, Bus bus) {
+    StampRoutes();
+    ResolveDistances(bus);
+
+    const BusPtr old_bus_ptr = bus_ptr; // keeps the name alive while unlinking
+    std::vector<BusPtr>& buses = buses_.Write();
+    const auto it = std::find(buses.begin(), buses.end(), old_bus_ptr);
+    UnlinkBus(old_bus_ptr);
+    *it = std::make_shared<const Bus>(std::move(bus));
+    LinkBus(*it);
+    return *it;
+}
+
+void Catalogue::CheckUpdate(const std::vector<Delta::Change>& changes) const {
+    // Buses and stops as the changes checked so far leave them
+    std::unordered_set<std::string_view> removed_buses;
+    std::unordered_map<std::string_view, const std::vector<StopPtr>*> new_routes;
+    std::unordered_set<StopPtr> removed_stops;
+
+    const auto check_bus = [&](const std::string& bus_name) {
+        if (!SearchBus(bus_name) || removed_buses.count(bus_name))
+            throw std::invalid_argument("unknown bus '" + bus_name + "'");
+    };
+    const auto check_stop = [&](const StopPtr& stop_ptr) {
+        if (!stop_ptr || IsRemoved(stop_ptr) || removed_stops.count(stop_ptr))
+            throw std::invalid_argument("delta refers to an unknown stop");
+    };
+    const auto is_served = [&](const StopPtr& stop_ptr) {
+        for (const BusPtr& bus_ptr : GetStopBuses(stop_ptr))
+            if (!removed_buses.count(bus_ptr->name) && !new_routes.count(bus_ptr->name))
+                return true;
+        for (const auto& [bus_name, stops] : new_routes)
+            if (std::find(stops->begin(), stops->end(), stop_ptr) != stops->end())
+                return true;
+        return false;
+    };
+
+    for (const Delta::Change& change : changes)
+        if (const auto* remove_bus = std::get_if<Delta::RemoveBus>(&change)) {
+            check_bus(remove_bus->name);
+            removed_buses.insert(remove_bus->name);
+            new_routes.erase(remove_bus->name);
+        } else if (const auto* remove_stop = std::get_if<Delta::RemoveStop>(&change)) {
+            const StopPtr stop_ptr = SearchStop(remove_stop->name);
+            if (!stop_ptr || removed_stops.count(stop_ptr))
+                throw std::invalid_argument("unknown stop '" + remove_stop->name + "'");
+            if (is_served(stop_ptr))
+                throw std::logic_error(
+                    "stop '" + remove_stop->name + "' is still served by buses"
+                );
+            removed_stops.insert(stop_ptr);
+        } else if (const auto* bus_stops = std::get_if<Delta::UpdateBusStops>(&change)) {
+            check_bus(bus_stops->name);
+            for (const StopPtr& stop_ptr : bus_stops->stops)
+                if (!stop_ptr || IsRemoved(stop_ptr) || removed_stops.count(stop_ptr))
+                    throw std::invalid_argument(
+                        "bus '" + bus_stops->name + "' refers to an unknown stop"
+                    );
+            new_routes[bus_stops->name] = &bus_stops->stops;
+        } else if (const auto* distance = std::get_if<Delta::UpdateDistance>(&change)) {
+            check_stop(distance->stop);
+            check_stop(distance->adjacent_stop);
+        }
+}
+
+void Catalogue::Update(const std::vector<Delta::Change>& changes) {
+    EnsureIndexed();
+    CheckUpdate(changes);
+
+    // Distances are re-resolved once for the buses passing any changed pair
+    std::set<std::pair<size_t, size_t>> changed_pairs;
+    std::vector<BusPtr> replaced_buses;
+    bool is_route_changed = false;
+    for (const Delta::Change& change : changes)
+        if (const auto* remove_bus = std::get_if<Delta::RemoveBus>(&change)) {
+            const BusPtr bus_ptr = SearchBus(remove_bus->name);
+            UnlinkBus(bus_ptr);
+            std::vector<BusPtr>& buses = buses_.Write();
+            buses.erase(std::find(buses.begin(), buses.end(), bus_ptr));
+            StampRoutes();
+            is_route_changed = true;
+        } else if (const auto* remove_stop = std::get_if<Delta::RemoveStop>(&change)) {
+            UnlinkStop(SearchStop(remove_stop->name));
+        } else if (const auto* bus_stops = std::get_if<Delta::UpdateBusStops>(&change)) {
+            const BusPtr& bus_ptr = SearchBus(bus_stops->name);
+            is_route_changed |= bus_ptr->stops != bus_stops->stops;
+            replaced_buses.push_back(ReplaceBus(
+                bus_ptr,
+                {bus_ptr->name, bus_stops->stops, bus_stops->is_roundtrip, bus_ptr->velocity}
+            ));
+        } else if (const auto* distance = std::get_if<Delta::UpdateDistance>(&change)) {
+            MakeAdjacent(distance->stop, distance->adjacent_stop, distance->metres);
+            changed_pairs.insert(std::minmax(distance->stop->id, distance->adjacent_stop->id));
+        }
+
+    if (!changed_pairs.empty()) {
+        std::vector<BusPtr> affected;
+        for (const BusPtr& bus_ptr : *buses_) {
+            const std::vector<StopPtr>& stops = bus_ptr->stops;
+            for (auto it = stops.begin(); it + 1 < stops.end(); ++it)
+                if (changed_pairs.count(std::minmax((*it)->id, (*std::next(it))->id))) {
+                    affected.push_back(bus_ptr);
+                    break;
+                }
+        }
+        for (const BusPtr& bus_ptr : affected)
+            replaced_buses.push_back(ReplaceBus(
+                bus_ptr,
+                {bus_ptr->name, bus_ptr->stops, bus_ptr->is_roundtrip, bus_ptr->velocity}
+            ));
+    }
+
+    // Names and so ranks stay unless a bus is gone, only new routes change
+    // the stop index
+    if (is_route_changed) {
+        IndexStopBuses();
+        return;
+    }
+    if (replaced_buses.empty())
+        return;
+    std::vector<BusPtr>& ranked_buses = ranked_buses_.Write();
+    for (const BusPtr& bus_ptr : replaced_buses)
+        if (SearchBus(bus_ptr->name) == bus_ptr)
+            *std::lower_bound(ranked_buses.begin(), ranked_buses.end(),
+                              bus_ptr, domain::Less<BusPtr>{}) = bus_ptr;
+}
+
+void Catalogue::RemoveBus(const std::string_view bus_name) {
+    Update({Delta::RemoveBus{std::string(bus_name)}});
+}
+
+void Catalogue::UpdateBusStops(const std::string_view bus_name,
+                               std::vector<StopPtr> stops,
+                               const bool is_roundtrip) {
+    Update({Delta::UpdateBusStops{std::string(bus_name), std::move(stops), is_roundtrip}});
+}
+
+void Catalogue::UpdateDistance(const StopPtr& stop,
+                               const StopPtr& adjacent_stop,
+                               const int distance) {
+    Update({Delta::UpdateDistance{stop, adjacent_stop, distance}});
+}
+
+void Catalogue::RemoveStop(const std::string_view stop_name) {
+    Update({Delta::RemoveStop{std::string(stop_name)}});
+}
+
+void Catalogue::UnlinkStop(const StopPtr& stop_ptr) {
+    // Every adjacency is mirrored, so only the neighbours' lists refer back
+    std::vector<AdjacentList>& stops_to_distance = stops_to_distance_.Write();
+    AdjacentList& adjacent_list = stops_to_distance.at(stop_ptr->id);
+    for (const Adjacent& adjacent : adjacent_list) {
+        if (adjacent.id == stop_ptr->id)
+            continue;
+
+        AdjacentList& neighbour_list = stops_to_distance.at(adjacent.id);
+        neighbour_list.erase(std::lower_bound(
+            neighbour_list.begin(), neighbour_list.end(),
+            stop_ptr->id,
+            [](const Adjacent& lhs, const size_t rhs) { return lhs.id < rhs; }
+        ));
+    }
+    adjacent_list.clear();
+
+    spatial_index_.Write().Remove(stop_ptr->id);
+    name_index_.Write().Remove(stop_ptr->name, NameIndex::Kind::STOP);
+    stop_names_.Write().erase(stop_ptr->name);
 }
 
 std::optional<BusLine> Catalogue::GetBusLine(
@@ -52,24 +489,24 @@ std::optional<BusLine> Catalogue::GetBusLine(
     const std::unordered_set<StopPtr> unique_stops{stops.begin(), stops.end()};
     bus_line.unique_stop_count = unique_stops.size();
 
-    double distance = 0;
-    const auto compute_bus_line = [&](StopPtr stop, StopPtr next_stop) {
-        distance += domain::ComputeDistance(stop, next_stop);
-        if (stops_to_distance_.find({stop, next_stop}) != stops_to_distance_.end())
-            bus_line.length += stops_to_distance_.at({stop, next_stop});
-        else if (stops_to_distance_.find({next_stop, stop}) != stops_to_distance_.end())
-            bus_line.length += stops_to_distance_.at({next_stop, stop});
-        else
-            bus_line.length -= 1;
-    };
+    std::vector<size_t> stop_ids;
+    stop_ids.reserve(stops.size());
+    for (const StopPtr& stop_ptr : stops)
+        stop_ids.push_back(stop_ptr->id);
 
-    for (auto it = stops.begin(); it + 1 != stops.end(); ++it)
-        compute_bus_line(*it, *std::next(it));
+    std::vector<double> distances(stop_ids.empty() ? 0 : stop_ids.size() - 1);
+    stop_columns_->ComputeSequenceDistances(
+        stop_ids.data(), stop_ids.size(), distances.data()
+    );
+    double distance = std::accumulate(distances.begin(), distances.end(), 0.);
+    for (const int metres : bus_ptr->distances)
+        bus_line.length += metres;
 
     if (!bus_ptr->is_roundtrip) {
         bus_line.stops_count = 2*bus_line.stops_count - 1;
-        for (auto it = stops.rbegin(); it + 1 != stops.rend(); ++it)
-            compute_bus_line(*it, *std::next(it));
+        distance *= 2;
+        for (const int metres : bus_ptr->reverse_distances)
+            bus_line.length += metres;
     }
     bus_line.curvature = bus_line.length/distance;
 
@@ -79,31 +516,125 @@ std::optional<BusLine> Catalogue::GetBusLine(
 std::optional<domain::StopStat> Catalogue::GetStop(
     const std::string_view stop_name
 ) const {
-    const static domain::SetPtr<BusPtr> empty_stop;
-
     const StopPtr& stop_ptr = SearchStop(stop_name);
     if (!stop_ptr)
         return std::nullopt;
 
-    return StopStat{
-        stop_ptr,
-        stop_ptr ? stop_to_buses_.at(stop_ptr) : empty_stop
-    };
+    return StopStat{stop_ptr, GetStopBuses(stop_ptr)};
+}
+
+std::vector<BusPtr> Catalogue::GetCommonBuses(
+    const std::vector<StopPtr>& stops
+) const {
+    if (stops.empty())
+        return {};
+
+    EnsureIndexed();
+    const std::vector<uint32_t>& offsets = stop_buses_->offsets;
+    const std::vector<uint32_t>& bus_ids = stop_buses_->bus_ids;
+    std::vector<uint32_t> common(bus_ids.begin() + offsets.at(stops.front()->id),
+                                 bus_ids.begin() + offsets.at(stops.front()->id + 1));
+    for (auto stop_it = std::next(stops.begin());
+         stop_it != stops.end() && !common.empty(); ++stop_it) {
+        auto first = bus_ids.begin() + offsets.at((*stop_it)->id);
+        const auto last = bus_ids.begin() + offsets.at((*stop_it)->id + 1);
+
+        // Both slices are ascending, the kept ranks are written over the front
+        auto out = common.begin();
+        for (auto it = common.begin(); it != common.end() && first != last;)
+            if (*it < *first) {
+                ++it;
+            } else if (*first < *it) {
+                ++first;
+            } else {
+                *out++ = *it++;
+                ++first;
+            }
+        common.erase(out, common.end());
+    }
+
+    std::vector<BusPtr> buses;
+    buses.reserve(common.size());
+    for (const uint32_t rank : common)
+        buses.push_back((*ranked_buses_)[rank]);
+    return buses;
+}
+
+std::vector<std::pair<StopPtr, double>> Catalogue::GetNearestStops(
+    const geo::Coordinates coords,
+    const size_t count
+) const {
+    std::vector<std::pair<StopPtr, double>> stops;
+    stops.reserve(std::min(count, stops_->size()));
+    for (const auto& [id, distance] : spatial_index_->FindNearest(coords, count))
+        stops.emplace_back((*stops_)[id], distance);
+    return stops;
+}
+
+domain::SetPtr<StopPtr> Catalogue::GetStopsInBox(
+    const geo::Coordinates min,
+    const geo::Coordinates max
+) const {
+    domain::SetPtr<StopPtr> stops;
+    for (const size_t id : spatial_index_->FindInBox({min, max}))
+        stops.insert((*stops_)[id]);
+    return stops;
 }
 
 domain::SetStat<BusLine> Catalogue::GetAllBusLines() const {
     domain::SetStat<BusLine> bus_lines;
-    for (const Bus& bus : buses_)
-        bus_lines.insert(*GetBusLine(bus.name));
+    for (const BusPtr& bus_ptr : *buses_)
+        bus_lines.insert(*GetBusLine(bus_ptr->name));
     return bus_lines;
 }
 
 domain::SetStat<StopStat> Catalogue::GetAllStopStats() const {
     domain::SetStat<StopStat> stop_stats;
-    for (const auto& [stop_ptr, buses] : stop_to_buses_)
-        if (!buses.empty())
-            stop_stats.insert(*GetStop(stop_ptr->name));
+    for (const StopPtr& stop_ptr : *stops_)
+        if (const domain::BusRange buses = GetStopBuses(stop_ptr); !buses.empty())
+            stop_stats.insert({stop_ptr, buses});
     return stop_stats;
 }
 
+std::vector<MemoryUsage> Catalogue::GetMemoryUsage() const {
+    using memory::GetByteSize;
+    EnsureIndexed();
+
+    size_t stop_bytes = GetByteSize(*stops_);
+    for (const StopPtr& stop_ptr : *stops_)
+        stop_bytes += memory::SHARED_OVERHEAD + sizeof(Stop)
+                    + GetByteSize(stop_ptr->name);
+
+    size_t bus_bytes = GetByteSize(*buses_);
+    for (const BusPtr& bus_ptr : *buses_)
+        bus_bytes += memory::SHARED_OVERHEAD + sizeof(Bus)
+                   + GetByteSize(bus_ptr->name)
+                   + GetByteSize(bus_ptr->stops)
+                   + GetByteSize(bus_ptr->distances)
+                   + GetByteSize(bus_ptr->reverse_distances);
+
+    const size_t stop_bus_bytes = GetByteSize(*ranked_buses_)
+                                + GetByteSize(stop_buses_->offsets)
+                                + GetByteSize(stop_buses_->bus_ids);
+
+    size_t adjacent_count = 0;
+    size_t adjacent_bytes = GetByteSize(*stops_to_distance_);
+    for (const AdjacentList& adjacent_list : *stops_to_distance_) {
+        adjacent_count += adjacent_list.size();
+        adjacent_bytes += GetByteSize(adjacent_list);
+    }
+
+    return {
+        {"catalogue.stops", stop_bytes, stops_->size()},
+        {"catalogue.buses", bus_bytes, buses_->size()},
+        memory::Describe("catalogue.stop_names", *stop_names_),
+        memory::Describe("catalogue.bus_names", *bus_names_),
+        {"catalogue.stop_buses", stop_bus_bytes, stop_buses_->bus_ids.size()},
+        {"catalogue.stops_to_distance", adjacent_bytes, adjacent_count},
+        {"catalogue.stop_columns", stop_columns_->GetByteSize(), stop_columns_->GetSize()},
+        {"catalogue.spatial_index", spatial_index_->GetByteSize(), spatial_index_->GetPointCount()},
+        {"catalogue.name_index", name_index_->GetByteSize(), name_index_->GetSize()},
+    };
+}
+
 } // namespace transport
\ No newline at end of file
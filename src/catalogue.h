@@ -1,96 +1,213 @@
 #pragma once
 #include "domain.h"
+#include "memory.h"
+#include "name_index.h"
+#include "spatial_index.h"
 
-#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <unordered_map>
-#include <unordered_set>
+#include <variant>
 #include <vector>
 
 namespace transport {
 
 class Catalogue {
 public:
-    using AdjacentStops = std::pair<domain::StopPtr, domain::StopPtr>;
+    struct Adjacent {
+        size_t id;
+        int distance; // [m]
+        bool is_explicit;
+    };
+    using AdjacentList = std::vector<Adjacent>; // sorted by id
 
-    class AdjacentStopsHasher {
-    public:
-        inline size_t operator()(const AdjacentStops adjacent_stops) const {
-            return hash_(adjacent_stops.first.get())
-                   + hash_(adjacent_stops.second.get())*37;
-        }
+    struct Distance {
+        size_t from;
+        size_t to;
+        int metres;
+    };
+
+    // Buses serving each stop as ranks into the buses ordered by name: stop i
+    // is served by bus_ids[offsets[i]..offsets[i + 1]) in ascending order
+    struct StopBusIndex {
+        std::vector<uint32_t> offsets = {0};
+        std::vector<uint32_t> bus_ids;
+    };
+
+    // One change of a delta batch with its stops already looked up
+    struct Delta {
+        struct RemoveBus {
+            std::string name;
+        };
+
+        struct RemoveStop {
+            std::string name;
+        };
+
+        struct UpdateBusStops {
+            std::string name;
+            std::vector<domain::StopPtr> stops;
+            bool is_roundtrip;
+        };
+
+        struct UpdateDistance {
+            domain::StopPtr stop;
+            domain::StopPtr adjacent_stop;
+            int metres;
+        };
 
-    private:
-        std::hash<const void*> hash_;
+        using Change = std::variant<RemoveBus, RemoveStop, UpdateBusStops, UpdateDistance>;
     };
 
 public:
     inline size_t GetStopCount() const {
-        return stops_.size();
+        return stops_->size();
     }
 
     inline size_t GetBusCount() const {
-        return buses_.size();
+        return buses_->size();
+    }
+
+    inline const std::vector<domain::StopPtr>& GetStops() const {
+        return *stops_;
+    }
+
+    inline const std::vector<domain::BusPtr>& GetBuses() const {
+        return *buses_;
     }
 
     inline const std::unordered_map<std::string_view, domain::StopPtr>&
     GetStopsHolder() const {
-        return stop_names_;
+        return *stop_names_;
     }
 
     inline const std::unordered_map<std::string_view, domain::BusPtr>&
     GetBusesHolder() const {
-        return bus_names_;
+        return *bus_names_;
     }
 
-    inline const std::unordered_map<AdjacentStops, int, AdjacentStopsHasher>&
-    GetDistances() const {
-        return stops_to_distance_;
+    inline const StopBusIndex& GetStopBusIndex() const {
+        EnsureIndexed();
+        return *stop_buses_;
+    }
+
+    inline domain::BusRange GetStopBuses(const domain::StopPtr& stop_ptr) const {
+        EnsureIndexed();
+        const uint32_t* bus_ids = stop_buses_->bus_ids.data();
+        return {bus_ids + stop_buses_->offsets.at(stop_ptr->id),
+                bus_ids + stop_buses_->offsets.at(stop_ptr->id + 1),
+                *ranked_buses_};
+    }
+
+    // Changes whenever stops or buses are added, replaced or removed, which
+    // is what the route graph is built from. Copies keep it, so catalogues
+    // with equal stamps have equal route graphs
+    inline uint64_t GetRouteStamp() const {
+        return route_stamp_;
+    }
+
+    inline const SpatialIndex& GetSpatialIndex() const {
+        return *spatial_index_;
+    }
+
+    inline const AdjacentList& GetAdjacent(const size_t stop_id) const {
+        return stops_to_distance_->at(stop_id);
     }
 
     inline size_t GetStopId(const std::string_view stop_name) const {
-        return std::distance(
-            stops_.begin(),
-            FindByName(stops_.begin(), stops_.end(), stop_name)
-        );
+        const domain::StopPtr& stop_ptr = SearchStop(stop_name);
+        return stop_ptr ? stop_ptr->id : stops_->size();
     }
 
     inline size_t GetBusId(const std::string_view bus_name) const {
         return std::distance(
-            buses_.begin(),
-            FindByName(buses_.begin(), buses_.end(), bus_name)
+            buses_->begin(),
+            std::find_if(buses_->begin(), buses_->end(), [bus_name](const auto& bus_ptr) {
+                return bus_name == bus_ptr->name;
+            })
         );
     }
 
     inline domain::StopPtr GetStop(const size_t id) const {
-        return std::next(stop_names_.begin(), id)->second;
+        return stops_->at(id);
     }
 
     inline domain::BusPtr GetBus(const size_t id) const {
-        return std::next(bus_names_.begin(), id)->second;
+        return buses_->at(id);
     }
 
     inline domain::StopPtr SearchStop(const std::string_view stop_name) const {
-        return (stop_names_.find(stop_name) != stop_names_.end())
-               ? stop_names_.at(stop_name)
-               : nullptr;
+        const auto it = stop_names_->find(stop_name);
+        return (it != stop_names_->end()) ? it->second : nullptr;
     }
 
     inline domain::BusPtr SearchBus(const std::string_view bus_name) const {
-        return (bus_names_.find(bus_name) != bus_names_.end())
-               ? bus_names_.at(bus_name)
-               : nullptr;
+        const auto it = bus_names_->find(bus_name);
+        return (it != bus_names_->end()) ? it->second : nullptr;
+    }
+
+    // Removed stops keep their slots in GetStops() so that ids stay dense
+    inline bool IsRemoved(const domain::StopPtr& stop_ptr) const {
+        return SearchStop(stop_ptr->name) != stop_ptr;
     }
 
     void AddStop(domain::Stop stop);
 
+    // The spatial grid is rebuilt unless a matching one is given
+    void AddStops(std::vector<domain::Stop> stops,
+                  std::optional<SpatialIndex::Grid> grid = std::nullopt);
+
     void MakeAdjacent(const domain::StopPtr& stop,
                       const domain::StopPtr& adjacent_stop,
                       const int distance);
 
+    // Same as MakeAdjacent called for each element in order
+    void MakeAdjacent(const std::vector<Distance>& distances);
+
+    std::optional<int> GetDistance(const domain::StopPtr& stop,
+                                   const domain::StopPtr& adjacent_stop) const;
+
+    // The stop to buses index is rebuilt once by the first lookup after
+    // a run of these
     void AddBus(domain::Bus bus);
 
+    // Indexes the buses added one by one now rather than on the first lookup
+    inline void EnsureIndexed() const {
+        if (index_state_.is_stale.load(std::memory_order_acquire))
+            IndexLazily();
+    }
+
+    // The stop to buses index is rebuilt unless a matching one is given
+    void AddBuses(std::vector<domain::Bus> buses,
+                  std::optional<StopBusIndex> stop_buses = std::nullopt);
+
+    // ---------- Delta updates ----------
+    // Each one keeps the buses' resolved distances and all indices valid
+
+    // Checks the whole batch against the catalogue as the earlier changes
+    // leave it and throws before changing anything. The changes are then
+    // applied with the stop to buses index rebuilt once at most
+    void Update(const std::vector<Delta::Change>& changes);
+
+    void RemoveBus(const std::string_view bus_name);
+
+    void UpdateBusStops(const std::string_view bus_name,
+                        std::vector<domain::StopPtr> stops,
+                        const bool is_roundtrip);
+
+    // Same as MakeAdjacent but also re-resolves buses passing the stops
+    void UpdateDistance(const domain::StopPtr& stop,
+                        const domain::StopPtr& adjacent_stop,
+                        const int distance);
+
+    // Stop must not be served by any bus
+    void RemoveStop(const std::string_view stop_name);
+
     std::optional<domain::BusLine> GetBusLine(
         const std::string_view bus_name
     ) const;
@@ -99,27 +216,99 @@ public:
         const std::string_view stop_name
     ) const;
 
+    std::vector<std::pair<domain::StopPtr, double>> GetNearestStops(
+        const geo::Coordinates coords,
+        const size_t count
+    ) const;
+
+    domain::SetPtr<domain::StopPtr> GetStopsInBox(
+        const geo::Coordinates min,
+        const geo::Coordinates max
+    ) const;
+
+    inline std::vector<NameIndex::Match> Suggest(const std::string_view query,
+                                                 const size_t count) const {
+        return name_index_->Suggest(query, count);
+    }
+
+    // Buses serving every one of the stops in name order, each pair of lists
+    // is merged in linear time
+    std::vector<domain::BusPtr> GetCommonBuses(
+        const std::vector<domain::StopPtr>& stops
+    ) const;
+
     domain::SetStat<domain::BusLine> GetAllBusLines() const;
 
     domain::SetStat<domain::StopStat> GetAllStopStats() const;
 
+    std::vector<MemoryUsage> GetMemoryUsage() const;
+
 private:
-    std::deque<domain::Stop> stops_;
-    std::deque<domain::Bus> buses_;
-    std::unordered_map<std::string_view, domain::StopPtr> stop_names_;
-    std::unordered_map<std::string_view, domain::BusPtr> bus_names_;
-    std::unordered_map<domain::StopPtr, domain::SetPtr<domain::BusPtr>> stop_to_buses_;
-    std::unordered_map<AdjacentStops, int, AdjacentStopsHasher> stops_to_distance_; //[m]
-
-    template<typename InputIt>
-    static InputIt FindByName(InputIt first, InputIt last, std::string_view name);
-};
+    // Copies take the state of the stop to buses index but not the lock
+    struct IndexState {
+        IndexState() = default;
+
+        IndexState(const IndexState& other)
+            : is_stale(other.is_stale.load(std::memory_order_acquire)) {
+        }
+
+        IndexState& operator=(const IndexState& other) {
+            is_stale.store(other.is_stale.load(std::memory_order_acquire),
+                           std::memory_order_release);
+            return *this;
+        }
+
+        std::mutex mutex;
+        std::atomic<bool> is_stale{false};
+    };
+
+    // Copies of the catalogue share each of these until either one changes it
+    template <typename T>
+    using Shared = CopyOnWrite<T>;
+
+    Shared<std::vector<domain::StopPtr>> stops_;
+    Shared<std::vector<domain::BusPtr>> buses_;
+    Shared<std::unordered_map<std::string_view, domain::StopPtr>> stop_names_;
+    Shared<std::unordered_map<std::string_view, domain::BusPtr>> bus_names_;
+    mutable Shared<std::vector<domain::BusPtr>> ranked_buses_; // ordered by name
+    mutable Shared<StopBusIndex> stop_buses_;
+    mutable IndexState index_state_;
+    Shared<std::vector<AdjacentList>> stops_to_distance_; // indexed by stop id
+    Shared<geo::PointColumns> stop_columns_; // indexed by stop id
+    Shared<SpatialIndex> spatial_index_;
+    Shared<NameIndex> name_index_;
+    uint64_t route_stamp_ = 0;
+
+    void StampRoutes();
+
+    const domain::StopPtr& EmplaceStop(domain::Stop stop);
+
+    void SetDistance(const size_t id, const Adjacent adjacent);
+
+    int ResolveDistance(const domain::StopPtr& stop,
+                        const domain::StopPtr& next_stop) const;
+
+    void ResolveDistances(domain::Bus& bus) const;
+
+    void LinkBus(const domain::BusPtr& bus_ptr);
 
-template<typename InputIt>
-InputIt Catalogue::FindByName(InputIt first, InputIt last, std::string_view name) {
-    return std::find_if(first, last, [name](const auto& element) {
-        return name == element.name;
-    });
-}
+    void UnlinkBus(const domain::BusPtr& bus_ptr);
+
+    void UnlinkStop(const domain::StopPtr& stop_ptr);
+
+    // Leaves the ranked buses and the stop to buses index to the caller
+    const domain::BusPtr& ReplaceBus(const domain::BusPtr& bus_ptr, domain::Bus bus);
+
+    void CheckUpdate(const std::vector<Delta::Change>& changes) const;
+
+    void RankBuses() const;
+
+    // Const as buses added one by one are indexed lazily
+    void IndexStopBuses() const;
+
+    void IndexLazily() const;
+
+    bool IsValid(const StopBusIndex& stop_buses) const;
+};
 
 } // namespace transport
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 #include <geo/geo.h>
 
+#include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <set>
@@ -38,6 +40,7 @@ struct Stop {
     std::string name;
     geo::Coordinates coords;
     uint16_t wait_time; // [min]
+    size_t id = 0;
 };
 using StopPtr = std::shared_ptr<const Stop>;
 
@@ -48,6 +51,11 @@ struct Bus {
     std::vector<StopPtr> stops;
     bool is_roundtrip;
     uint16_t velocity; // [km/h]
+
+    // Road distances resolved by the catalogue: distances[i] is the segment
+    // stops[i] -> stops[i + 1], reverse_distances[i] is stops[i + 1] -> stops[i]
+    std::vector<int> distances = {}; // [m]
+    std::vector<int> reverse_distances = {}; // [m]
 };
 using BusPtr = std::shared_ptr<const Bus>;
 
@@ -72,11 +80,94 @@ struct BusLine {
     double curvature = 1.;
 };
 
+// ---------- BusRange ----------------
+
+// Slice of bus ranks resolved against the buses ordered by name, so iterating
+// it visits the buses in name order
+class BusRange {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = BusPtr;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const BusPtr*;
+        using reference = const BusPtr&;
+
+        Iterator(const uint32_t* rank, const std::vector<BusPtr>* ranked_buses)
+            : rank_(rank)
+            , ranked_buses_(ranked_buses)
+        {}
+
+        inline reference operator*() const {
+            return (*ranked_buses_)[*rank_];
+        }
+
+        inline pointer operator->() const {
+            return &**this;
+        }
+
+        inline Iterator& operator++() {
+            ++rank_;
+            return *this;
+        }
+
+        inline Iterator operator++(int) {
+            Iterator it = *this;
+            ++rank_;
+            return it;
+        }
+
+        inline bool operator==(const Iterator& other) const {
+            return rank_ == other.rank_;
+        }
+
+        inline bool operator!=(const Iterator& other) const {
+            return rank_ != other.rank_;
+        }
+
+    private:
+        const uint32_t* rank_;
+        const std::vector<BusPtr>* ranked_buses_;
+    };
+
+    BusRange() = default;
+
+    BusRange(const uint32_t* first,
+             const uint32_t* last,
+             const std::vector<BusPtr>& ranked_buses)
+        : first_(first)
+        , last_(last)
+        , ranked_buses_(&ranked_buses)
+    {}
+
+    inline Iterator begin() const {
+        return {first_, ranked_buses_};
+    }
+
+    inline Iterator end() const {
+        return {last_, ranked_buses_};
+    }
+
+    inline size_t size() const {
+        return last_ - first_;
+    }
+
+    inline bool empty() const {
+        return first_ == last_;
+    }
+
+private:
+    const uint32_t* first_ = nullptr;
+    const uint32_t* last_ = nullptr;
+    const std::vector<BusPtr>* ranked_buses_ = nullptr;
+};
+
 // ---------- StopStat ----------------
 
 struct StopStat {
     StopPtr ptr;
-    const SetPtr<BusPtr>& unique_buses;
+    BusRange unique_buses; // valid while the catalogue is unchanged
 };
 
 // ---------- Route -------------------
@@ -1,5 +1,16 @@
 #include "json_reader.h"
 
+#include <json/json_parser.h>
+
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+
+#include "metrics.h"
+#include "parallel.h"
+
 namespace transport {
 namespace io {
 
@@ -9,6 +20,150 @@ void ThrowInvalidRequest(const std::string& id, const std::string& type) {
     );
 }
 
+domain::StopPtr SearchStop(const Catalogue& db, const std::string& stop_name) {
+    const domain::StopPtr stop_ptr = db.SearchStop(stop_name);
+    if (!stop_ptr)
+        throw std::invalid_argument("unknown stop '" + stop_name + "'");
+    return stop_ptr;
+}
+
+static_assert(std::variant_size_v<StatRequest::Query> <= metrics::Registry::MAX_REQUEST_TYPES);
+
+namespace {
+
+constexpr std::string_view WHITESPACE = " \t\n\r";
+
+// Position after the string opened by the quote at the position
+size_t SkipString(const std::string_view text, size_t pos) {
+    while (true) {
+        pos = text.find_first_of("\"\\", pos + 1);
+        if (pos == std::string_view::npos || text[pos] == '"')
+            return (pos == std::string_view::npos) ? pos : pos + 1;
+        ++pos; // the escaped character
+    }
+}
+
+// End of the value starting at the position, only strings and brackets are
+// looked at
+size_t SkipValue(const std::string_view text, size_t pos) {
+    size_t depth = 0;
+    while ((pos = text.find_first_of("\"[]{},", pos)) != std::string_view::npos)
+        switch (text[pos]) {
+            case '"':
+                pos = SkipString(text, pos);
+                if (pos == std::string_view::npos || depth == 0)
+                    return pos;
+                break;
+            case '[':
+            case '{':
+                ++depth;
+                ++pos;
+                break;
+            case ']':
+            case '}':
+                if (depth == 0)
+                    return pos;
+                if (--depth == 0)
+                    return pos + 1;
+                ++pos;
+                break;
+            default:
+                if (depth == 0)
+                    return pos;
+                ++pos;
+        }
+    return pos;
+}
+
+// Text of a root section found by skipping the ones before it unparsed, a
+// key written with escapes is not recognised
+std::optional<std::string_view> FindSection(const std::string_view text,
+                                            const std::string_view key) {
+    const auto next = [&text](const size_t pos) {
+        return (pos < text.size()) ? text.find_first_not_of(WHITESPACE, pos)
+                                   : std::string_view::npos;
+    };
+
+    size_t pos = next(0);
+    if (pos == std::string_view::npos || text[pos] != '{')
+        return std::nullopt;
+    while ((pos = next(pos + 1)) != std::string_view::npos && text[pos] == '"') {
+        const size_t key_end = SkipString(text, pos);
+        if (key_end == std::string_view::npos)
+            return std::nullopt;
+        const std::string_view name = text.substr(pos + 1, key_end - pos - 2);
+
+        pos = next(key_end);
+        if (pos == std::string_view::npos || text[pos] != ':')
+            return std::nullopt;
+        const size_t first = next(pos + 1);
+        if (first == std::string_view::npos)
+            return std::nullopt;
+        const size_t last = SkipValue(text, first);
+        if (last == std::string_view::npos)
+            return std::nullopt;
+        if (name == key)
+            return text.substr(first, last - first);
+
+        pos = next(last);
+        if (pos == std::string_view::npos || text[pos] != ',')
+            return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+struct NodeFootprint {
+    size_t bytes = 0;
+    size_t count = 0;
+};
+
+void Accumulate(const json::Node& node, NodeFootprint& footprint);
+
+void Accumulate(const json::Dict& dict, NodeFootprint& footprint) {
+    footprint.bytes += memory::GetByteSize(dict);
+    for (const auto& [key, item] : dict) {
+        footprint.bytes += memory::GetByteSize(key);
+        Accumulate(item, footprint);
+    }
+}
+
+void Accumulate(const json::Node& node, NodeFootprint& footprint) {
+    ++footprint.count;
+    if (node.IsString()) {
+        footprint.bytes += memory::GetByteSize(node.AsString());
+    } else if (node.IsArray()) {
+        footprint.bytes += memory::GetByteSize(node.AsArray());
+        for (const json::Node& item : node.AsArray())
+            Accumulate(item, footprint);
+    } else if (node.IsDict()) {
+        Accumulate(node.AsDict(), footprint);
+    }
+}
+
+// Heap held by the strings of a typed request
+size_t GetHeapSize(const StatRequest& request) {
+    using memory::GetByteSize;
+
+    const StatRequest::Query& query = request.query;
+    if (const auto* bus = std::get_if<StatRequest::Bus>(&query))
+        return GetByteSize(bus->name);
+    if (const auto* stop = std::get_if<StatRequest::Stop>(&query))
+        return GetByteSize(stop->name);
+    if (const auto* route = std::get_if<StatRequest::Route>(&query))
+        return GetByteSize(route->from) + GetByteSize(route->to);
+    if (const auto* suggest = std::get_if<StatRequest::Suggest>(&query))
+        return GetByteSize(suggest->query);
+    if (const auto* common_buses = std::get_if<StatRequest::CommonBuses>(&query)) {
+        size_t bytes = GetByteSize(common_buses->stops);
+        for (const std::string& stop_name : common_buses->stops)
+            bytes += GetByteSize(stop_name);
+        return bytes;
+    }
+    return 0;
+}
+
+} // namespace
+
 renderer::Settings JsonReader::GenerateMapSettings() const {
     renderer::Settings settings;
 
@@ -21,7 +176,7 @@ renderer::Settings JsonReader::GenerateMapSettings() const {
         };
     };
 
-    if (requests_.find("render_settings") == requests_.end())
+    if (!settings_.render)
         return settings;
 
     settings.map_sizes = {
@@ -48,6 +203,22 @@ renderer::Settings JsonReader::GenerateMapSettings() const {
     return settings;
 }
 
+json::PrintSettings JsonReader::GeneratePrintSettings() const {
+    json::PrintSettings settings;
+    if (!settings_.output)
+        return settings;
+
+    if (const auto it = settings_.output->find("precision"); it != settings_.output->end())
+        settings.precision = it->second.AsInt();
+    if (const auto it = settings_.output->find("fixed_precision"); it != settings_.output->end())
+        for (const auto& [field, precision] : it->second.AsDict())
+            settings.fixed_precision.emplace(field, precision.AsInt());
+    if (const auto it = settings_.output->find("pretty"); it != settings_.output->end())
+        settings.is_pretty = it->second.AsBool();
+
+    return settings;
+}
+
 svg::Color JsonReader::ConvertToColor(const json::Node node) {
     svg::Color color;
 
@@ -72,225 +243,1174 @@ svg::Color JsonReader::ConvertToColor(const json::Node node) {
     return color;
 }
 
-std::string JsonReader::ConvertRequestType(const JsonReader::BaseType type) {
-    switch (type) {
-    case JsonReader::BaseType::BUS:
-        return "Bus";
-    case JsonReader::BaseType::STOP:
-        return "Stop";
-    default:
-        throw std::invalid_argument("transport::io::BaseType: enum class");
+// ---------- StatRequest -------------
+
+std::string_view GetTypeName(const StatRequest& request) {
+    return GetTypeName(request.query.index());
+}
+
+std::string_view GetTypeName(const size_t type_index) {
+    // In the order of StatRequest::Query alternatives
+    static constexpr std::string_view names[] = {
+        "Bus", "CommonBuses", "Map", "Memory", "Metrics", "Nearest", "Route",
+        "Stop", "StopsInBox", "Suggest"
+    };
+    static_assert(std::size(names) == std::variant_size_v<StatRequest::Query>);
+    return names[type_index];
+}
+
+json::Node ConvertToNode(const StatRequest& request) {
+    json::Dict dict{
+        {"id", request.id},
+        {"type", std::string(GetTypeName(request))},
+    };
+
+    const StatRequest::Query& query = request.query;
+    if (const auto* bus = std::get_if<StatRequest::Bus>(&query)) {
+        dict.emplace("name", bus->name);
+    } else if (const auto* common_buses = std::get_if<StatRequest::CommonBuses>(&query)) {
+        dict.emplace("stops", json::Array{common_buses->stops.begin(), common_buses->stops.end()});
+    } else if (const auto* nearest = std::get_if<StatRequest::Nearest>(&query)) {
+        dict.emplace("latitude", nearest->coords.lat);
+        dict.emplace("longitude", nearest->coords.lng);
+        dict.emplace("count", static_cast<int>(nearest->count));
+    } else if (const auto* route = std::get_if<StatRequest::Route>(&query)) {
+        dict.emplace("from", route->from);
+        dict.emplace("to", route->to);
+    } else if (const auto* stop = std::get_if<StatRequest::Stop>(&query)) {
+        dict.emplace("name", stop->name);
+    } else if (const auto* box = std::get_if<StatRequest::StopsInBox>(&query)) {
+        dict.emplace("min_latitude", box->min.lat);
+        dict.emplace("min_longitude", box->min.lng);
+        dict.emplace("max_latitude", box->max.lat);
+        dict.emplace("max_longitude", box->max.lng);
+    } else if (const auto* suggest = std::get_if<StatRequest::Suggest>(&query)) {
+        dict.emplace("query", suggest->query);
+        dict.emplace("count", static_cast<int>(suggest->count));
     }
+
+    return json::Node(std::move(dict));
 }
 
-void JsonReader::ParseBases(const BaseType type) {
-    const std::string type_s = ConvertRequestType(type);
+std::string GetQueryKey(const StatRequest& request) {
+    std::string key(GetTypeName(request));
+    const auto add_string = [&key](const std::string_view value) {
+        key.append(std::to_string(value.size())).push_back(':');
+        key.append(value);
+    };
+    const auto add_bytes = [&key](const auto value) {
+        char bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        key.append(bytes, sizeof(value));
+    };
+
+    const StatRequest::Query& query = request.query;
+    if (const auto* bus = std::get_if<StatRequest::Bus>(&query)) {
+        add_string(bus->name);
+    } else if (const auto* common_buses = std::get_if<StatRequest::CommonBuses>(&query)) {
+        for (const std::string& stop : common_buses->stops)
+            add_string(stop);
+    } else if (const auto* nearest = std::get_if<StatRequest::Nearest>(&query)) {
+        add_bytes(nearest->coords.lat);
+        add_bytes(nearest->coords.lng);
+        add_bytes(nearest->count);
+    } else if (const auto* route = std::get_if<StatRequest::Route>(&query)) {
+        add_string(route->from);
+        add_string(route->to);
+    } else if (const auto* stop = std::get_if<StatRequest::Stop>(&query)) {
+        add_string(stop->name);
+    } else if (const auto* box = std::get_if<StatRequest::StopsInBox>(&query)) {
+        add_bytes(box->min.lat);
+        add_bytes(box->min.lng);
+        add_bytes(box->max.lat);
+        add_bytes(box->max.lng);
+    } else if (const auto* suggest = std::get_if<StatRequest::Suggest>(&query)) {
+        add_string(suggest->query);
+        add_bytes(suggest->count);
+    } else if (std::holds_alternative<StatRequest::Metrics>(query)) {
+        add_bytes(request.id);
+    }
+    return key;
+}
 
-    std::vector<Request>* container = nullptr;
-    if (type == BaseType::BUS)
-        container = &buses_;
-    else if (type == BaseType::STOP)
-        container = &stops_;
+// ---------- JsonReader::Ingest ------
 
-    const json::Array& base_requests = requests_.at("base_requests").AsArray();
-    container->reserve(base_requests.size()/2u);
-    for (const auto& base_request : base_requests) {
-        const json::Dict& request = base_request.AsDict();
-        const std::string& type_value = request.at("type").AsString();
+// SAX handler filling the reader while the document is scanned. Base requests
+// are converted field by field; each stat request and every other section
+// are assembled as nodes first, as they are small
+class JsonReader::Ingest {
+public:
+    explicit Ingest(JsonReader& reader) : reader_(reader) {
+    }
+
+    void Null() {
+        if (!Forward(&json::DomBuilder::Null))
+            SetValue(nullptr);
+    }
+
+    void Bool(const bool value) {
+        if (!Forward(&json::DomBuilder::Bool, value))
+            SetValue(value);
+    }
+
+    void Int(const int value) {
+        if (!Forward(&json::DomBuilder::Int, value))
+            SetValue(value);
+    }
+
+    void Double(const double value) {
+        if (!Forward(&json::DomBuilder::Double, value))
+            SetValue(value);
+    }
 
-        if (type_value == type_s)
-            container->push_back(std::make_unique<const json::Dict>(request));
-        else if (type_names_.find(type_value) == type_names_.end())
-            ThrowInvalidRequest(request.at("id").AsString(), type_value);
+    void String(const std::string_view value) {
+        if (!Forward(&json::DomBuilder::String, value))
+            SetValue(value);
     }
+
+    void Key(const std::string_view key) {
+        if (subtree_) {
+            subtree_->Key(key);
+        } else if (depth_ == 1) {
+            section_.assign(key.data(), key.size());
+        } else if (depth_ == 3) {
+            field_.assign(key.data(), key.size());
+        } else if (depth_ == 4) {
+            distance_ref_ = reader_.GetStopRef(key);
+        }
+    }
+
+    void StartArray() {
+        if (!Forward(&json::DomBuilder::StartArray)) {
+            switch (Locate()) {
+                case Place::ROOT:
+                    throw std::logic_error("not a dict");
+                case Place::BASE_ARRAY:
+                case Place::STAT_ARRAY:
+                    break;
+                case Place::BASE_FIELD:
+                    if (field_ != "stops")
+                        Delegate(Target::SKIP)->StartArray();
+                    break;
+                case Place::BASE_REQUEST:
+                    throw std::invalid_argument("base request is not a dict");
+                case Place::SECTION:
+                    Delegate(Target::SECTION)->StartArray();
+                    break;
+                case Place::STAT_REQUEST:
+                    Delegate(Target::STAT)->StartArray();
+                    break;
+                default:
+                    Delegate(Target::SKIP)->StartArray();
+            }
+        }
+        ++depth_;
+    }
+
+    void StartDict() {
+        if (!Forward(&json::DomBuilder::StartDict)) {
+            switch (Locate()) {
+                case Place::ROOT:
+                    break;
+                case Place::BASE_ARRAY:
+                case Place::STAT_ARRAY:
+                    throw std::invalid_argument("'" + section_ + "' is not an array");
+                case Place::BASE_REQUEST:
+                    ResetBase();
+                    break;
+                case Place::BASE_FIELD:
+                    if (field_ != "road_distances")
+                        Delegate(Target::SKIP)->StartDict();
+                    break;
+                case Place::SECTION:
+                    Delegate(Target::SECTION)->StartDict();
+                    break;
+                case Place::STAT_REQUEST:
+                    Delegate(Target::STAT)->StartDict();
+                    break;
+                default:
+                    Delegate(Target::SKIP)->StartDict();
+            }
+        }
+        ++depth_;
+    }
+
+    void EndArray() {
+        --depth_;
+        if (subtree_)
+            Forward(&json::DomBuilder::EndArray);
+    }
+
+    void EndDict() {
+        --depth_;
+        if (subtree_)
+            Forward(&json::DomBuilder::EndDict);
+        else if (depth_ == 2 && section_ == "base_requests")
+            CommitBase();
+    }
+
+private:
+    // Position of a value by the containers enclosing it
+    enum class Place {
+        ROOT,
+        SECTION, // value of a root key other than the requests below
+        BASE_ARRAY,
+        BASE_REQUEST,
+        BASE_FIELD,
+        BASE_ITEM, // element of a bus route or of road distances
+        STAT_ARRAY,
+        STAT_REQUEST,
+        OTHER,
+    };
+
+    enum class Target { SECTION, STAT, SKIP };
+
+    struct BaseRequest {
+        std::string type;
+        std::string name;
+        std::optional<double> latitude;
+        std::optional<double> longitude;
+        std::optional<bool> is_roundtrip;
+        std::vector<std::pair<StopRef, int>> distances;
+        std::vector<StopRef> stops;
+    };
+
+    JsonReader& reader_;
+    size_t depth_ = 0; // containers opened and not closed
+    std::string section_;
+    std::string field_;
+    StopRef distance_ref_ = 0;
+    BaseRequest base_;
+    std::optional<json::DomBuilder> subtree_;
+    size_t subtree_depth_ = 0;
+    Target target_ = Target::SKIP;
+
+    Place Locate() const {
+        const bool is_base = (section_ == "base_requests");
+        const bool is_stat = (section_ == "stat_requests");
+        switch (depth_) {
+            case 0:
+                return Place::ROOT;
+            case 1:
+                return is_base ? Place::BASE_ARRAY
+                       : is_stat ? Place::STAT_ARRAY
+                       : Place::SECTION;
+            case 2:
+                return is_base ? Place::BASE_REQUEST : Place::STAT_REQUEST;
+            case 3:
+                return is_base ? Place::BASE_FIELD : Place::OTHER;
+            case 4:
+                return is_base ? Place::BASE_ITEM : Place::OTHER;
+            default:
+                return Place::OTHER;
+        }
+    }
+
+    json::DomBuilder* Delegate(const Target target) {
+        subtree_.emplace();
+        subtree_depth_ = depth_;
+        target_ = target;
+        return &*subtree_;
+    }
+
+    // Passes the event to the node being assembled and completes the node once
+    // its outermost value ends
+    template <typename... Params, typename... Args>
+    bool Forward(void (json::DomBuilder::*event)(Params...), Args&&... args) {
+        if (!subtree_)
+            return false;
+
+        ((*subtree_).*event)(std::forward<Args>(args)...);
+        if (depth_ == subtree_depth_)
+            Complete();
+        return true;
+    }
+
+    void Complete() {
+        json::Node node = subtree_->Build();
+        subtree_.reset();
+
+        if (target_ == Target::SECTION)
+            reader_.requests_.emplace(section_, std::move(node));
+        else if (target_ == Target::STAT)
+            reader_.stats_.push_back(ParseStat(node.AsDict()));
+    }
+
+    template <typename Value>
+    void SetValue(const Value& value) {
+        switch (Locate()) {
+            case Place::ROOT:
+                throw std::logic_error("not a dict");
+            case Place::SECTION:
+                if constexpr (std::is_same_v<Value, std::string_view>)
+                    reader_.requests_.emplace(section_, std::string(value));
+                else
+                    reader_.requests_.emplace(section_, value);
+                break;
+            case Place::STAT_REQUEST:
+                throw std::logic_error("not a dict");
+            case Place::BASE_FIELD:
+                SetField(value);
+                break;
+            case Place::BASE_ITEM:
+                AddItem(value);
+                break;
+            case Place::OTHER:
+                break;
+            default:
+                throw std::invalid_argument("'" + section_ + "' is not an array of dicts");
+        }
+    }
+
+    template <typename Value>
+    void SetField(const Value& value) {
+        if (field_ == "type" || field_ == "name") {
+            if constexpr (std::is_same_v<Value, std::string_view>)
+                (field_ == "type" ? base_.type : base_.name).assign(value.data(), value.size());
+            else
+                throw std::logic_error("not a string");
+        } else if (field_ == "latitude" || field_ == "longitude") {
+            if constexpr (std::is_same_v<Value, int> || std::is_same_v<Value, double>)
+                (field_ == "latitude" ? base_.latitude : base_.longitude) = value;
+            else
+                throw std::logic_error("not a double");
+        } else if (field_ == "is_roundtrip") {
+            if constexpr (std::is_same_v<Value, bool>)
+                base_.is_roundtrip = value;
+            else
+                throw std::logic_error("not a bool");
+        }
+    }
+
+    template <typename Value>
+    void AddItem(const Value& value) {
+        if (field_ == "stops") {
+            if constexpr (std::is_same_v<Value, std::string_view>)
+                base_.stops.push_back(reader_.GetStopRef(value));
+            else
+                throw std::logic_error("not a string");
+        } else if (field_ == "road_distances") {
+            if constexpr (std::is_same_v<Value, int>)
+                base_.distances.emplace_back(distance_ref_, value);
+            else
+                throw std::logic_error("not an int");
+        }
+    }
+
+    void ResetBase() {
+        base_.type.clear();
+        base_.name.clear();
+        base_.latitude.reset();
+        base_.longitude.reset();
+        base_.is_roundtrip.reset();
+        base_.distances.clear();
+        base_.stops.clear();
+    }
+
+    void CommitBase() {
+        if (base_.type == "Stop") {
+            if (!base_.latitude || !base_.longitude)
+                throw std::invalid_argument("stop '" + base_.name + "' has no coordinates");
+            reader_.AddStop(
+                std::move(base_.name),
+                {*base_.latitude, *base_.longitude},
+                base_.distances
+            );
+        } else if (base_.type == "Bus") {
+            if (!base_.is_roundtrip)
+                throw std::invalid_argument("bus '" + base_.name + "' has no is_roundtrip");
+            reader_.AddBus(std::move(base_.name), std::move(base_.stops), *base_.is_roundtrip);
+        } else {
+            throw std::invalid_argument(
+                "unable to load base request (type='" + base_.type + "')"
+            );
+        }
+    }
+};
+
+// ---------- JsonReader --------------
+
+JsonReader::JsonReader(std::istream& input, SettingsCallback on_serialization) {
+    static const std::string SERIALIZATION_KEY = "serialization_settings";
+
+    const metrics::PhaseTimer timer(metrics::Phase::PARSE);
+    const std::string text = json::ReadAll(input);
+
+    // The section parsed here is kept as the ingest does not replace it
+    bool is_notified = false;
+    if (on_serialization)
+        if (const std::optional<std::string_view> section = FindSection(text, SERIALIZATION_KEY)) {
+            const auto it = requests_.emplace(
+                SERIALIZATION_KEY,
+                json::Load(*section).GetRoot()
+            ).first;
+            on_serialization(it->second.AsDict());
+            is_notified = true;
+        }
+
+    Ingest ingest(*this);
+    json::Parse(text, ingest);
+    ParseSections();
+
+    if (on_serialization && !is_notified && settings_.serialization)
+        on_serialization(*settings_.serialization);
 }
 
-void JsonReader::ParseSettings(const std::string& setting_key) {
-    Request settings = std::make_unique<const json::Dict>(
-        requests_.at(setting_key).AsDict()
-    );
+JsonReader::JsonReader(const json::Dict& requests) {
+    for (const auto& [key, node] : requests)
+        if (key == "base_requests") {
+            ParseBases(node.AsArray());
+        } else if (key == "stat_requests") {
+            stats_.reserve(node.AsArray().size());
+            for (const json::Node& request : node.AsArray())
+                stats_.push_back(ParseStat(request.AsDict()));
+        } else {
+            requests_.emplace(key, node);
+        }
+    ParseSections();
+}
+
+StatRequest JsonReader::ParseStat(const json::Dict& request) {
+    const std::string& type_value = request.at("type").AsString();
+    const int id = request.at("id").AsInt();
+
+    const auto get_count = [&request, id](const size_t default_count) {
+        const auto it = request.find("count");
+        if (it == request.end())
+            return default_count;
+        const int count = it->second.AsInt();
+        if (count < 0)
+            throw std::invalid_argument(
+                "request " + std::to_string(id) + " has a negative count"
+            );
+        return static_cast<size_t>(count);
+    };
+    const auto get_coords = [&request](const std::string& prefix) {
+        return geo::Coordinates{
+            request.at(prefix + "latitude").AsDouble(),
+            request.at(prefix + "longitude").AsDouble()
+        };
+    };
+
+    if (type_value == "Bus")
+        return {id, StatRequest::Bus{request.at("name").AsString()}};
+    if (type_value == "CommonBuses") {
+        StatRequest::CommonBuses common_buses;
+        for (const json::Node& stop_name : request.at("stops").AsArray())
+            common_buses.stops.push_back(stop_name.AsString());
+        return {id, std::move(common_buses)};
+    }
+    if (type_value == "Map")
+        return {id, StatRequest::Map{}};
+    if (type_value == "Memory")
+        return {id, StatRequest::Memory{}};
+    if (type_value == "Metrics")
+        return {id, StatRequest::Metrics{}};
+    if (type_value == "Nearest")
+        return {id, StatRequest::Nearest{get_coords(""), get_count(1)}};
+    if (type_value == "Route")
+        return {id, StatRequest::Route{request.at("from").AsString(), request.at("to").AsString()}};
+    if (type_value == "Stop")
+        return {id, StatRequest::Stop{request.at("name").AsString()}};
+    if (type_value == "StopsInBox")
+        return {id, StatRequest::StopsInBox{get_coords("min_"), get_coords("max_")}};
+    if (type_value == "Suggest")
+        return {id, StatRequest::Suggest{request.at("query").AsString(), get_count(5)}};
 
-    if (setting_key == "render_settings")
-        settings_.render = std::move(settings);
-    else if (setting_key == "routing_settings")
-        settings_.routing = std::move(settings);
-    else if (setting_key == "serialization_settings")
-        settings_.serialization = std::move(settings);
+    ThrowInvalidRequest(std::to_string(id), type_value);
+    return {};
 }
 
-void JsonReader::ParseStats() {
-    const json::Array& stat_requests = requests_.at("stat_requests").AsArray();
+JsonReader::StopRef JsonReader::GetStopRef(const std::string_view stop_name) {
+    if (const auto it = stop_refs_.find(stop_name); it != stop_refs_.end())
+        return it->second;
 
-    stats_.reserve(stat_requests.size());
-    for (const auto& request_node : stat_requests) {
+    const StopRef ref = static_cast<StopRef>(ref_names_.size());
+    stop_refs_.emplace(ref_names_.emplace_back(stop_name), ref);
+    ref_stops_.push_back(NO_STOP);
+    return ref;
+}
+
+size_t JsonReader::ResolveStop(const StopRef ref) const {
+    const size_t index = ref_stops_.at(ref);
+    if (index == NO_STOP)
+        throw std::invalid_argument("unknown stop '" + ref_names_[ref] + "'");
+    return index;
+}
+
+void JsonReader::AddStop(std::string name,
+                         const geo::Coordinates coords,
+                         const std::vector<std::pair<StopRef, int>>& distances) {
+    const StopRef ref = GetStopRef(name);
+    ref_stops_[ref] = stops_.size();
+    stops_.push_back({std::move(name), coords, 0});
+    for (const auto& [adjacent_ref, metres] : distances)
+        distances_.push_back({ref, adjacent_ref, metres});
+}
+
+void JsonReader::AddBus(std::string name,
+                        std::vector<StopRef> stops,
+                        const bool is_roundtrip) {
+    buses_.push_back({std::move(name), std::move(stops), is_roundtrip});
+}
+
+void JsonReader::ParseBases(const json::Array& base_requests) {
+    for (const json::Node& request_node : base_requests) {
         const json::Dict& request = request_node.AsDict();
         const std::string& type_value = request.at("type").AsString();
 
-        if (type_names_.find(type_value) != type_names_.end())
-            stats_.push_back(std::make_unique<const json::Dict>(request));
+        if (type_value == "Stop") {
+            std::vector<std::pair<StopRef, int>> distances;
+            if (const auto it = request.find("road_distances"); it != request.end())
+                for (const auto& [stop_name, distance] : it->second.AsDict())
+                    distances.emplace_back(GetStopRef(stop_name), distance.AsInt());
+
+            AddStop(
+                request.at("name").AsString(),
+                {request.at("latitude").AsDouble(), request.at("longitude").AsDouble()},
+                distances
+            );
+        } else if (type_value == "Bus") {
+            std::vector<StopRef> stops;
+            for (const json::Node& stop_name : request.at("stops").AsArray())
+                stops.push_back(GetStopRef(stop_name.AsString()));
+
+            AddBus(request.at("name").AsString(), std::move(stops),
+                   request.at("is_roundtrip").AsBool());
+        } else {
+            throw std::invalid_argument(
+                "unable to load base request (type='" + type_value + "')"
+            );
+        }
+    }
+}
+
+void JsonReader::ParseSections() {
+    const auto find_dict = [this](const std::string& key) -> Request {
+        const auto it = requests_.find(key);
+        return (it != requests_.end()) ? &it->second.AsDict() : nullptr;
+    };
+
+    if (const auto it = requests_.find("delta_requests"); it != requests_.end())
+        ParseDeltas(it->second.AsArray());
+
+    settings_.render = find_dict("render_settings");
+    settings_.routing = find_dict("routing_settings");
+    settings_.serialization = find_dict("serialization_settings");
+    settings_.output = find_dict("output_settings");
+}
+
+void JsonReader::ParseDeltas(const json::Array& delta_requests) {
+    deltas_.reserve(delta_requests.size());
+    for (const auto& request_node : delta_requests) {
+        const json::Dict& request = request_node.AsDict();
+        const std::string& type_value = request.at("type").AsString();
+
+        if (IsDelta(request))
+            deltas_.push_back(&request);
         else
-            ThrowInvalidRequest(request.at("id").AsString(), type_value);
+            throw std::invalid_argument(
+                "unable to load delta request (type='" + type_value + "')"
+            );
     }
 }
 
+bool JsonReader::IsDelta(const json::Dict& request) {
+    static const std::set<std::string_view> delta_type_names{
+        "RemoveBus", "RemoveStop", "UpdateBusStops", "UpdateDistance"
+    };
+    const auto it = request.find("type");
+    return it != request.end() && it->second.IsString()
+        && delta_type_names.count(it->second.AsString());
+}
+
+std::vector<MemoryUsage> JsonReader::GetMemoryUsage() const {
+    using memory::GetByteSize;
+
+    NodeFootprint sections;
+    Accumulate(requests_, sections);
+    sections.bytes += GetByteSize(deltas_);
+
+    size_t stop_bytes = GetByteSize(stops_);
+    for (const domain::Stop& stop : stops_)
+        stop_bytes += GetByteSize(stop.name);
+
+    size_t bus_bytes = GetByteSize(buses_);
+    for (const BusRecord& bus : buses_)
+        bus_bytes += GetByteSize(bus.name) + GetByteSize(bus.stops);
+
+    MemoryUsage stop_refs = memory::Describe("json.stop_refs", stop_refs_);
+    stop_refs.bytes += ref_names_.size()*sizeof(std::string) + GetByteSize(ref_stops_);
+    for (const std::string& name : ref_names_)
+        stop_refs.bytes += GetByteSize(name);
+
+    size_t stat_bytes = GetByteSize(stats_);
+    for (const StatRequest& request : stats_)
+        stat_bytes += GetHeapSize(request);
+
+    return {
+        {"json.sections", sections.bytes, sections.count},
+        {"json.stops", stop_bytes, stops_.size()},
+        {"json.buses", bus_bytes, buses_.size()},
+        {"json.distances", GetByteSize(distances_), distances_.size()},
+        std::move(stop_refs),
+        {"json.stats", stat_bytes, stats_.size()},
+    };
+}
+
 void Populate(Catalogue& db, const JsonReader& reader) {
+    const metrics::PhaseTimer timer(metrics::Phase::POPULATE);
     const auto& routing = reader.GetRoutingSettings();
     const uint16_t bus_wait_time = routing ? routing->at("bus_wait_time").AsInt() : 0;
     const uint16_t bus_velocity = routing ? routing->at("bus_velocity").AsInt() : 0;
 
-    for (const auto& request : reader.GetStops())
-        db.AddStop({
-            request->at("name").AsString(),
-            {request->at("latitude").AsDouble(), request->at("longitude").AsDouble()},
-            bus_wait_time
-        });
+    // Stops keep the order of declaration, so references map to ids directly
+    const size_t first_id = db.GetStopCount();
+    const auto get_id = [&reader, first_id](const JsonReader::StopRef ref) {
+        return first_id + reader.ResolveStop(ref);
+    };
 
-    for (const auto& request : reader.GetStops()) {
-        domain::StopPtr stop_ptr = db.SearchStop(
-            request->at("name").AsString()
-        );
-        for (const auto& [stop_name, distance] : request->at("road_distances").AsDict())
-            db.MakeAdjacent(
-                stop_ptr,
-                db.SearchStop(stop_name),
-                distance.AsInt()
-            );
-    }
+    std::vector<domain::Stop> stops = reader.GetStops();
+    for (domain::Stop& stop : stops)
+        stop.wait_time = bus_wait_time;
+    db.AddStops(std::move(stops));
+
+    std::vector<Catalogue::Distance> distances;
+    distances.reserve(reader.GetDistances().size());
+    for (const auto& [from, to, metres] : reader.GetDistances())
+        distances.push_back({get_id(from), get_id(to), metres});
+    db.MakeAdjacent(distances);
+
+    const auto& records = reader.GetBuses();
+    std::vector<domain::Bus> buses(records.size());
+    ForEachChunk(records.size(), [&](const size_t first, const size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            std::vector<domain::StopPtr> bus_stops;
+            bus_stops.reserve(records[i].stops.size());
+            for (const JsonReader::StopRef ref : records[i].stops)
+                bus_stops.push_back(db.GetStop(get_id(ref)));
+
+            buses[i] = {records[i].name, std::move(bus_stops), records[i].is_roundtrip, bus_velocity};
+        }
+    }, 64);
+    db.AddBuses(std::move(buses));
+}
 
-    for (const auto& request : reader.GetBuses()) {
-        const auto& stop_names = request->at("stops").AsArray();
+Catalogue::Delta::Change ParseDelta(const Catalogue& db, const json::Dict& request) {
+    using Delta = Catalogue::Delta;
 
-        std::vector<domain::StopPtr> stops;
-        stops.reserve(stop_names.size());
+    const std::string& type_value = request.at("type").AsString();
+    if (type_value == "RemoveBus") {
+        return Delta::RemoveBus{request.at("name").AsString()};
+    } else if (type_value == "RemoveStop") {
+        return Delta::RemoveStop{request.at("name").AsString()};
+    } else if (type_value == "UpdateBusStops") {
+        const json::Array& stop_names = request.at("stops").AsArray();
+
+        std::vector<domain::StopPtr> bus_stops;
+        bus_stops.reserve(stop_names.size());
         for (const json::Node& stop_name : stop_names)
-            stops.push_back(db.SearchStop(stop_name.AsString()));
+            bus_stops.push_back(SearchStop(db, stop_name.AsString()));
 
-        db.AddBus({
-            request->at("name").AsString(),
-            stops,
-            request->at("is_roundtrip").AsBool(),
-            bus_velocity
-        });
+        return Delta::UpdateBusStops{
+            request.at("name").AsString(),
+            std::move(bus_stops),
+            request.at("is_roundtrip").AsBool()
+        };
+    } else if (type_value == "UpdateDistance") {
+        return Delta::UpdateDistance{
+            SearchStop(db, request.at("from").AsString()),
+            SearchStop(db, request.at("to").AsString()),
+            request.at("distance").AsInt()
+        };
     }
+    throw std::invalid_argument(
+        "unable to load delta request (type='" + type_value + "')"
+    );
+}
+
+void Update(Catalogue& db, const JsonReader& reader) {
+    // Every delta is read before the first one is applied
+    std::vector<Catalogue::Delta::Change> changes;
+    changes.reserve(reader.GetDeltas().size());
+    for (const auto& request : reader.GetDeltas())
+        changes.push_back(ParseDelta(db, *request));
+    db.Update(changes);
 }
 
 namespace {
 
-json::Node ConstructNotFoundRequest(const int id) {
-    return json::Builder{}.StartDict()
-        .Key("error_message").Value("not found")
-        .Key("request_id").Value(id)
-    .EndDict()
-    .Build();
+void WriteNotFound(json::Writer& writer, const int id) {
+    writer.StartDict()
+        .Key("error_message").String("not found")
+        .Key("request_id").Int(id)
+    .EndDict();
 }
 
-json::Node ConstructBusLineRequest(
-    const int id,
-    const std::optional<domain::BusLine>& bus_line
-) {
+void WriteBusLine(json::Writer& writer,
+                  const int id,
+                  const std::optional<domain::BusLine>& bus_line) {
     if (!bus_line)
-        return ConstructNotFoundRequest(id);
+        return WriteNotFound(writer, id);
 
-    return json::Builder{}.StartDict()
-            .Key("curvature").Value(bus_line->curvature)
-            .Key("request_id").Value(id)
-            .Key("route_length").Value(bus_line->length)
-            .Key("stop_count").Value(static_cast<int>(bus_line->stops_count))
-            .Key("unique_stop_count").Value(static_cast<int>(bus_line->unique_stop_count))
-        .EndDict()
-        .Build();
+    writer.StartDict()
+        .Key("curvature").Double(bus_line->curvature)
+        .Key("request_id").Int(id)
+        .Key("route_length").Double(bus_line->length)
+        .Key("stop_count").Int(static_cast<int>(bus_line->stops_count))
+        .Key("unique_stop_count").Int(static_cast<int>(bus_line->unique_stop_count))
+    .EndDict();
 }
 
-json::Node ConstructStopRequest(const int id,
-                                const std::optional<domain::StopStat>& stop_stat) {
-    if (!stop_stat)
-        return ConstructNotFoundRequest(id);
+template <typename Buses>
+void WriteBuses(json::Writer& writer, const int id, const Buses& buses) {
+    writer.StartDict().Key("buses").StartArray();
+    for (const domain::BusPtr& bus_ptr : buses)
+        writer.String(bus_ptr->name);
+    writer.EndArray()
+        .Key("request_id").Int(id)
+    .EndDict();
+}
 
-    json::Array buses;
-    buses.reserve(stop_stat->unique_buses.size());
-    for (const domain::BusPtr& bus_ptr : stop_stat->unique_buses)
-        buses.push_back(bus_ptr->name);
+void WriteStop(json::Writer& writer,
+               const int id,
+               const std::optional<domain::StopStat>& stop_stat) {
+    if (!stop_stat)
+        return WriteNotFound(writer, id);
+    WriteBuses(writer, id, stop_stat->unique_buses);
+}
 
-    return json::Builder{}.StartDict()
-        .Key("buses").Value(buses)
-        .Key("request_id").Value(id)
-    .EndDict()
-    .Build();
+void WriteCommonBuses(json::Writer& writer,
+                      const int id,
+                      const std::optional<std::vector<domain::BusPtr>>& buses) {
+    if (!buses)
+        return WriteNotFound(writer, id);
+    WriteBuses(writer, id, *buses);
 }
 
-json::Node ConstructRouteRequest(const int id,
-                                 const std::optional<domain::Route>& route) {
+void WriteRoute(json::Writer& writer,
+                const int id,
+                const std::optional<domain::Route>& route) {
     if (!route)
-        return ConstructNotFoundRequest(id);
-
-    json::Array items;
-    items.reserve(route->edges.size());
-    for (const domain::Edge& edge : route->edges)
-        items.push_back(
-            (edge.bus)
-            ? json::Builder{}.StartDict()
-                    .Key("bus").Value(edge.bus->name)
-                    .Key("span_count").Value(edge.stop_count)
-                    .Key("time").Value(edge.timedelta)
-                    .Key("type").Value("Bus")
-                .EndDict()
-                .Build()
-            : json::Builder{}.StartDict()
-                    .Key("stop_name").Value(edge.from->name)
-                    .Key("time").Value(edge.timedelta)
-                    .Key("type").Value("Wait")
-                .EndDict()
-                .Build()
+        return WriteNotFound(writer, id);
+
+    writer.StartDict().Key("items").StartArray();
+    for (const domain::Edge& edge : route->edges) {
+        writer.StartDict();
+        if (edge.bus)
+            writer
+                .Key("bus").String(edge.bus->name)
+                .Key("span_count").Int(edge.stop_count)
+                .Key("time").Double(edge.timedelta)
+                .Key("type").String("Bus");
+        else
+            writer
+                .Key("stop_name").String(edge.from->name)
+                .Key("time").Double(edge.timedelta)
+                .Key("type").String("Wait");
+        writer.EndDict();
+    }
+    writer.EndArray()
+        .Key("request_id").Int(id)
+        .Key("total_time").Double(route->timedelta)
+    .EndDict();
+}
+
+std::string RenderMap(const RequestHandler& handler) {
+    std::ostringstream out;
+    handler.RenderMap().Render(out);
+    return out.str();
+}
+
+// Collects the stats and renders the layers of the map as tasks of the pool
+std::string RenderMap(const RequestHandler& handler, TaskPool& pool) {
+    using Layer = renderer::MapRenderer::Layer;
+    static const size_t LAYER_COUNT = renderer::MapRenderer::LAYER_COUNT;
+
+    const Catalogue& catalogue = handler.GetCatalogue();
+    domain::SetStat<domain::BusLine> routes;
+    domain::SetStat<domain::StopStat> stop_stats;
+    {
+        TaskGroup group(pool);
+        group.Run([&]() { routes = catalogue.GetAllBusLines(); });
+        group.Run([&]() { stop_stats = catalogue.GetAllStopStats(); });
+        group.Wait();
+    }
+
+    const renderer::MapRenderer& renderer = handler.GetRenderer();
+    const renderer::SphereProjector projector = renderer.MakeProjector(stop_stats);
+    std::vector<std::string> layers(LAYER_COUNT);
+    {
+        TaskGroup group(pool);
+        for (size_t layer = 0; layer < LAYER_COUNT; ++layer)
+            group.Run([&, layer]() {
+                std::ostringstream out;
+                renderer.RenderLayer(static_cast<Layer>(layer), projector, routes, stop_stats)
+                    .RenderObjects(out);
+                layers[layer] = out.str();
+            });
+        group.Wait();
+    }
+
+    std::ostringstream out;
+    svg::Document::RenderHeader(out);
+    for (const std::string& layer : layers)
+        out << layer;
+    svg::Document::RenderFooter(out);
+    return out.str();
+}
+
+void WriteMap(json::Writer& writer, const int id, const std::string& map) {
+    writer.StartDict()
+        .Key("map").String(map)
+        .Key("request_id").Int(id)
+    .EndDict();
+}
+
+void WriteNearest(json::Writer& writer,
+                  const int id,
+                  const std::vector<std::pair<domain::StopPtr, double>>& stops) {
+    writer.StartDict()
+        .Key("request_id").Int(id)
+        .Key("stops").StartArray();
+    for (const auto& [stop_ptr, distance] : stops)
+        writer.StartDict()
+            .Key("distance").Double(distance)
+            .Key("name").String(stop_ptr->name)
+        .EndDict();
+    writer.EndArray().EndDict();
+}
+
+void WriteStopsInBox(json::Writer& writer,
+                     const int id,
+                     const domain::SetPtr<domain::StopPtr>& stops) {
+    writer.StartDict()
+        .Key("request_id").Int(id)
+        .Key("stops").StartArray();
+    for (const domain::StopPtr& stop_ptr : stops)
+        writer.String(stop_ptr->name);
+    writer.EndArray().EndDict();
+}
+
+void WriteSuggest(json::Writer& writer,
+                  const int id,
+                  const std::vector<NameIndex::Match>& matches) {
+    writer.StartDict().Key("items").StartArray();
+    for (const NameIndex::Match& match : matches)
+        writer.StartDict()
+            .Key("name").String(match.name)
+            .Key("type").String(match.kind == NameIndex::Kind::BUS ? "Bus" : "Stop")
+        .EndDict();
+    writer.EndArray()
+        .Key("request_id").Int(id)
+    .EndDict();
+}
+
+// Sizes beyond int fall back to double as the responses have no wider integer
+void WriteSize(json::Writer& writer, const size_t value) {
+    if (value <= static_cast<size_t>(std::numeric_limits<int>::max()))
+        writer.Int(static_cast<int>(value));
+    else
+        writer.Double(static_cast<double>(value));
+}
+
+void WriteMemory(json::Writer& writer,
+                 const int id,
+                 const std::vector<MemoryUsage>& usage) {
+    size_t total_bytes = 0;
+    writer.StartDict()
+        .Key("request_id").Int(id)
+        .Key("structures").StartArray();
+    for (const MemoryUsage& structure : usage) {
+        total_bytes += structure.bytes;
+        writer.StartDict().Key("bytes");
+        WriteSize(writer, structure.bytes);
+        writer.Key("count");
+        WriteSize(writer, structure.count);
+        writer
+            .Key("load_factor").Double(structure.load_factor)
+            .Key("name").String(structure.name)
+        .EndDict();
+    }
+    writer.EndArray().Key("total_bytes");
+    WriteSize(writer, total_bytes);
+    writer.EndDict();
+}
+
+void WriteMetrics(json::Writer& writer, const int id) {
+    static const double MICROSECONDS_PER_NANOSECOND = 1e-3;
+    static const double MILLISECONDS_PER_NANOSECOND = 1e-6;
+
+    const metrics::Registry& registry = metrics::GetRegistry();
+    writer.StartDict().Key("phases").StartArray();
+    for (size_t phase = 0; phase < metrics::PHASE_COUNT; ++phase) {
+        const metrics::PhaseStat& stat = registry.GetPhase(static_cast<metrics::Phase>(phase));
+        const uint64_t count = stat.count.load(std::memory_order_relaxed);
+        if (count == 0)
+            continue;
+
+        writer.StartDict().Key("count");
+        WriteSize(writer, count);
+        writer
+            .Key("name").String(metrics::GetPhaseName(static_cast<metrics::Phase>(phase)))
+            .Key("total_ms").Double(stat.nanoseconds.load(std::memory_order_relaxed)
+                                    *MILLISECONDS_PER_NANOSECOND)
+        .EndDict();
+    }
+    writer.EndArray()
+        .Key("request_id").Int(id)
+        .Key("requests").StartArray();
+    for (size_t type = 0; type < std::variant_size_v<StatRequest::Query>; ++type) {
+        const metrics::Histogram& latency = registry.GetLatency(type);
+        const uint64_t count = latency.GetCount();
+        const uint64_t reused_count = registry.GetReusedCount(type);
+        if (count == 0 && reused_count == 0)
+            continue;
+
+        const auto write_us = [&writer](const uint64_t nanoseconds) {
+            writer.Double(nanoseconds*MICROSECONDS_PER_NANOSECOND);
+        };
+        writer.StartDict().Key("count");
+        WriteSize(writer, count);
+        writer.Key("max_us");
+        write_us(latency.GetMax());
+        writer.Key("mean_us");
+        write_us(count ? latency.GetTotal()/count : 0);
+        writer.Key("p50_us");
+        write_us(latency.GetQuantile(0.5));
+        writer.Key("p90_us");
+        write_us(latency.GetQuantile(0.9));
+        writer.Key("p99_us");
+        write_us(latency.GetQuantile(0.99));
+        writer.Key("reused");
+        WriteSize(writer, reused_count);
+        writer
+            .Key("type").String(GetTypeName(type))
+        .EndDict();
+    }
+    writer.EndArray().EndDict();
+}
+
+// Rough time to answer a request, a unit is about a Bus lookup. A map takes
+// time by the objects drawn
+size_t EstimateCost(const RequestHandler& handler, const StatRequest& request) {
+    static const size_t MAP_COST_PER_OBJECT = 10;
+
+    const StatRequest::Query& query = request.query;
+    if (std::holds_alternative<StatRequest::Map>(query)) {
+        const Catalogue& catalogue = handler.GetCatalogue();
+        return MAP_COST_PER_OBJECT*(catalogue.GetStopCount() + catalogue.GetBusCount());
+    }
+    if (const auto* common_buses = std::get_if<StatRequest::CommonBuses>(&query))
+        return 1 + common_buses->stops.size();
+    if (std::holds_alternative<StatRequest::Route>(query))
+        return 2;
+    if (std::holds_alternative<StatRequest::Nearest>(query)
+     || std::holds_alternative<StatRequest::StopsInBox>(query))
+        return 4;
+    if (std::holds_alternative<StatRequest::Memory>(query)
+     || std::holds_alternative<StatRequest::Metrics>(query))
+        return 8;
+    return 1;
+}
+
+// Bounds of consecutive requests of about the same cost, a request costlier
+// than a chunk goes alone. Repeated queries cost nothing as they are not
+// answered again
+std::vector<size_t> SplitByCost(const RequestHandler& handler,
+                                const std::vector<StatRequest>& requests,
+                                const std::vector<size_t>& origins) {
+    static const size_t CHUNK_COST = 512;
+
+    std::vector<size_t> bounds{0};
+    size_t cost = 0;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const size_t request_cost = (origins[i] == i) ? EstimateCost(handler, requests[i]) : 0;
+        if (cost > 0 && cost + request_cost > CHUNK_COST) {
+            bounds.push_back(i);
+            cost = 0;
+        }
+        cost += request_cost;
+    }
+    if (bounds.back() != requests.size())
+        bounds.push_back(requests.size());
+    return bounds;
+}
+
+// Response to a query asked several times, split around the id value
+struct SharedResponse {
+    std::string prefix;
+    std::string suffix;
+    size_t use_count; // requests left to take it
+};
+
+SharedResponse SplitAtId(const std::string_view response, const size_t use_count) {
+    static const std::string_view ID_KEY = "\"request_id\":";
+
+    // Keys inside strings have their quotes escaped, so the only match is
+    // the response's own
+    const size_t key = response.find(ID_KEY);
+    if (key == std::string_view::npos)
+        throw std::logic_error("response has no request_id");
+    const size_t first = response.find_first_not_of(' ', key + ID_KEY.size());
+    const size_t last = response.find_first_not_of("-0123456789", first);
+    return {
+        std::string(response.substr(0, first)),
+        std::string(response.substr(last)),
+        use_count
+    };
+}
+
+// Writes the response and records its latency by the request type. A map is
+// rendered in parts when there is a pool
+void Answer(const RequestHandler& handler,
+            const JsonReader& reader,
+            const StatRequest& request,
+            json::Writer& writer,
+            TaskPool* pool) {
+    const metrics::Clock::time_point start = metrics::Clock::now();
+    const int id = request.id;
+    const StatRequest::Query& query = request.query;
+
+    if (std::holds_alternative<StatRequest::Map>(query)) {
+        if (pool)
+            WriteMap(writer, id, RenderMap(handler, *pool));
+        else
+            WriteMap(writer, id, RenderMap(handler));
+    } else if (const auto* bus = std::get_if<StatRequest::Bus>(&query)) {
+        WriteBusLine(writer, id, handler.GetBusStat(bus->name));
+    } else if (const auto* stop = std::get_if<StatRequest::Stop>(&query)) {
+        WriteStop(writer, id, handler.GetStopStat(stop->name));
+    } else if (const auto* common_buses = std::get_if<StatRequest::CommonBuses>(&query)) {
+        WriteCommonBuses(
+            writer,
+            id,
+            handler.GetCommonBuses({common_buses->stops.begin(), common_buses->stops.end()})
         );
+    } else if (const auto* route = std::get_if<StatRequest::Route>(&query)) {
+        WriteRoute(writer, id, handler.GetRoute(route->from, route->to));
+    } else if (const auto* nearest = std::get_if<StatRequest::Nearest>(&query)) {
+        WriteNearest(writer, id, handler.GetNearestStops(nearest->coords, nearest->count));
+    } else if (const auto* box = std::get_if<StatRequest::StopsInBox>(&query)) {
+        WriteStopsInBox(writer, id, handler.GetStopsInBox(box->min, box->max));
+    } else if (const auto* suggest = std::get_if<StatRequest::Suggest>(&query)) {
+        WriteSuggest(writer, id, handler.Suggest(suggest->query, suggest->count));
+    } else if (std::holds_alternative<StatRequest::Memory>(query)) {
+        WriteMemory(writer, id, GetMemoryUsage(handler, reader));
+    } else if (std::holds_alternative<StatRequest::Metrics>(query)) {
+        WriteMetrics(writer, id);
+    }
 
-    return json::Builder{}.StartDict()
-        .Key("items").Value(items)
-        .Key("request_id").Value(id)
-        .Key("total_time").Value(route->timedelta)
-    .EndDict()
-    .Build();
+    metrics::GetRegistry().GetLatency(query.index())
+        .Record(metrics::GetNanoseconds(metrics::Clock::now() - start));
 }
 
 } // namespace
 
-json::Document Search(const RequestHandler& handler, const JsonReader& reader) {
-    std::vector<json::Node> nodes;
-    nodes.reserve(reader.GetStats().size());
-    for (const auto& request : reader.GetStats()) {
-        const std::string& type_value = request->at("type").AsString();
-        const int& id = request->at("id").AsInt();
-
-        if (type_value == "Map") {
-            std::ostringstream out;
-            handler.RenderMap().Render(out);
-            nodes.push_back(json::Builder{}.StartDict()
-                    .Key("map").Value(out.str())
-                    .Key("request_id").Value(id)
-                .EndDict()
-                .Build()
-            );
-        } else if (type_value == "Bus") {
-            nodes.push_back(ConstructBusLineRequest(
-                id,
-                handler.GetBusStat(request->at("name").AsString())
-            ));
-        } else if (type_value == "Stop") {
-            nodes.push_back(ConstructStopRequest(
-                id,
-                handler.GetStopStat(request->at("name").AsString())
-            ));
-        } else if (type_value == "Route") {
-            nodes.push_back(ConstructRouteRequest(
-                id,
-                handler.GetRoute(request->at("from").AsString(),
-                                 request->at("to").AsString())
-            ));
-        } else {
-            ThrowInvalidRequest(std::to_string(id), type_value);
+std::vector<MemoryUsage> GetMemoryUsage(const RequestHandler& handler,
+                                        const JsonReader& reader) {
+    std::vector<MemoryUsage> usage = handler.GetMemoryUsage();
+    for (MemoryUsage& reader_usage : reader.GetMemoryUsage())
+        usage.push_back(std::move(reader_usage));
+    return usage;
+}
+
+void WriteResponse(const RequestHandler& handler,
+                   const JsonReader& reader,
+                   const StatRequest& request,
+                   json::Writer& writer) {
+    Answer(handler, reader, request, writer, nullptr);
+}
+
+void Search(const RequestHandler& handler,
+            const JsonReader& reader,
+            json::Writer& writer,
+            const size_t thread_count) {
+    const std::vector<StatRequest>& requests = reader.GetStats();
+
+    // First request with the same query and the number of requests sharing
+    // it by the first one
+    std::vector<size_t> origins(requests.size());
+    std::vector<size_t> use_counts(requests.size(), 0);
+    {
+        std::unordered_map<std::string, size_t> first_requests;
+        first_requests.reserve(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i) {
+            origins[i] = first_requests.emplace(GetQueryKey(requests[i]), i).first->second;
+            ++use_counts[origins[i]];
         }
     }
+    const std::vector<size_t> bounds = SplitByCost(handler, requests, origins);
+
+    // Each chunk is formatted one level deep into its own text, the ends of
+    // the responses split it back for the writer. A repeated query is left
+    // empty there and is filled in from the first response to it
+    struct Responses {
+        size_t first;
+        std::string text;
+        std::vector<size_t> ends;
+    };
+    const auto produce = [&](const size_t chunk, TaskPool* pool) {
+        std::ostringstream out;
+        Responses responses{bounds[chunk], {}, {}};
+        responses.ends.reserve(bounds[chunk + 1] - bounds[chunk]);
+        {
+            json::Writer chunk_writer(out, writer.GetSettings(), 1);
+            for (size_t i = bounds[chunk]; i < bounds[chunk + 1]; ++i) {
+                const StatRequest& request = requests[i];
+                if (origins[i] == i)
+                    Answer(handler, reader, request, chunk_writer, pool);
+                chunk_writer.Flush();
+                responses.ends.push_back(static_cast<size_t>(out.tellp()));
+            }
+        }
+        responses.text = out.str();
+        return responses;
+    };
+
+    std::unordered_map<size_t, SharedResponse> shared;
+    std::string spliced;
+    const auto consume = [&](const Responses& responses) {
+        const std::string_view text = responses.text;
+        size_t begin = 0;
+        for (size_t i = responses.first; i < responses.first + responses.ends.size(); ++i) {
+            const size_t end = responses.ends[i - responses.first];
+            const std::string_view response = text.substr(begin, end - begin);
+            begin = end;
+
+            if (origins[i] == i) {
+                writer.Raw(response);
+                if (use_counts[i] > 1)
+                    shared.emplace(i, SplitAtId(response, use_counts[i] - 1));
+                continue;
+            }
+
+            metrics::GetRegistry().AddReused(requests[i].query.index());
+            const auto it = shared.find(origins[i]);
+            char id[16];
+            const char* id_end = std::to_chars(id, std::end(id), requests[i].id).ptr;
+            spliced.assign(it->second.prefix)
+                .append(id, id_end - id)
+                .append(it->second.suffix);
+            writer.Raw(spliced);
+            if (--it->second.use_count == 0)
+                shared.erase(it);
+        }
+    };
 
-    return json::Document(json::Builder{}.Value(nodes).Build());
+    writer.StartArray();
+    if (thread_count <= 1) {
+        for (size_t chunk = 0; chunk + 1 < bounds.size(); ++chunk)
+            consume(produce(chunk, nullptr));
+    } else {
+        TaskPool pool(thread_count);
+        RunInOrder(
+            pool, bounds.size() - 1,
+            [&produce, &pool](const size_t chunk) { return produce(chunk, &pool); },
+            consume
+        );
+    }
+    writer.EndArray();
 }
 
 } // namespace io
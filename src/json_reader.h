@@ -1,70 +1,174 @@
 #pragma once
 #include <json/json_builder.h>
+#include <json/json_writer.h>
 
+#include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
-#include <memory>
 #include <optional>
 #include <set>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 
 #include "catalogue.h"
 #include "map_renderer.h"
+#include "memory.h"
 #include "request_handler.h"
 
 namespace transport {
 namespace io {
 
-class JsonReader {
-    using Request = std::unique_ptr<const json::Dict>;
+// ---------- StatRequest -------------
+
+struct StatRequest {
+    struct Bus {
+        std::string name;
+    };
+
+    struct CommonBuses {
+        std::vector<std::string> stops;
+    };
+
+    struct Map {};
+
+    struct Memory {};
+
+    struct Metrics {};
+
+    struct Nearest {
+        geo::Coordinates coords;
+        size_t count = 1;
+    };
+
+    struct Route {
+        std::string from;
+        std::string to;
+    };
+
+    struct Stop {
+        std::string name;
+    };
+
+    struct StopsInBox {
+        geo::Coordinates min;
+        geo::Coordinates max;
+    };
+
+    struct Suggest {
+        std::string query;
+        size_t count = 5;
+    };
+
+    using Query = std::variant<Bus, CommonBuses, Map, Memory, Metrics, Nearest,
+                               Route, Stop, StopsInBox, Suggest>;
+
+    int id;
+    Query query;
+};
+
+// Type name of the request as it is written in JSON
+std::string_view GetTypeName(const StatRequest& request);
+
+// Type name by the index of the alternative in StatRequest::Query
+std::string_view GetTypeName(const size_t type_index);
+
+json::Node ConvertToNode(const StatRequest& request);
+
+// Identifies the query regardless of the id, requests with equal keys get
+// the same response. Metrics requests are all told apart as they report the
+// moment they are answered
+std::string GetQueryKey(const StatRequest& request);
+
+// ---------- JsonReader --------------
 
-    enum class BaseType { BUS, STOP, ROUTE, };
+class JsonReader {
+    // Views into the sections kept by the reader, never owned
+    using Request = const json::Dict*;
 
     struct Settings {
-        Request render;
-        Request routing;
-        Request serialization;
+        Request render = nullptr;
+        Request routing = nullptr;
+        Request serialization = nullptr;
+        Request output = nullptr;
     };
 
 public:
-    JsonReader(std::istream& input)
-            : requests_(json::Load(input).GetRoot().AsDict()) {
-        // Requests
-        if (requests_.find("base_requests") != requests_.end()) {
-            ParseBases(BaseType::BUS);
-            ParseBases(BaseType::STOP);
-        }
-        if (requests_.find("stat_requests") != requests_.end())
-            ParseStats();
-
-        // Settings
-        if (requests_.find("render_settings") != requests_.end())
-            ParseSettings("render_settings");
-        if (requests_.find("routing_settings") != requests_.end())
-            ParseSettings("routing_settings");
-        if (requests_.find("serialization_settings") != requests_.end())
-            ParseSettings("serialization_settings");
-    }
+    // Base requests keep stop names as references, each one resolves to an
+    // index in GetStops() once the whole document is read
+    using StopRef = uint32_t;
+
+    struct BusRecord {
+        std::string name;
+        std::vector<StopRef> stops;
+        bool is_roundtrip;
+    };
+
+    struct DistanceRecord {
+        StopRef from;
+        StopRef to;
+        int metres;
+    };
+
+    // Receives serialization_settings before the reader is complete
+    using SettingsCallback = std::function<void(const json::Dict& serialization_settings)>;
+
+    // Streams the document: base and stat requests are converted as they are
+    // scanned, only the other sections are kept as nodes. The callback gets
+    // serialization_settings ahead of the parsing when they can be located
+    // in the text, and once the document is read otherwise
+    explicit JsonReader(std::istream& input, SettingsCallback on_serialization = {});
+
+    explicit JsonReader(const json::Dict& requests);
+
+    // Requests point into the reader's own sections
+    JsonReader(const JsonReader&) = delete;
+    JsonReader& operator=(const JsonReader&) = delete;
+
+    // Throws for an unknown type or a missing field
+    static StatRequest ParseStat(const json::Dict& request);
+
+    static bool IsDelta(const json::Dict& request);
 
     renderer::Settings GenerateMapSettings() const;
 
-    inline const std::vector<Request>& GetBuses() const {
+    // Response formatting from output_settings: significant digits of doubles,
+    // 0 for the shortest exact ones, digits after the point by field name and
+    // whether to indent or to print on one line
+    json::PrintSettings GeneratePrintSettings() const;
+
+    // Stops in the order of declaration without wait time
+    inline const std::vector<domain::Stop>& GetStops() const {
+        return stops_;
+    }
+
+    inline const std::vector<BusRecord>& GetBuses() const {
         return buses_;
     }
 
-    inline const std::vector<Request>& GetStops() const {
-        return stops_;
+    inline const std::vector<DistanceRecord>& GetDistances() const {
+        return distances_;
     }
 
-    inline const std::vector<Request>& GetStats() const {
+    // Throws for a name that is referred to but never declared
+    size_t ResolveStop(const StopRef ref) const;
+
+    inline const std::vector<StatRequest>& GetStats() const {
         return stats_;
     }
 
-    inline const Request& GetRoutingSettings() const {
+    inline const std::vector<Request>& GetDeltas() const {
+        return deltas_;
+    }
+
+    inline Request GetRoutingSettings() const {
         return settings_.routing;
     }
 
-    inline const Request& GetSerializationSettings() const {
+    inline Request GetSerializationSettings() const {
         return settings_.serialization;
     }
 
@@ -72,29 +176,80 @@ public:
         return settings_.serialization->at("file").AsString();
     }
 
+    // Number of regional databases, a single one unless set
+    inline size_t GetShardCount() const {
+        const auto it = settings_.serialization->find("shard_count");
+        return (it != settings_.serialization->end()) ? it->second.AsInt() : 1;
+    }
+
+    inline size_t GetShardIndex() const {
+        return settings_.serialization->at("shard_index").AsInt();
+    }
+
+    // Converted requests and the sections kept as nodes
+    std::vector<MemoryUsage> GetMemoryUsage() const;
+
 private:
-    const std::set<std::string> type_names_{"Bus", "Map", "Route", "Stop"};
-    json::Dict requests_;
-    std::vector<Request> buses_;
-    std::vector<Request> stops_;
-    std::vector<Request> routes_;
-    std::vector<Request> stats_;
+    class Ingest;
+
+    static constexpr size_t NO_STOP = static_cast<size_t>(-1);
+
+    json::Dict requests_; // sections other than base and stat requests
+    std::vector<domain::Stop> stops_;
+    std::vector<BusRecord> buses_;
+    std::vector<DistanceRecord> distances_;
+    std::deque<std::string> ref_names_; // by reference, never reallocated
+    std::unordered_map<std::string_view, StopRef> stop_refs_;
+    std::vector<size_t> ref_stops_; // index in stops_ by reference
+    std::vector<StatRequest> stats_;
+    std::vector<Request> deltas_;
     Settings settings_;
 
     static svg::Color ConvertToColor(const json::Node node);
 
-    static std::string ConvertRequestType(const BaseType type);
+    StopRef GetStopRef(const std::string_view stop_name);
+
+    void AddStop(std::string name,
+                 const geo::Coordinates coords,
+                 const std::vector<std::pair<StopRef, int>>& distances);
+
+    void AddBus(std::string name,
+                std::vector<StopRef> stops,
+                const bool is_roundtrip);
 
-    void ParseBases(const BaseType type);
+    void ParseBases(const json::Array& base_requests);
 
-    void ParseSettings(const std::string& setting_key);
+    void ParseSections();
 
-    void ParseStats();
+    void ParseDeltas(const json::Array& delta_requests);
 };
 
 void Populate(Catalogue& db, const JsonReader& reader);
 
-json::Document Search(const RequestHandler& handler, const JsonReader& reader);
+// Looks up the stops of a delta request, throws for an unknown one
+Catalogue::Delta::Change ParseDelta(const Catalogue& db, const json::Dict& request);
+
+// Applies delta requests in the given order, none of them if any one fails
+void Update(Catalogue& db, const JsonReader& reader);
+
+// Footprint of the catalogue, the router and the loaded requests
+std::vector<MemoryUsage> GetMemoryUsage(const RequestHandler& handler,
+                                        const JsonReader& reader);
+
+// Writes the response to a single request
+void WriteResponse(const RequestHandler& handler,
+                   const JsonReader& reader,
+                   const StatRequest& request,
+                   json::Writer& writer);
+
+// Writes the responses as an array, each one as soon as it is answered. A
+// query asked again is answered once and its response reused with the new
+// id. With several threads chunks of requests are answered concurrently and
+// written in the order of the requests
+void Search(const RequestHandler& handler,
+            const JsonReader& reader,
+            json::Writer& writer,
+            const size_t thread_count = 1);
 
 } // namespace io
 } // namespace transport
\ No newline at end of file
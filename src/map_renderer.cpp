@@ -9,18 +9,32 @@ svg::Document MapRenderer::RenderMap(
 ) const {
     svg::Document document;
 
+    const SphereProjector projector = MakeProjector(stop_stats);
+    for (size_t layer = 0; layer < LAYER_COUNT; ++layer)
+        DrawLayer(document, static_cast<Layer>(layer), projector, routes, stop_stats);
+
+    return document;
+}
+
+SphereProjector MapRenderer::MakeProjector(
+    const domain::SetStat<domain::StopStat>& stop_stats
+) const {
     const std::vector<geo::Coordinates> coordinates = GetCoordinates(stop_stats);
-    SphereProjector projector(
+    return {
         coordinates.begin(), coordinates.end(),
         settings_.map_sizes.first, settings_.map_sizes.second,
         settings_.padding
-    );
-
-    DrawBusLineLines(document, projector, routes);
-    DrawBusLineLabels(document, projector, routes);
-    DrawStops(document, projector, stop_stats);
-    DrawStopLabels(document, projector, stop_stats);
+    };
+}
 
+svg::Document MapRenderer::RenderLayer(
+    const Layer layer,
+    const SphereProjector& projector,
+    const domain::SetStat<domain::BusLine>& routes,
+    const domain::SetStat<domain::StopStat>& stop_stats
+) const {
+    svg::Document document;
+    DrawLayer(document, layer, projector, routes, stop_stats);
     return document;
 }
 
@@ -35,6 +49,25 @@ std::vector<geo::Coordinates> MapRenderer::GetCoordinates(
     return coordinates;
 }
 
+void MapRenderer::DrawLayer(
+    svg::Document& document,
+    const Layer layer,
+    const SphereProjector& projector,
+    const domain::SetStat<domain::BusLine>& routes,
+    const domain::SetStat<domain::StopStat>& stop_stats
+) const {
+    switch (layer) {
+        case Layer::BUS_LINES:
+            return DrawBusLineLines(document, projector, routes);
+        case Layer::BUS_LABELS:
+            return DrawBusLineLabels(document, projector, routes);
+        case Layer::STOPS:
+            return DrawStops(document, projector, stop_stats);
+        case Layer::STOP_LABELS:
+            return DrawStopLabels(document, projector, stop_stats);
+    }
+}
+
 void MapRenderer::DrawBusLineLines(
     svg::Document& document,
     const SphereProjector& projector,
@@ -92,6 +92,10 @@ struct Settings {
 
 class MapRenderer {
 public:
+    // Layers of the map from the bottom one, each can be rendered apart
+    enum class Layer { BUS_LINES, BUS_LABELS, STOPS, STOP_LABELS };
+    static constexpr size_t LAYER_COUNT = 4;
+
     MapRenderer(Settings settings) : settings_(std::move(settings)) {}
 
     inline void SetSettings(Settings settings) {
@@ -107,6 +111,19 @@ public:
         const domain::SetStat<domain::StopStat>& stop_stats
     ) const;
 
+    // Fits the stops served by buses into the map
+    SphereProjector MakeProjector(
+        const domain::SetStat<domain::StopStat>& stop_stats
+    ) const;
+
+    // The objects of RenderMap() on the layer
+    svg::Document RenderLayer(
+        const Layer layer,
+        const SphereProjector& projector,
+        const domain::SetStat<domain::BusLine>& routes,
+        const domain::SetStat<domain::StopStat>& stop_stats
+    ) const;
+
 private:
     Settings settings_;
 
@@ -118,6 +135,12 @@ private:
         const domain::SetStat<domain::StopStat>& stops
     ) const;
 
+    void DrawLayer(svg::Document& document,
+                   const Layer layer,
+                   const SphereProjector& projector,
+                   const domain::SetStat<domain::BusLine>& routes,
+                   const domain::SetStat<domain::StopStat>& stop_stats) const;
+
     void DrawBusLineLines(svg::Document& document,
                         const SphereProjector& projector,
                         const domain::SetStat<domain::BusLine>& routes) const;
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+// ---------- MemoryUsage -------------
+
+struct MemoryUsage {
+    std::string name;
+    size_t bytes = 0; // heap bytes
+    size_t count = 0; // elements
+    double load_factor = 0; // hash tables only
+};
+
+// Heap footprints of the standard containers estimated from the node layouts
+// shared by libstdc++ and libc++, the elements' own heap is not followed
+namespace memory {
+
+// Control block of std::make_shared: a vtable pointer and two counters
+static constexpr size_t SHARED_OVERHEAD = 2*sizeof(void*);
+
+// Red-black tree node: colour, parent, left and right
+static constexpr size_t TREE_NODE_OVERHEAD = 4*sizeof(void*);
+
+// Hash table node: next pointer and the cached hash
+static constexpr size_t HASH_NODE_OVERHEAD = sizeof(void*) + sizeof(size_t);
+
+inline size_t GetByteSize(const std::string& text) {
+    static const size_t sso_capacity = std::string().capacity();
+    return text.capacity() > sso_capacity ? text.capacity() + 1 : 0;
+}
+
+template <typename T, typename Allocator>
+size_t GetByteSize(const std::vector<T, Allocator>& values) {
+    return values.capacity()*sizeof(T);
+}
+
+template <typename Key, typename Compare, typename Allocator>
+size_t GetByteSize(const std::set<Key, Compare, Allocator>& values) {
+    return values.size()*(TREE_NODE_OVERHEAD + sizeof(Key));
+}
+
+template <typename Key, typename Value, typename Compare, typename Allocator>
+size_t GetByteSize(const std::map<Key, Value, Compare, Allocator>& values) {
+    return values.size()
+           *(TREE_NODE_OVERHEAD + sizeof(typename std::map<Key, Value>::value_type));
+}
+
+template <typename Key, typename Value, typename... Args>
+size_t GetByteSize(const std::unordered_map<Key, Value, Args...>& values) {
+    return values.bucket_count()*sizeof(void*)
+           + values.size()*(HASH_NODE_OVERHEAD
+                            + sizeof(typename std::unordered_map<Key, Value>::value_type));
+}
+
+template <typename Key, typename Value, typename... Args>
+MemoryUsage Describe(std::string name,
+                     const std::unordered_map<Key, Value, Args...>& values) {
+    return {std::move(name), GetByteSize(values), values.size(), values.load_factor()};
+}
+
+} // namespace memory
+
+// ---------- CopyOnWrite -------------
+
+// Value shared by the copies of its owner until one of them writes to it.
+// Only the owner being changed may write, the others may be read meanwhile
+template <typename T>
+class CopyOnWrite {
+public:
+    CopyOnWrite()
+        : value_(std::make_shared<T>()) {
+    }
+
+    inline const T& operator*() const {
+        return *value_;
+    }
+
+    inline const T* operator->() const {
+        return value_.get();
+    }
+
+    // Copies the value first if another owner still refers to it
+    T& Write() {
+        if (value_.use_count() > 1)
+            value_ = std::make_shared<T>(*value_);
+        else
+            // Pairs with the release of the last other owner's reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+        return *value_;
+    }
+
+private:
+    std::shared_ptr<T> value_;
+};
+
+} // namespace transport
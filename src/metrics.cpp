@@ -0,0 +1,117 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace transport {
+namespace metrics {
+
+// ---------- Histogram ---------------
+
+void Histogram::Record(const uint64_t nanoseconds) {
+    Shard& shard = shards_[GetShardIndex()];
+    shard.buckets[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    shard.count.fetch_add(1, std::memory_order_relaxed);
+    shard.total.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    uint64_t max = shard.max.load(std::memory_order_relaxed);
+    while (nanoseconds > max
+        && !shard.max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t Histogram::GetCount() const {
+    uint64_t count = 0;
+    for (const Shard& shard : shards_)
+        count += shard.count.load(std::memory_order_relaxed);
+    return count;
+}
+
+uint64_t Histogram::GetTotal() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_)
+        total += shard.total.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t Histogram::GetMax() const {
+    uint64_t max = 0;
+    for (const Shard& shard : shards_)
+        max = std::max(max, shard.max.load(std::memory_order_relaxed));
+    return max;
+}
+
+uint64_t Histogram::GetQuantile(const double quantile) const {
+    const uint64_t count = GetCount();
+    if (count == 0)
+        return 0;
+
+    // Rank of the value, counted from one
+    const uint64_t rank = std::max<uint64_t>(
+        1u,
+        static_cast<uint64_t>(std::ceil(quantile*static_cast<double>(count)))
+    );
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+        for (const Shard& shard : shards_)
+            seen += shard.buckets[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(GetUpperBound(bucket), GetMax());
+    }
+    return GetMax();
+}
+
+size_t Histogram::GetShardIndex() {
+    // Threads take the shards in turn as they record for the first time
+    static std::atomic<size_t> next_index{0};
+    thread_local const size_t index =
+        next_index.fetch_add(1, std::memory_order_relaxed)%SHARD_COUNT;
+    return index;
+}
+
+size_t Histogram::GetBucket(const uint64_t value) {
+    if (value < SUB_BUCKET_COUNT)
+        return static_cast<size_t>(value);
+
+    // The leading bit picks the power of two, the bits after it the sub-bucket
+    size_t exponent = SUB_BUCKET_BITS;
+    while (exponent < 63 && (value >> (exponent + 1)))
+        ++exponent;
+    const size_t shift = exponent - SUB_BUCKET_BITS;
+    return (exponent - SUB_BUCKET_BITS + 1)*SUB_BUCKET_COUNT
+         + static_cast<size_t>((value >> shift) & (SUB_BUCKET_COUNT - 1));
+}
+
+uint64_t Histogram::GetUpperBound(const size_t bucket) {
+    if (bucket < SUB_BUCKET_COUNT)
+        return bucket;
+
+    const size_t shift = bucket/SUB_BUCKET_COUNT - 1;
+    const uint64_t first = (SUB_BUCKET_COUNT + bucket%SUB_BUCKET_COUNT) << shift;
+    return first + ((uint64_t{1} << shift) - 1);
+}
+
+// ---------- Registry ----------------
+
+std::string_view GetPhaseName(const Phase phase) {
+    // In the order of Phase
+    static constexpr std::string_view names[] = {
+        "parse", "populate", "graph_build", "route_precompute", "serialize",
+        "deserialize"
+    };
+    return names[static_cast<size_t>(phase)];
+}
+
+void Registry::AddPhase(const Phase phase, const uint64_t nanoseconds) {
+    PhaseStat& stat = phases_[static_cast<size_t>(phase)];
+    stat.count.fetch_add(1, std::memory_order_relaxed);
+    stat.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+} // namespace metrics
+} // namespace transport
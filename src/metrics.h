@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace transport {
+namespace metrics {
+
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t GetNanoseconds(const Clock::duration duration) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()
+    );
+}
+
+// ---------- Histogram ---------------
+
+// Latencies in nanoseconds by logarithmic buckets: each power of two is split
+// into SUB_BUCKET_COUNT linear ones, so a value is known to within 1/16 of
+// itself. Recording takes a few relaxed atomic additions and no lock, on
+// counters of the recording thread's own shard that the reads sum up
+class Histogram {
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t{1} << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1)*SUB_BUCKET_COUNT;
+    static constexpr size_t SHARD_COUNT = 8;
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    void Record(const uint64_t nanoseconds);
+
+    uint64_t GetCount() const;
+
+    uint64_t GetTotal() const;
+
+    uint64_t GetMax() const;
+
+    // Upper bound of the bucket holding the quantile, zero while empty
+    uint64_t GetQuantile(const double quantile) const;
+
+private:
+    // Threads are spread over the shards, each one starting a cache line
+    // so that threads of different shards never write to the same line
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> max{0};
+        std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards_;
+
+    static size_t GetShardIndex();
+
+    static size_t GetBucket(const uint64_t value);
+
+    static uint64_t GetUpperBound(const size_t bucket);
+};
+
+// ---------- Registry ----------------
+
+// Startup and update phases, timed wherever they run
+enum class Phase {
+    PARSE,
+    POPULATE,
+    GRAPH_BUILD,
+    ROUTE_PRECOMPUTE,
+    SERIALIZE,
+    DESERIALIZE,
+};
+static constexpr size_t PHASE_COUNT = 6;
+
+std::string_view GetPhaseName(const Phase phase);
+
+struct PhaseStat {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> nanoseconds{0};
+};
+
+// Process-wide counters. Requests are kept by the index of their type in
+// StatRequest::Query, each computed one in the histogram and each one
+// answered with the response of an equal query in the reuse counter
+class Registry {
+public:
+    static constexpr size_t MAX_REQUEST_TYPES = 16;
+
+    inline Histogram& GetLatency(const size_t request_type) {
+        return latencies_[request_type];
+    }
+
+    inline const Histogram& GetLatency(const size_t request_type) const {
+        return latencies_[request_type];
+    }
+
+    inline void AddReused(const size_t request_type) {
+        reused_counts_[request_type].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline uint64_t GetReusedCount(const size_t request_type) const {
+        return reused_counts_[request_type].load(std::memory_order_relaxed);
+    }
+
+    void AddPhase(const Phase phase, const uint64_t nanoseconds);
+
+    inline const PhaseStat& GetPhase(const Phase phase) const {
+        return phases_[static_cast<size_t>(phase)];
+    }
+
+private:
+    std::array<Histogram, MAX_REQUEST_TYPES> latencies_;
+    std::array<std::atomic<uint64_t>, MAX_REQUEST_TYPES> reused_counts_{};
+    std::array<PhaseStat, PHASE_COUNT> phases_;
+};
+
+Registry& GetRegistry();
+
+// Adds the time from its construction to its destruction to the phase
+class PhaseTimer {
+public:
+    explicit PhaseTimer(const Phase phase)
+        : phase_(phase)
+        , start_(Clock::now()) {
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        GetRegistry().AddPhase(phase_, GetNanoseconds(Clock::now() - start_));
+    }
+
+private:
+    Phase phase_;
+    Clock::time_point start_;
+};
+
+} // namespace metrics
+} // namespace transport
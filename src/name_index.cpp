@@ -0,0 +1,191 @@
+#include "name_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+
+#include "memory.h"
+
+namespace transport {
+
+// ---------- NameIndex ---------------
+
+std::string NameIndex::ToLower(std::string_view text) {
+    std::string lower(text);
+    for (char& c : lower)
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return lower;
+}
+
+std::vector<NameIndex::Trigram> NameIndex::GetTrigrams(std::string_view key) {
+    // Padding lets words' beginnings and ends weigh more
+    const std::string padded = "  " + std::string(key) + ' ';
+
+    std::vector<Trigram> trigrams;
+    trigrams.reserve(padded.size() - 2);
+    for (size_t i = 0; i + 2 < padded.size(); ++i)
+        trigrams.push_back(
+            static_cast<Trigram>(static_cast<unsigned char>(padded[i])) << 16
+            | static_cast<Trigram>(static_cast<unsigned char>(padded[i + 1])) << 8
+            | static_cast<Trigram>(static_cast<unsigned char>(padded[i + 2]))
+        );
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+uint32_t NameIndex::Emplace(std::string_view name, const Kind kind) {
+    const uint32_t id = static_cast<uint32_t>(entries_.size());
+    const size_t key_offset = keys_.size();
+    keys_ += ToLower(name);
+    entries_.push_back({
+        static_cast<uint32_t>(key_offset),
+        static_cast<uint32_t>(name.size()),
+        {name, kind},
+        0
+    });
+
+    const std::vector<Trigram> trigrams = GetTrigrams(GetKey(id));
+    for (const Trigram trigram : trigrams)
+        trigram_to_entries_[trigram].push_back(id);
+    entries_.back().trigram_count = static_cast<uint32_t>(trigrams.size());
+    return id;
+}
+
+bool NameIndex::IsLess(const uint32_t lhs, const uint32_t rhs) const {
+    return GetKey(lhs) < GetKey(rhs);
+}
+
+void NameIndex::Add(std::string_view name, const Kind kind) {
+    const uint32_t id = Emplace(name, kind);
+    order_.insert(
+        std::upper_bound(
+            order_.begin(), order_.end(), id,
+            [this](const uint32_t lhs, const uint32_t rhs) { return IsLess(lhs, rhs); }
+        ),
+        id
+    );
+}
+
+void NameIndex::Add(const std::vector<Match>& matches) {
+    entries_.reserve(entries_.size() + matches.size());
+    order_.reserve(order_.size() + matches.size());
+    for (const Match& match : matches)
+        order_.push_back(Emplace(match.name, match.kind));
+
+    std::stable_sort(
+        order_.begin(), order_.end(),
+        [this](const uint32_t lhs, const uint32_t rhs) { return IsLess(lhs, rhs); }
+    );
+}
+
+size_t NameIndex::GetByteSize() const {
+    size_t size = memory::GetByteSize(entries_)
+                + memory::GetByteSize(keys_)
+                + memory::GetByteSize(order_)
+                + memory::GetByteSize(trigram_to_entries_);
+    for (const auto& [trigram, ids] : trigram_to_entries_)
+        size += memory::GetByteSize(ids);
+    return size;
+}
+
+void NameIndex::Remove(std::string_view name, const Kind kind) {
+    const std::string key = ToLower(name);
+    auto it = std::lower_bound(
+        order_.begin(), order_.end(), key,
+        [this](const uint32_t id, const std::string& value) {
+            return GetKey(id) < value;
+        }
+    );
+    for (; it != order_.end() && GetKey(*it) == key; ++it) {
+        Entry& entry = entries_[*it];
+        if (entry.match.name != name || entry.match.kind != kind)
+            continue;
+
+        entry.match.name = {}; // the name may not outlive the removal
+        entry.is_removed = true;
+        order_.erase(it);
+        if (++removed_count_ > entries_.size()/2)
+            Compact();
+        return;
+    }
+}
+
+void NameIndex::Compact() {
+    // Entries are added again in key order, so the new order is the identity
+    NameIndex compacted;
+    compacted.entries_.reserve(order_.size());
+    compacted.keys_.reserve(keys_.size());
+    compacted.order_.reserve(order_.size());
+    for (const uint32_t id : order_)
+        compacted.order_.push_back(
+            compacted.Emplace(entries_[id].match.name, entries_[id].match.kind)
+        );
+    *this = std::move(compacted);
+}
+
+std::vector<NameIndex::Match> NameIndex::Suggest(std::string_view query,
+                                                 const size_t count) const {
+    std::vector<Match> matches;
+    if (!count)
+        return matches;
+
+    const std::string key = ToLower(query);
+    std::unordered_set<uint32_t> matched;
+
+    auto it = std::lower_bound(
+        order_.begin(), order_.end(), key,
+        [this](const uint32_t id, const std::string& value) {
+            return GetKey(id) < value;
+        }
+    );
+    for (; it != order_.end() && matches.size() < count; ++it) {
+        if (GetKey(*it).substr(0, key.size()) != key)
+            break;
+
+        matches.push_back(entries_[*it].match);
+        matched.insert(*it);
+    }
+
+    if (matches.size() == count || key.size() < MIN_FUZZY_LENGTH)
+        return matches;
+
+    const std::vector<Trigram> trigrams = GetTrigrams(key);
+    std::unordered_map<uint32_t, uint32_t> id_to_hits;
+    for (const Trigram trigram : trigrams)
+        if (const auto found = trigram_to_entries_.find(trigram);
+            found != trigram_to_entries_.end())
+            for (const uint32_t id : found->second)
+                ++id_to_hits[id];
+
+    struct Candidate {
+        uint32_t id;
+        double similarity;
+    };
+    std::vector<Candidate> candidates;
+    for (const auto& [id, hits] : id_to_hits) {
+        if (matched.count(id) || entries_[id].is_removed)
+            continue;
+
+        const double similarity = static_cast<double>(hits)
+            /(trigrams.size() + entries_[id].trigram_count - hits);
+        if (similarity >= MIN_SIMILARITY)
+            candidates.push_back({id, similarity});
+    }
+
+    const size_t fuzzy_count = std::min(count - matches.size(), candidates.size());
+    std::partial_sort(
+        candidates.begin(), candidates.begin() + fuzzy_count, candidates.end(),
+        [this](const Candidate& lhs, const Candidate& rhs) {
+            return lhs.similarity > rhs.similarity
+                || (lhs.similarity == rhs.similarity && IsLess(lhs.id, rhs.id));
+        }
+    );
+    for (size_t i = 0; i < fuzzy_count; ++i)
+        matches.push_back(entries_[candidates[i].id].match);
+
+    return matches;
+}
+
+} // namespace transport
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace transport {
+
+// Case-insensitive prefix search over names kept in lexicographic order,
+// complemented by a trigram index for typo-tolerant matches. Names are
+// referenced, their lowercase keys are kept one after another in a pool
+class NameIndex {
+public:
+    enum class Kind : uint8_t { BUS, STOP, };
+
+    struct Match {
+        std::string_view name; // refers to the indexed name
+        Kind kind;
+    };
+
+public:
+    // Names must outlive the index
+    void Add(std::string_view name, const Kind kind);
+
+    void Add(const std::vector<Match>& matches);
+
+    // Stops suggesting the name. Removed entries are dropped together with
+    // their trigram postings once they make up half of the entries
+    void Remove(std::string_view name, const Kind kind);
+
+    inline size_t GetSize() const {
+        return order_.size();
+    }
+
+    size_t GetByteSize() const;
+
+    // Prefix matches in lexicographic order followed by the closest fuzzy
+    // matches if there are fewer than count of them. Shorter queries than
+    // MIN_FUZZY_LENGTH share trigrams with too many names to rank them
+    std::vector<Match> Suggest(std::string_view query, const size_t count) const;
+
+    static constexpr size_t MIN_FUZZY_LENGTH = 3;
+
+private:
+    using Trigram = uint32_t;
+
+    struct Entry {
+        uint32_t key_offset; // into keys_
+        uint32_t key_size;
+        Match match;
+        uint32_t trigram_count;
+        bool is_removed = false;
+    };
+
+    static constexpr double MIN_SIMILARITY = 0.3;
+
+    std::vector<Entry> entries_;
+    std::string keys_; // lowercase names
+    std::vector<uint32_t> order_; // entry ids sorted by key
+    std::unordered_map<Trigram, std::vector<uint32_t>> trigram_to_entries_;
+    size_t removed_count_ = 0;
+
+    static std::string ToLower(std::string_view text);
+
+    static std::vector<Trigram> GetTrigrams(std::string_view key);
+
+    inline std::string_view GetKey(const uint32_t id) const {
+        return std::string_view(keys_).substr(entries_[id].key_offset, entries_[id].key_size);
+    }
+
+    uint32_t Emplace(std::string_view name, const Kind kind);
+
+    bool IsLess(const uint32_t lhs, const uint32_t rhs) const;
+
+    void Compact();
+};
+
+} // namespace transport
@@ -0,0 +1,153 @@
+#include "parallel.h"
+
+#include <utility>
+
+namespace transport {
+
+namespace {
+
+// Pool and queue of the calling worker thread
+thread_local const TaskPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+} // namespace
+
+// ---------- TaskPool ----------------
+
+TaskPool::TaskPool(const size_t thread_count)
+        : queues_(std::max<size_t>(thread_count, 1u)) {
+    threads_.reserve(queues_.size());
+    for (size_t index = 0; index < queues_.size(); ++index)
+        threads_.emplace_back(&TaskPool::Work, this, index);
+}
+
+TaskPool::~TaskPool() {
+    {
+        const std::lock_guard lock(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_)
+        thread.join();
+}
+
+void TaskPool::Submit(Task task) {
+    // Counted first, so a sleeping worker is never left with a queued task
+    {
+        const std::lock_guard lock(sleep_mutex_);
+        ++queued_count_;
+    }
+
+    if (const size_t own_queue = GetOwnQueue(); own_queue != queues_.size()) {
+        Queue& queue = queues_[own_queue];
+        const std::lock_guard lock(queue.mutex);
+        queue.tasks.push_front(std::move(task));
+    } else {
+        Queue& queue = queues_[next_queue_++ % queues_.size()];
+        const std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+bool TaskPool::RunOne() {
+    std::optional<Task> task = Take(GetOwnQueue());
+    if (!task)
+        return false;
+    (*task)();
+    return true;
+}
+
+void TaskPool::Notify() {
+    // Locked, so a thread about to sleep sees the change or gets woken
+    {
+        const std::lock_guard lock(sleep_mutex_);
+    }
+    wake_.notify_all();
+}
+
+size_t TaskPool::GetOwnQueue() const {
+    return (current_pool == this) ? current_queue : queues_.size();
+}
+
+std::optional<TaskPool::Task> TaskPool::Take(const size_t own_queue) {
+    const auto pop = [this](Queue& queue, const bool is_front) -> std::optional<Task> {
+        const std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty())
+            return std::nullopt;
+
+        Task task;
+        if (is_front) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        --queued_count_;
+        return task;
+    };
+
+    if (own_queue != queues_.size())
+        if (std::optional<Task> task = pop(queues_[own_queue], true))
+            return task;
+    for (size_t i = 1; i <= queues_.size(); ++i)
+        if (std::optional<Task> task = pop(queues_[(own_queue + i) % queues_.size()], false))
+            return task;
+    return std::nullopt;
+}
+
+void TaskPool::Work(const size_t index) {
+    current_pool = this;
+    current_queue = index;
+
+    while (true) {
+        if (std::optional<Task> task = Take(index)) {
+            (*task)();
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [this]() { return is_stopping_ || queued_count_ > 0; });
+        if (is_stopping_ && queued_count_ == 0)
+            return;
+    }
+}
+
+// ---------- TaskGroup ---------------
+
+TaskGroup::~TaskGroup() {
+    Join();
+}
+
+void TaskGroup::Run(TaskPool::Task task) {
+    ++running_count_;
+    pool_.Submit([this, task = std::move(task)]() {
+        try {
+            task();
+        } catch (...) {
+            const std::lock_guard lock(error_mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+        // The group may be gone once the count drops, the pool is not
+        TaskPool& pool = pool_;
+        if (--running_count_ == 0)
+            pool.Notify();
+    });
+}
+
+void TaskGroup::Wait() {
+    Join();
+    if (error_)
+        std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+void TaskGroup::Join() {
+    const auto is_done = [this]() { return running_count_ == 0; };
+    while (!is_done())
+        if (!pool_.RunOne())
+            pool_.Sleep(is_done);
+}
+
+} // namespace transport
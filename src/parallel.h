@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace transport {
+
+// Calls function(first, last) for contiguous chunks of [0, size) on the
+// hardware threads, small ranges are processed in the calling thread
+template <typename Function>
+void ForEachChunk(const size_t size,
+                  Function function,
+                  const size_t min_chunk_size = 1024) {
+    const size_t thread_count = std::max<size_t>(
+        1u,
+        std::min<size_t>(std::thread::hardware_concurrency(),
+                         size/std::max<size_t>(min_chunk_size, 1u))
+    );
+    if (thread_count == 1) {
+        function(size_t{0}, size);
+        return;
+    }
+
+    const size_t chunk_size = (size + thread_count - 1)/thread_count;
+    std::vector<std::future<void>> futures;
+    futures.reserve(thread_count - 1);
+    for (size_t first = chunk_size; first < size; first += chunk_size)
+        futures.push_back(std::async(
+            std::launch::async,
+            function, first, std::min(size, first + chunk_size)
+        ));
+
+    function(size_t{0}, std::min(size, chunk_size));
+    for (std::future<void>& future : futures)
+        future.get();
+}
+
+// ---------- TaskPool ----------------
+
+// Worker threads each keeping its own deque of tasks. A worker runs its tasks
+// from the front and, once out of them, steals from the back of the others'
+// deques. Tasks submitted by a task go to the front of its worker's deque so
+// nested work is done first where it was split unless an idle worker steals
+// it, the other ones are dealt to the workers in turn
+class TaskPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskPool(const size_t thread_count);
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    // Runs the queued tasks before the workers stop
+    ~TaskPool();
+
+    inline size_t GetThreadCount() const {
+        return threads_.size();
+    }
+
+    // Tasks are not to throw, TaskGroup catches for them
+    void Submit(Task task);
+
+    // Runs a queued task in the calling thread, false if there are none
+    bool RunOne();
+
+    // Blocks the calling thread until a task is queued or is_done() holds.
+    // Whatever makes is_done() hold is to call Notify() afterwards
+    template <typename Done>
+    void Sleep(Done is_done) {
+        std::unique_lock lock(sleep_mutex_);
+        wake_.wait(lock, [&]() { return queued_count_ > 0 || is_done(); });
+    }
+
+    // Wakes the threads in Sleep() to check their condition again
+    void Notify();
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_queue_{0};
+    std::atomic<size_t> queued_count_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_;
+    bool is_stopping_ = false;
+
+    // Index of the calling worker's queue, the pool's queue count otherwise
+    size_t GetOwnQueue() const;
+
+    std::optional<Task> Take(const size_t own_queue);
+
+    void Work(const size_t index);
+};
+
+// ---------- TaskGroup ---------------
+
+// Tasks run on a pool and joined together. The waiting thread runs queued
+// tasks meanwhile, so a task may split its work into a group of its own,
+// and sleeps on the pool until the last task ends once there are none
+class TaskGroup {
+public:
+    explicit TaskGroup(TaskPool& pool) : pool_(pool) {}
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup();
+
+    void Run(TaskPool::Task task);
+
+    // Rethrows the first exception of the tasks
+    void Wait();
+
+private:
+    TaskPool& pool_;
+    std::atomic<size_t> running_count_{0};
+    std::mutex error_mutex_;
+    std::exception_ptr error_;
+
+    void Join();
+};
+
+// Calls produce(index) for each of task_count tasks on the pool and passes
+// the results to consume() in the calling thread in the order of the tasks.
+// A result is consumed once the ones before it are, so the output streams
+// while the workers go on. Only twice as many tasks as there are workers are
+// in flight, a slow one holds back at most that many results. The calling
+// thread runs queued tasks while it waits. An exception of produce() is
+// rethrown at its task
+template <typename Produce, typename Consume>
+void RunInOrder(TaskPool& pool,
+                const size_t task_count,
+                Produce produce,
+                Consume consume) {
+    using Result = std::invoke_result_t<Produce&, size_t>;
+
+    struct Slot {
+        std::optional<Result> result;
+        std::exception_ptr error;
+        std::atomic<bool> is_ready{false};
+    };
+    const size_t window = std::min(task_count, 2*pool.GetThreadCount());
+    std::vector<Slot> slots(window); // task i goes to slot i % window
+    std::atomic<bool> is_cancelled{false};
+
+    // The group is joined before the slots go, the guard first drops the
+    // tasks left when the consumer leaves early
+    TaskGroup group(pool);
+    struct Cancel {
+        std::atomic<bool>& is_cancelled;
+        ~Cancel() {
+            is_cancelled = true;
+        }
+    } cancel{is_cancelled};
+
+    const auto run = [&](const size_t index) {
+        group.Run([&, index]() {
+            if (is_cancelled)
+                return;
+
+            Slot& slot = slots[index % window];
+            try {
+                slot.result.emplace(produce(index));
+            } catch (...) {
+                slot.error = std::current_exception();
+            }
+            slot.is_ready.store(true, std::memory_order_release);
+            pool.Notify();
+        });
+    };
+
+    for (size_t index = 0; index < window; ++index)
+        run(index);
+
+    for (size_t index = 0; index < task_count; ++index) {
+        Slot& slot = slots[index % window];
+        const auto is_ready = [&slot]() {
+            return slot.is_ready.load(std::memory_order_acquire);
+        };
+        while (!is_ready())
+            if (!pool.RunOne())
+                pool.Sleep(is_ready);
+
+        if (slot.error)
+            std::rethrow_exception(slot.error);
+        consume(std::move(*slot.result));
+        slot.result.reset();
+        slot.is_ready.store(false, std::memory_order_relaxed);
+
+        if (index + window < task_count)
+            run(index + window);
+    }
+}
+
+} // namespace transport
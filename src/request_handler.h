@@ -8,19 +8,36 @@
 namespace transport {
 namespace io {
 
+// Answers stat requests from a catalogue it does not own. The const members
+// only read the catalogue, the renderer and the router. Their one cache is
+// the catalogue's stop to buses index, which the first lookup after buses
+// are added one by one rebuilds under the index mutex; a Snapshot builds it
+// with EnsureIndexed() before it is published, so that no reader does. One
+// handler may thus serve several threads at once as long as nothing changes
+// it or the catalogue meanwhile. The router is immutable and may be shared
+// by the handlers of several catalogue versions
 class RequestHandler {
 public:
-    RequestHandler(Catalogue& catalogue, renderer::Settings render_settings)
+    RequestHandler(const Catalogue& catalogue,
+                   renderer::Settings render_settings)
         : catalogue_(catalogue)
         , renderer_(renderer::MapRenderer(render_settings))
-        , router_(Router(catalogue)) {
+        , router_(std::make_shared<const Router>(catalogue)) {
     }
 
-    RequestHandler(Catalogue& catalogue,
+    RequestHandler(const Catalogue& catalogue,
                    renderer::Settings render_settings,
                    Router router)
         : catalogue_(catalogue)
         , renderer_(renderer::MapRenderer(render_settings))
+        , router_(std::make_shared<const Router>(std::move(router))) {
+    }
+
+    RequestHandler(const Catalogue& catalogue,
+                   renderer::Settings render_settings,
+                   std::shared_ptr<const Router> router)
+        : catalogue_(catalogue)
+        , renderer_(renderer::MapRenderer(render_settings))
         , router_(std::move(router)) {
     }
 
@@ -28,20 +45,35 @@ public:
         return renderer_.GetSettings();
     }
 
+    inline const renderer::MapRenderer& GetRenderer() const {
+        return renderer_;
+    }
+
     inline void SetRendererSettings(renderer::Settings settings) {
         renderer_.SetSettings(settings);
     }
 
     inline const Router& GetRouter() const {
+        return *router_;
+    }
+
+    inline std::shared_ptr<const Router> ShareRouter() const {
         return router_;
     }
 
-    inline Catalogue& GetCatalogue() const {
+    inline const Catalogue& GetCatalogue() const {
         return catalogue_;
     }
 
     inline void SetRouter(Router router) {
-        router_ = std::move(router);
+        router_ = std::make_shared<const Router>(std::move(router));
+    }
+
+    inline std::vector<MemoryUsage> GetMemoryUsage() const {
+        std::vector<MemoryUsage> usage = catalogue_.GetMemoryUsage();
+        for (MemoryUsage& router_usage : router_->GetMemoryUsage())
+            usage.push_back(std::move(router_usage));
+        return usage;
     }
 
     inline std::optional<domain::BusLine> GetBusStat(
@@ -56,6 +88,21 @@ public:
         return catalogue_.GetStop(stop_name);
     }
 
+    // Empty if any of the stops is unknown
+    inline std::optional<std::vector<domain::BusPtr>> GetCommonBuses(
+        const std::vector<std::string_view>& stop_names
+    ) const {
+        std::vector<domain::StopPtr> stops;
+        stops.reserve(stop_names.size());
+        for (const std::string_view stop_name : stop_names) {
+            const domain::StopPtr& stop_ptr = catalogue_.SearchStop(stop_name);
+            if (!stop_ptr)
+                return std::nullopt;
+            stops.push_back(stop_ptr);
+        }
+        return catalogue_.GetCommonBuses(stops);
+    }
+
     inline std::optional<domain::Route> GetRoute(
         const std::string_view start,
         const std::string_view finish
@@ -64,10 +111,29 @@ public:
         const domain::StopPtr& finish_ptr = catalogue_.SearchStop(finish);
 
         return (start_ptr && finish_ptr)
-               ? router_.GetRoute(start_ptr, finish_ptr)
+               ? router_->GetRoute(start_ptr, finish_ptr)
                : std::nullopt;
     }
 
+    inline std::vector<std::pair<domain::StopPtr, double>> GetNearestStops(
+        const geo::Coordinates coords,
+        const size_t count
+    ) const {
+        return catalogue_.GetNearestStops(coords, count);
+    }
+
+    inline domain::SetPtr<domain::StopPtr> GetStopsInBox(
+        const geo::Coordinates min,
+        const geo::Coordinates max
+    ) const {
+        return catalogue_.GetStopsInBox(min, max);
+    }
+
+    inline std::vector<NameIndex::Match> Suggest(const std::string_view query,
+                                                 const size_t count) const {
+        return catalogue_.Suggest(query, count);
+    }
+
     inline svg::Document RenderMap() const {
         return renderer_.RenderMap(
             catalogue_.GetAllBusLines(),
@@ -76,9 +142,9 @@ public:
     }
 
 private:
-    Catalogue& catalogue_;
+    const Catalogue& catalogue_;
     renderer::MapRenderer renderer_;
-    Router router_;
+    std::shared_ptr<const Router> router_;
 };
 
 } // namespace io
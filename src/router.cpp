@@ -1,6 +1,7 @@
 #include "router.h"
 
 #include <iterator>
+#include <stdexcept>
 #include <vector>
 
 namespace transport {
@@ -8,44 +9,44 @@ namespace transport {
 using graph::EdgeId, graph::VertexId;
 
 void Router::FillStopEdges(const Catalogue& db) {
-    graph::VertexId vertex_id = {};
-    for (const auto& [_, stop_ptr] : db.GetStopsHolder()) {
-        stop_to_transfer_.emplace(stop_ptr, Transfer{vertex_id, vertex_id++});
-        ++vertex_id;
-    }
-
-    for (const auto& [stop_ptr, transfer] : stop_to_transfer_) {
+    for (const domain::StopPtr& stop_ptr : db.GetStops()) {
+        const Transfer transfer = GetTransfer(stop_ptr);
         const double wait_time = stop_ptr->wait_time;
         id_to_edge_.emplace(
-            graph_.AddEdge({transfer.second, transfer.first, wait_time}),
+            graph_->AddEdge({transfer.second, transfer.first, wait_time}),
             domain::Edge{stop_ptr, stop_ptr, nullptr, 0, wait_time}
         );
     }
 }
 
 std::vector<domain::Edge> Router::CreateEdgesFromBusLines(const Catalogue& db) {
-    const auto& stops_to_distance = db.GetDistances();
-    const auto& push_back_busline_edges = [&](auto first, auto last,
-                                              std::vector<domain::Edge>& edges,
-                                              const domain::BusPtr& bus_ptr) {
-        for (auto from = first; from != last; ++from) {
+    const auto& push_back_busline_edges = [](const domain::BusPtr& bus_ptr,
+                                             const bool is_reversed,
+                                             std::vector<domain::Edge>& edges) {
+        const std::vector<domain::StopPtr>& stops = bus_ptr->stops;
+        const size_t last = stops.size();
+
+        const auto stop_at = [&](const size_t i) -> const domain::StopPtr& {
+            return is_reversed ? stops[last - 1 - i] : stops[i];
+        };
+        const auto distance_at = [&](const size_t i) {
+            return is_reversed
+                   ? bus_ptr->reverse_distances[last - 2 - i]
+                   : bus_ptr->distances[i];
+        };
+
+        for (size_t from = 0; from < last; ++from) {
             int distance = 0;
-            for (auto to = std::next(from); to != last; ++to) {
-                if (*to == *from)
+            for (size_t to = from + 1; to < last; ++to) {
+                distance += distance_at(to - 1);
+                if (stop_at(to) == stop_at(from))
                     continue;
 
-                const domain::StopPtr& prev = *std::prev(to);
-                distance += stops_to_distance.at(
-                    stops_to_distance.find({prev, *to}) != stops_to_distance.end()
-                    ? Catalogue::AdjacentStops(prev, *to)
-                    : Catalogue::AdjacentStops(*to, prev)
-                );
-
                 edges.push_back(domain::Edge{
-                    *from,
-                    *to,
+                    stop_at(from),
+                    stop_at(to),
                     bus_ptr,
-                    static_cast<uint8_t>(std::distance(from, to)),
+                    static_cast<uint8_t>(to - from),
                     60 * distance*1e-3/bus_ptr->velocity // [h]->[min]
                 });
             }
@@ -53,29 +54,20 @@ std::vector<domain::Edge> Router::CreateEdgesFromBusLines(const Catalogue& db) {
     };
 
     std::vector<domain::Edge> edges;
-    for (const auto& [_, bus_ptr] : db.GetBusesHolder()) {
-        push_back_busline_edges(
-            begin(bus_ptr->stops), end(bus_ptr->stops),
-            edges,
-            bus_ptr
-        );
-
+    for (const domain::BusPtr& bus_ptr : db.GetBuses()) {
+        push_back_busline_edges(bus_ptr, false, edges);
         if (!bus_ptr->is_roundtrip)
-            push_back_busline_edges(
-                rbegin(bus_ptr->stops), rend(bus_ptr->stops),
-                edges,
-                bus_ptr
-            );
+            push_back_busline_edges(bus_ptr, true, edges);
     }
 
     return edges;
 }
 
-void Router::FillBusEdges(const Catalogue& db) {
-    std::unordered_map<graph::VertexId, std::unordered_map<graph::VertexId, domain::Edge>> vertex_to_edges;
+Router::VertexToEdges Router::CreateVertexToEdges(const Catalogue& db) {
+    VertexToEdges vertex_to_edges;
     for (domain::Edge& edge : CreateEdgesFromBusLines(db)) {
-        const graph::VertexId from = stop_to_transfer_.at(edge.from).first;
-        const graph::VertexId to = stop_to_transfer_.at(edge.to).second;
+        const graph::VertexId from = GetTransfer(edge.from).first;
+        const graph::VertexId to = GetTransfer(edge.to).second;
 
         if (vertex_to_edges.count(from) && vertex_to_edges.at(from).count(to)) {
             if (vertex_to_edges.at(from).at(to).timedelta > edge.timedelta)
@@ -84,15 +76,34 @@ void Router::FillBusEdges(const Catalogue& db) {
             vertex_to_edges[from].emplace(to, std::move(edge));
         }
     }
+    return vertex_to_edges;
+}
 
-    for (auto& [from, vertex_to_edge] : vertex_to_edges)
+void Router::FillBusEdges(const Catalogue& db) {
+    for (auto& [from, vertex_to_edge] : CreateVertexToEdges(db))
         for (auto& [to, edge] : vertex_to_edge)
             id_to_edge_.emplace(
-                graph_.AddEdge({from, to, edge.timedelta}),
+                graph_->AddEdge({from, to, edge.timedelta}),
                 std::move(edge)
             );
 }
 
+void Router::RestoreEdges(const Catalogue& db) {
+    VertexToEdges vertex_to_edges = CreateVertexToEdges(db);
+    for (EdgeId id = 0; id < graph_->GetEdgeCount(); ++id) {
+        const auto& [from, to, weight] = graph_->GetEdge(id);
+        if (from/2 == to/2) {
+            const domain::StopPtr& stop_ptr = db.GetStop(from/2);
+            id_to_edge_.emplace(
+                id,
+                domain::Edge{stop_ptr, stop_ptr, nullptr, 0, weight}
+            );
+        } else {
+            id_to_edge_.emplace(id, std::move(vertex_to_edges.at(from).at(to)));
+        }
+    }
+}
+
 std::vector<domain::Edge> Router::GetEdgesFromIds(
     std::vector<graph::EdgeId> edge_ids
 ) const {
@@ -107,9 +118,12 @@ std::optional<domain::Route> Router::GetRoute(
     const domain::StopPtr& start,
     const domain::StopPtr& finish
 ) const {
+    if (!router_)
+        throw std::logic_error("routes have not been computed");
+
     const auto& route = router_->BuildRoute(
-        stop_to_transfer_.at(start).second,
-        stop_to_transfer_.at(finish).second
+        GetTransfer(start).second,
+        GetTransfer(finish).second
     );
 
     if (!route)
@@ -118,4 +132,15 @@ std::optional<domain::Route> Router::GetRoute(
     return domain::Route{GetEdgesFromIds(route->edges), route->weight};
 }
 
-} // namespace transport
\ No newline at end of file
+std::vector<MemoryUsage> Router::GetMemoryUsage() const {
+    const size_t vertex_count = graph_->GetVertexCount();
+    std::vector<MemoryUsage> usage{
+        {"router.graph", graph_->GetByteSize(), graph_->GetEdgeCount()},
+        memory::Describe("router.id_to_edge", id_to_edge_),
+    };
+    if (router_)
+        usage.push_back({"router.routes", router_->GetByteSize(), vertex_count*vertex_count});
+    return usage;
+}
+
+} // namespace transport
@@ -6,46 +6,93 @@
 #include <unordered_map>
 
 #include "catalogue.h"
+#include "metrics.h"
 
 namespace transport {
 
 class Router {
 public:
+    using Graph = graph::DirectedWeightedGraph<double>;
     using Transfer = std::pair<graph::VertexId, graph::VertexId>;
 
 public:
-    explicit Router(const Catalogue& db) : graph_(2*db.GetStopCount()) {
-        FillStopEdges(db);
-        FillBusEdges(db);
-        router_ = std::make_unique<graph::Router<double>>(
-            graph::Router<double>(graph_)
-        );
+    // Empty graph without routes, a placeholder until a database is loaded
+    Router()
+            : graph_(std::make_unique<Graph>()) {
     }
 
-    explicit Router(const Catalogue& db,
-                    graph::DirectedWeightedGraph<double> graph)
-            : graph_(graph) {
-        FillStopEdges(db);
-        FillBusEdges(db);
+    // The route table may be left out when the graph is only to be stored,
+    // as it is computed again when the database is loaded
+    explicit Router(const Catalogue& db, const bool is_routed = true)
+            : graph_(std::make_unique<Graph>(2*db.GetStopCount())) {
+        {
+            const metrics::PhaseTimer timer(metrics::Phase::GRAPH_BUILD);
+            FillStopEdges(db);
+            FillBusEdges(db);
+        }
+        if (!is_routed)
+            return;
+        const metrics::PhaseTimer timer(metrics::Phase::ROUTE_PRECOMPUTE);
+        router_ = std::make_unique<graph::Router<double>>(*graph_);
     }
 
-    inline const graph::DirectedWeightedGraph<double>& GetGraph() const {
-        return graph_;
+    // Graph together with its route table, which depends on the graph alone
+    // and so can be computed before the catalogue is there
+    struct Routes {
+        std::unique_ptr<Graph> graph;
+        std::unique_ptr<graph::Router<double>> router;
+    };
+
+    explicit Router(const Catalogue& db, Graph graph)
+            : Router(db, ComputeRoutes(std::move(graph))) {
+    }
+
+    explicit Router(const Catalogue& db, Routes routes)
+            : graph_(std::move(routes.graph))
+            , router_(std::move(routes.router)) {
+        const metrics::PhaseTimer timer(metrics::Phase::GRAPH_BUILD);
+        RestoreEdges(db);
+    }
+
+    static Routes ComputeRoutes(Graph graph) {
+        const metrics::PhaseTimer timer(metrics::Phase::ROUTE_PRECOMPUTE);
+        Routes routes{std::make_unique<Graph>(std::move(graph)), nullptr};
+        routes.router = std::make_unique<graph::Router<double>>(*routes.graph);
+        return routes;
+    }
+
+    inline const Graph& GetGraph() const {
+        return *graph_;
     }
 
     std::optional<domain::Route> GetRoute(const domain::StopPtr& start,
                                           const domain::StopPtr& finish) const;
 
+    std::vector<MemoryUsage> GetMemoryUsage() const;
+
 private:
-    graph::DirectedWeightedGraph<double> graph_;
+    using VertexToEdges = std::unordered_map<
+        graph::VertexId,
+        std::unordered_map<graph::VertexId, domain::Edge>
+    >;
+
+    // Graph is kept on the heap as graph::Router refers to it
+    std::unique_ptr<Graph> graph_;
     std::unique_ptr<graph::Router<double>> router_;
-    std::unordered_map<domain::StopPtr, Transfer> stop_to_transfer_;
     std::unordered_map<graph::EdgeId, domain::Edge> id_to_edge_;
 
+    // Stop is split into the boarding (first) and the arrival (second)
+    // vertices connected by the waiting edge
+    inline static Transfer GetTransfer(const domain::StopPtr& stop_ptr) {
+        return {2*stop_ptr->id + 1, 2*stop_ptr->id};
+    }
+
     static std::vector<domain::Edge> CreateEdgesFromBusLines(
         const Catalogue& db
     );
 
+    static VertexToEdges CreateVertexToEdges(const Catalogue& db);
+
     std::vector<domain::Edge> GetEdgesFromIds(
         std::vector<graph::EdgeId> edge_ids
     ) const;
@@ -53,6 +100,8 @@ private:
     void FillStopEdges(const Catalogue& db);
 
     void FillBusEdges(const Catalogue& db);
+
+    void RestoreEdges(const Catalogue& db);
 };
 
-} // namespace transport
\ No newline at end of file
+} // namespace transport
@@ -1,21 +1,24 @@
 #include "serialization.h"
 
+#include <future>
+
 #include "domain.h"
+#include "metrics.h"
 
 namespace transport {
 namespace io {
 
 namespace {
 
-std::vector<int> ParseIntegerContainer(std::string_view text) {
-    std::vector<int> words;
+std::vector<double> ParseNumberContainer(std::string_view text) {
+    std::vector<double> words;
 
     const size_t pos_end = text.npos;
     while (true) {
         size_t sep = text.find(',');
         std::string_view word = text.substr(0, sep);
 
-        words.push_back(std::stoi(std::string(word)));
+        words.push_back(std::stod(std::string(word)));
 
         if (sep == pos_end)
             break;
@@ -29,50 +32,190 @@ std::vector<int> ParseIntegerContainer(std::string_view text) {
 
 // ---------- Bufferiser --------------
 
-void Bufferiser::Serialize(std::ostream& out) const {
+void Bufferiser::Serialize(std::ostream& out,
+                           const std::optional<ShardInfo>& shard) const {
+    const metrics::PhaseTimer timer(metrics::Phase::SERIALIZE);
     pb::Catalogue converted_catalogue;
 
     const transport::Catalogue& catalogue = request_handler_.GetCatalogue();
-    for (const auto& [_, stop_ptr] : catalogue.GetStopsHolder())
-        *converted_catalogue.add_stop() = Convert(*stop_ptr);
-    for (const auto& [stops, distance] : catalogue.GetDistances())
-        *converted_catalogue.add_adjacent_stops() = Convert(stops, distance);
-    for (const auto& [_, bus_ptr] : catalogue.GetBusesHolder())
-        *converted_catalogue.add_bus() = Convert(*bus_ptr);
+
+    // Removed stops are dropped and the rest are renumbered densely
+    std::vector<size_t> stop_ids(catalogue.GetStopCount(), REMOVED_ID);
+    size_t stop_count = 0;
+    for (const domain::StopPtr& stop_ptr : catalogue.GetStops())
+        if (!catalogue.IsRemoved(stop_ptr)) {
+            stop_ids[stop_ptr->id] = stop_count++;
+            *converted_catalogue.add_stop() = Convert(*stop_ptr, stop_ids);
+        }
+    for (const domain::StopPtr& stop_ptr : catalogue.GetStops())
+        for (const Catalogue::Adjacent& adjacent : catalogue.GetAdjacent(stop_ptr->id))
+            if (adjacent.is_explicit)
+                *converted_catalogue.add_adjacent_stops() = Convert(
+                    stop_ids[stop_ptr->id],
+                    {stop_ids[adjacent.id], adjacent.distance, adjacent.is_explicit}
+                );
+    for (const domain::BusPtr& bus_ptr : catalogue.GetBuses())
+        *converted_catalogue.add_bus() = Convert(*bus_ptr, stop_ids);
+    *converted_catalogue.mutable_spatial_index() = Convert(
+        catalogue.GetSpatialIndex().GetGrid(),
+        stop_ids
+    );
+    *converted_catalogue.mutable_stop_bus_index() = Convert(
+        catalogue.GetStopBusIndex(),
+        stop_ids
+    );
 
     pb::DataBase db;
     *db.mutable_catalogue() = converted_catalogue;
     *db.mutable_map_settings() = Convert(request_handler_.GetRendererSettings());
-    *db.mutable_graph() = Convert(request_handler_.GetRouter().GetGraph());
+    *db.mutable_graph() = Convert(request_handler_.GetRouter().GetGraph(), stop_ids);
+    if (shard)
+        *db.mutable_shard() = Convert(*shard, stop_ids);
     db.SerializeToOstream(&out);
 }
 
-void Bufferiser::Deserialize(std::istream& in) {
+std::optional<ShardInfo> Bufferiser::Deserialize(std::istream& in,
+                                                 Catalogue& catalogue,
+                                                 const bool is_routed) {
+    const metrics::PhaseTimer timer(metrics::Phase::DESERIALIZE);
     pb::DataBase db;
     db.ParseFromIstream(&in);
 
-    transport::Catalogue& catalogue = request_handler_.GetCatalogue();
-    for (int i = 0; i < db.catalogue().stop_size(); ++i) {
-        const pb::domain::Stop& stop = db.catalogue().stop(i);
-        catalogue.AddStop({
-            catalogue.GetStop(stop.id())->name,
+    // The route table is computed from the graph while the catalogue is
+    // restored
+    std::future<Router::Routes> routes;
+    if (is_routed)
+        routes = std::async(std::launch::async, [&db]() {
+            return Router::ComputeRoutes(Convert(db.graph()));
+        });
+
+    const pb::Catalogue& converted_catalogue = db.catalogue();
+
+    std::vector<domain::Stop> stops;
+    stops.reserve(converted_catalogue.stop_size());
+    for (const pb::domain::Stop& stop : converted_catalogue.stop())
+        stops.push_back({
+            stop.name(),
             geo::Coordinates{stop.coords().lat(), stop.coords().lng()},
             static_cast<uint16_t>(stop.wait_time())
         });
-    }
-    for (int i = 0; i < db.catalogue().adjacent_stops_size(); ++i) {
-        const auto& adjacent_stops = db.catalogue().adjacent_stops(i);
-        catalogue.MakeAdjacent(
-            catalogue.GetStop(adjacent_stops.id()),
-            catalogue.GetStop(adjacent_stops.adjacent_id()),
-            adjacent_stops.distance()
-        );
-    }
-    for (int i = 0; i < db.catalogue().bus_size(); ++i)
-        catalogue.AddBus(Convert(db.catalogue().bus(i)));
+    catalogue.AddStops(
+        std::move(stops),
+        converted_catalogue.has_spatial_index()
+        ? std::make_optional(Convert(converted_catalogue.spatial_index()))
+        : std::nullopt
+    );
+
+    std::vector<Catalogue::Distance> distances;
+    distances.reserve(converted_catalogue.adjacent_stops_size());
+    for (const pb::domain::AdjacentStops& adjacent_stops : converted_catalogue.adjacent_stops())
+        distances.push_back({
+            adjacent_stops.id(),
+            adjacent_stops.adjacent_id(),
+            static_cast<int>(adjacent_stops.distance())
+        });
+    catalogue.MakeAdjacent(distances);
+
+    std::vector<domain::Bus> buses;
+    buses.reserve(converted_catalogue.bus_size());
+    for (const pb::domain::Bus& bus : converted_catalogue.bus())
+        buses.push_back(Convert(bus, catalogue));
+    catalogue.AddBuses(
+        std::move(buses),
+        converted_catalogue.has_stop_bus_index()
+        ? std::make_optional(Convert(converted_catalogue.stop_bus_index()))
+        : std::nullopt
+    );
 
     request_handler_.SetRendererSettings(Convert(db.map_settings()));
-    request_handler_.SetRouter(Router(catalogue, Convert(db.graph())));
+    if (is_routed)
+        request_handler_.SetRouter(Router(catalogue, routes.get()));
+
+    return db.has_shard()
+           ? std::make_optional(Convert(db.shard()))
+           : std::nullopt;
+}
+
+pb::Shard Bufferiser::Convert(const ShardInfo& shard,
+                              const std::vector<size_t>& stop_ids) {
+    pb::Shard converted;
+
+    converted.set_index(shard.index);
+    converted.set_count(shard.count);
+    for (size_t id = 0; id < shard.owners.size(); ++id)
+        if (stop_ids.at(id) != REMOVED_ID)
+            converted.add_owner(shard.owners[id]);
+    for (const size_t id : shard.entries)
+        converted.add_entry_stop_id(stop_ids.at(id));
+    for (const size_t id : shard.exits)
+        converted.add_exit_stop_id(stop_ids.at(id));
+
+    return converted;
+}
+
+ShardInfo Bufferiser::Convert(const pb::Shard& shard) {
+    return {
+        shard.index(),
+        shard.count(),
+        {shard.owner().begin(), shard.owner().end()},
+        {shard.entry_stop_id().begin(), shard.entry_stop_id().end()},
+        {shard.exit_stop_id().begin(), shard.exit_stop_id().end()}
+    };
+}
+
+pb::SpatialIndex Bufferiser::Convert(const SpatialIndex::Grid& grid,
+                                     const std::vector<size_t>& stop_ids) {
+    pb::SpatialIndex converted;
+
+    *converted.mutable_min() = Convert(grid.bounds.min);
+    *converted.mutable_max() = Convert(grid.bounds.max);
+    converted.set_columns(grid.columns);
+    converted.set_rows(grid.rows);
+
+    for (const std::vector<size_t>& cell : grid.cells) {
+        pb::SpatialCell& converted_cell = *converted.add_cell();
+        for (const size_t id : cell)
+            converted_cell.add_stop_id(stop_ids.at(id));
+    }
+
+    return converted;
+}
+
+pb::StopBusIndex Bufferiser::Convert(const Catalogue::StopBusIndex& stop_buses,
+                                     const std::vector<size_t>& stop_ids) {
+    pb::StopBusIndex converted;
+
+    // Removed stops are served by no bus, so dropping their offsets is enough
+    converted.add_offset(0);
+    for (size_t id = 0; id < stop_ids.size(); ++id)
+        if (stop_ids[id] != REMOVED_ID)
+            converted.add_offset(stop_buses.offsets.at(id + 1));
+    *converted.mutable_bus_id() = {stop_buses.bus_ids.begin(), stop_buses.bus_ids.end()};
+    return converted;
+}
+
+Catalogue::StopBusIndex Bufferiser::Convert(const pb::StopBusIndex& stop_buses) {
+    return {
+        {stop_buses.offset().begin(), stop_buses.offset().end()},
+        {stop_buses.bus_id().begin(), stop_buses.bus_id().end()}
+    };
+}
+
+SpatialIndex::Grid Bufferiser::Convert(const pb::SpatialIndex& grid) {
+    SpatialIndex::Grid converted;
+
+    converted.bounds = {
+        {grid.min().lat(), grid.min().lng()},
+        {grid.max().lat(), grid.max().lng()}
+    };
+    converted.columns = grid.columns();
+    converted.rows = grid.rows();
+
+    converted.cells.reserve(grid.cell_size());
+    for (const pb::SpatialCell& cell : grid.cell())
+        converted.cells.emplace_back(cell.stop_id().begin(), cell.stop_id().end());
+
+    return converted;
 }
 
 pb::renderer::Settings Bufferiser::Convert(
@@ -126,12 +269,18 @@ renderer::Settings Bufferiser::Convert(
         if (name == "none") {
             return svg::Color();
         } else if (name.substr(0, 3) == "rgb") {
-            size_t begin = name.find_first_of('(') + 1;
-            size_t end = begin + name.find_first_of('(') - 2;
-            const auto color = ParseIntegerContainer(name.substr(begin, end));
+            const size_t begin = name.find_first_of('(') + 1;
+            const size_t end = name.find_first_of(')', begin);
+            const auto color = ParseNumberContainer(name.substr(begin, end - begin));
+            if (color.size() != 3 && color.size() != 4)
+                throw std::invalid_argument("unable to convert '" + name + "' to color");
+
+            const auto channel = [&color](const size_t i) {
+                return static_cast<uint8_t>(color[i]);
+            };
             return (color.size() == 3)
-                   ? svg::Color(svg::Rgb(color[0], color[1], color[2]))
-                   : svg::Color(svg::Rgba(color[0], color[1], color[2], color[3]));
+                   ? svg::Color(svg::Rgb(channel(0), channel(1), channel(2)))
+                   : svg::Color(svg::Rgba(channel(0), channel(1), channel(2), color[3]));
         } else {
             return svg::Color(name);
         }
@@ -152,28 +301,45 @@ renderer::Settings Bufferiser::Convert(
 }
 
 graph::pb::Graph Bufferiser::Convert(
-    const graph::DirectedWeightedGraph<double>& graph
+    const graph::DirectedWeightedGraph<double>& graph,
+    const std::vector<size_t>& stop_ids
 ) {
     graph::pb::Graph converted;
 
+    // Vertices follow their stops, 2*id and 2*id + 1
+    const auto convert_vertex = [&stop_ids](const graph::VertexId vertex) {
+        const size_t stop_id = stop_ids.at(vertex/2);
+        return (stop_id == REMOVED_ID) ? REMOVED_ID : 2*stop_id + vertex%2;
+    };
+
     // edge = 1
+    std::vector<size_t> edge_ids(graph.GetEdgeCount(), REMOVED_ID);
     for (graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
         const auto& edge = graph.GetEdge(edge_id);
+        const size_t from = convert_vertex(edge.from);
+        const size_t to = convert_vertex(edge.to);
+        if (from == REMOVED_ID || to == REMOVED_ID)
+            continue;
 
         graph::pb::Edge converted_edge;
-        converted_edge.set_from(edge.from);
-        converted_edge.set_to(edge.to);
+        converted_edge.set_from(from);
+        converted_edge.set_to(to);
         converted_edge.set_weight(edge.weight);
+        edge_ids[edge_id] = converted.edge_size();
         *converted.add_edge() = converted_edge;
     }
 
     // incidence_list = 2
     for (graph::VertexId vertex = 0; vertex < graph.GetVertexCount(); ++vertex) {
-        graph::pb::IncidenceList edge_ids;
+        if (convert_vertex(vertex) == REMOVED_ID)
+            continue;
+
+        graph::pb::IncidenceList converted_ids;
         for (const graph::EdgeId id : graph.GetIncidentEdges(vertex))
-            edge_ids.add_edge_id(id);
+            if (edge_ids[id] != REMOVED_ID)
+                converted_ids.add_edge_id(edge_ids[id]);
 
-        *converted.add_incidence_list() = edge_ids;
+        *converted.add_incidence_list() = converted_ids;
     }
 
     return converted;
@@ -206,51 +372,48 @@ graph::DirectedWeightedGraph<double> Bufferiser::Convert(
     return {edges, incidence_lists};
 }
 
-pb::domain::Stop Bufferiser::Convert(const domain::Stop& stop) const {
+pb::domain::Stop Bufferiser::Convert(const domain::Stop& stop,
+                                     const std::vector<size_t>& stop_ids) {
     pb::domain::Stop converted;
 
-    converted.set_id(request_handler_.GetCatalogue().GetStopId(stop.name));
+    converted.set_id(stop_ids.at(stop.id));
+    converted.set_name(stop.name);
     converted.set_wait_time(stop.wait_time);
 
-    geo::pb::Coordinates coordinates;
-    coordinates.set_lat(stop.coords.lat);
-    coordinates.set_lng(stop.coords.lng);
-    *converted.mutable_coords() = coordinates;
+    *converted.mutable_coords() = Convert(stop.coords);
 
     return converted;
 }
 
 pb::domain::AdjacentStops Bufferiser::Convert(
-    const Catalogue::AdjacentStops adjacent_stops,
-    const int distance
-) const {
+    const size_t id,
+    const Catalogue::Adjacent& adjacent
+) {
     pb::domain::AdjacentStops converted;
 
-    const Catalogue& catalogue = request_handler_.GetCatalogue();
-    converted.set_id(catalogue.GetStopId(adjacent_stops.first->name));
-    converted.set_adjacent_id(catalogue.GetStopId(adjacent_stops.first->name));
-    converted.set_distance(distance);
+    converted.set_id(id);
+    converted.set_adjacent_id(adjacent.id);
+    converted.set_distance(adjacent.distance);
 
     return converted;
 }
 
-pb::domain::Bus Bufferiser::Convert(const domain::Bus& bus) const {
+pb::domain::Bus Bufferiser::Convert(const domain::Bus& bus,
+                                    const std::vector<size_t>& stop_ids) {
     pb::domain::Bus converted;
 
     converted.set_name(bus.name);
     converted.set_is_roundtrip(bus.is_roundtrip);
     converted.set_velocity(bus.velocity);
 
-    const transport::Catalogue& catalogue = request_handler_.GetCatalogue();
     for (const domain::StopPtr& stop_ptr : bus.stops)
-        converted.add_stop_id(catalogue.GetStopId(stop_ptr->name));
+        converted.add_stop_id(stop_ids.at(stop_ptr->id));
 
     return converted;
 }
 
-domain::Bus Bufferiser::Convert(const pb::domain::Bus& bus) const {
-    const transport::Catalogue& catalogue = request_handler_.GetCatalogue();
-
+domain::Bus Bufferiser::Convert(const pb::domain::Bus& bus,
+                                const Catalogue& catalogue) {
     std::vector<domain::StopPtr> stops;
     stops.reserve(bus.stop_id_size());
     for (int i = 0; i < bus.stop_id_size(); ++i)
@@ -9,6 +9,7 @@
 #include <sstream>
 
 #include "request_handler.h"
+#include "shard.h"
 
 namespace transport {
 namespace io {
@@ -19,11 +20,20 @@ public:
         : request_handler_(request_handler) {
     }
 
-    void Serialize(std::ostream& out) const;
+    void Serialize(std::ostream& out,
+                   const std::optional<ShardInfo>& shard = std::nullopt) const;
 
-    void Deserialize(std::istream& in);
+    // Fills the catalogue viewed by the request handler, shard databases
+    // also return their region. The route table is computed from the stored
+    // graph only if asked for, otherwise the router of the handler is kept
+    std::optional<ShardInfo> Deserialize(std::istream& in,
+                                         Catalogue& catalogue,
+                                         const bool is_routed = false);
 
 private:
+    // Marks ids of removed stops while renumbering the rest
+    static constexpr size_t REMOVED_ID = static_cast<size_t>(-1);
+
     RequestHandler& request_handler_;
 
     inline static svg::pb::Point Convert(const svg::Point& point) {
@@ -41,28 +51,54 @@ private:
         return converted;
     }
 
+    inline static geo::pb::Coordinates Convert(const geo::Coordinates& coords) {
+        geo::pb::Coordinates converted;
+        converted.set_lat(coords.lat);
+        converted.set_lng(coords.lng);
+        return converted;
+    }
+
+    static pb::SpatialIndex Convert(const SpatialIndex::Grid& grid,
+                                    const std::vector<size_t>& stop_ids);
+
+    static SpatialIndex::Grid Convert(const pb::SpatialIndex& grid);
+
+    static pb::StopBusIndex Convert(const Catalogue::StopBusIndex& stop_buses,
+                                    const std::vector<size_t>& stop_ids);
+
+    static Catalogue::StopBusIndex Convert(const pb::StopBusIndex& stop_buses);
+
     static pb::renderer::Settings Convert(const renderer::Settings& settings);
 
     static renderer::Settings Convert(const pb::renderer::Settings& settings);
 
     static graph::pb::Graph Convert(
-        const graph::DirectedWeightedGraph<double>& graph
+        const graph::DirectedWeightedGraph<double>& graph,
+        const std::vector<size_t>& stop_ids
     );
 
     static graph::DirectedWeightedGraph<double> Convert(
         const graph::pb::Graph& graph
     );
 
-    pb::domain::Stop Convert(const domain::Stop& stop) const;
+    static pb::Shard Convert(const ShardInfo& shard,
+                             const std::vector<size_t>& stop_ids);
+
+    static ShardInfo Convert(const pb::Shard& shard);
 
-    pb::domain::AdjacentStops Convert(
-        const Catalogue::AdjacentStops adjacent_stops,
-        const int distance
-    ) const;
+    static pb::domain::Stop Convert(const domain::Stop& stop,
+                                    const std::vector<size_t>& stop_ids);
+
+    static pb::domain::AdjacentStops Convert(
+        const size_t id,
+        const Catalogue::Adjacent& adjacent
+    );
 
-    pb::domain::Bus Convert(const domain::Bus& bus) const;
+    static pb::domain::Bus Convert(const domain::Bus& bus,
+                                   const std::vector<size_t>& stop_ids);
 
-    domain::Bus Convert(const pb::domain::Bus& bus) const;
+    static domain::Bus Convert(const pb::domain::Bus& bus,
+                               const Catalogue& catalogue);
 };
 
 } // namespace io
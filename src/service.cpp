@@ -0,0 +1,129 @@
+#include "service.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <json/json_parser.h>
+#include <json/json_writer.h>
+
+#include <cerrno>
+#include <chrono>
+#include <future>
+#include <list>
+#include <optional>
+#include <stdexcept>
+
+#include "socket.h"
+
+namespace transport {
+namespace io {
+
+namespace {
+
+// Id of a request which has been parsed but not understood
+std::optional<int> FindRequestId(const json::Document& document) {
+    if (!document.GetRoot().IsDict())
+        return std::nullopt;
+    const json::Dict& request = document.GetRoot().AsDict();
+    const auto it = request.find("id");
+    if (it == request.end() || !it->second.IsInt())
+        return std::nullopt;
+    return it->second.AsInt();
+}
+
+void WriteVersion(json::Writer& writer,
+                  const std::optional<int> id,
+                  const uint64_t version) {
+    writer.StartDict();
+    if (id)
+        writer.Key("request_id").Int(*id);
+    writer.Key("version").Int(static_cast<int>(version)).EndDict();
+}
+
+void WriteError(json::Writer& writer,
+                const std::optional<int> id,
+                const std::string_view message) {
+    writer.StartDict().Key("error_message").String(message);
+    if (id)
+        writer.Key("request_id").Int(*id);
+    writer.EndDict();
+}
+
+} // namespace
+
+// ---------- Service -----------------
+
+void ServeLines(VersionedCatalogue& versioned,
+                const JsonReader& reader,
+                std::istream& input,
+                std::ostream& output) {
+    json::PrintSettings settings = reader.GeneratePrintSettings();
+    settings.is_pretty = false;
+    json::Writer writer(output, std::move(settings));
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        // Handler calls are made before a response starts, so a failed
+        // request leaves nothing half-written
+        std::optional<json::Document> document;
+        try {
+            document = json::Load(line);
+            const json::Dict& request = document->GetRoot().AsDict();
+            if (JsonReader::IsDelta(request)) {
+                const SnapshotPtr snapshot = versioned.Update([&request](Catalogue& db) {
+                    db.Update({ParseDelta(db, request)});
+                });
+                WriteVersion(writer, FindRequestId(*document), snapshot->version);
+            } else {
+                const StatRequest stat_request = JsonReader::ParseStat(request);
+                WriteResponse(versioned.Pin()->handler, reader, stat_request, writer);
+            }
+        } catch (const std::exception& e) {
+            WriteError(writer, document ? FindRequestId(*document) : std::nullopt, e.what());
+        }
+
+        writer.Flush();
+        output.put('\n');
+        if (!output.flush())
+            break;
+    }
+}
+
+void ServeSocket(const std::string& socket_name,
+                 VersionedCatalogue& versioned,
+                 const JsonReader& reader) {
+    const int listener = Listen(socket_name);
+
+    // Connections finished by the time the next one comes are let go
+    std::list<std::future<void>> connections;
+    while (true) {
+        const int socket = ::accept(listener, nullptr, nullptr);
+        if (socket < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        connections.remove_if([](const std::future<void>& connection) {
+            return connection.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        connections.push_back(std::async(std::launch::async, [&, socket]() {
+            {
+                SocketBuffer buffer(socket);
+                std::iostream stream(&buffer);
+                ServeLines(versioned, reader, stream, stream);
+            }
+            ::close(socket);
+        }));
+    }
+
+    connections.clear(); // waits for the ones still open
+    ::close(listener);
+    ::unlink(socket_name.c_str());
+}
+
+} // namespace io
+} // namespace transport
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+#include "json_reader.h"
+#include "snapshot.h"
+
+namespace transport {
+namespace io {
+
+// ---------- Service -----------------
+
+// Answers stat requests given one per line with one response line each, in
+// the output_settings of the reader but never indented. Each one is answered
+// from the latest snapshot, a delta request publishes the next one and gets
+// its version back. A request that fails gets an error_message response and
+// the stream goes on
+void ServeLines(VersionedCatalogue& versioned,
+                const JsonReader& reader,
+                std::istream& input,
+                std::ostream& output);
+
+// Serves the lines of each connection to a local Unix socket on a thread of
+// its own, so a slow client does not hold up the others
+void ServeSocket(const std::string& socket_name,
+                 VersionedCatalogue& versioned,
+                 const JsonReader& reader);
+
+} // namespace io
+} // namespace transport
@@ -0,0 +1,631 @@
+#include "shard.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <json/json_parser.h>
+#include <json/json_writer.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "socket.h"
+
+namespace transport {
+
+using domain::BusPtr, domain::StopPtr;
+using io::ReadAll, io::WriteAll;
+
+namespace {
+
+// ---------- Partition ---------------
+
+void Bisect(const Catalogue& db,
+            const std::vector<size_t>::iterator first,
+            const std::vector<size_t>::iterator last,
+            const uint32_t shard,
+            const size_t shard_count,
+            std::vector<uint32_t>& owners) {
+    if (shard_count == 1 || std::distance(first, last) < 2) {
+        for (auto it = first; it != last; ++it)
+            owners[*it] = shard;
+        return;
+    }
+
+    geo::Coordinates min = db.GetStop(*first)->coords;
+    geo::Coordinates max = min;
+    for (auto it = first; it != last; ++it) {
+        const geo::Coordinates& coords = db.GetStop(*it)->coords;
+        min = {std::min(min.lat, coords.lat), std::min(min.lng, coords.lng)};
+        max = {std::max(max.lat, coords.lat), std::max(max.lng, coords.lng)};
+    }
+
+    // Cut across the longer side so that regions stay compact
+    const double lng_scale = std::cos((min.lat + max.lat)/2*M_PI/180.);
+    const bool is_lat_cut = (max.lat - min.lat) >= (max.lng - min.lng)*lng_scale;
+
+    const size_t left_count = shard_count/2;
+    const auto middle = first + std::distance(first, last)*left_count/shard_count;
+    std::nth_element(first, middle, last, [&](const size_t lhs, const size_t rhs) {
+        const geo::Coordinates& lhs_coords = db.GetStop(lhs)->coords;
+        const geo::Coordinates& rhs_coords = db.GetStop(rhs)->coords;
+        return is_lat_cut ? lhs_coords.lat < rhs_coords.lat
+                          : lhs_coords.lng < rhs_coords.lng;
+    });
+
+    Bisect(db, first, middle, shard, left_count, owners);
+    Bisect(db, middle, last, shard + left_count, shard_count - left_count, owners);
+}
+
+// Calls visit(stop, shard) for every stop a ride from a stop owned by
+// another shard can end at, in both directions of non-roundtrip buses
+template <typename Visit>
+void ForEachCrossing(const BusPtr& bus_ptr,
+                     const std::vector<uint32_t>& owners,
+                     Visit visit) {
+    const auto walk = [&](const auto first, const auto last) {
+        std::set<uint32_t> boarded;
+        for (auto it = first; it != last; ++it) {
+            const uint32_t owner = owners[(*it)->id];
+            for (const uint32_t shard : boarded)
+                if (shard != owner)
+                    visit(*it, shard);
+            boarded.insert(owner);
+        }
+    };
+
+    const std::vector<StopPtr>& stops = bus_ptr->stops;
+    walk(stops.begin(), stops.end());
+    if (!bus_ptr->is_roundtrip)
+        walk(stops.rbegin(), stops.rend());
+}
+
+// ---------- Framing -----------------
+
+// Frames are JSON documents on one line prefixed by their native-endian
+// length, both ends run on the same host. Stat responses keep the precision
+// process_requests prints with, distance tables are summed up by the
+// coordinator and travel exactly
+json::PrintSettings GetFrameSettings(const bool is_exact) {
+    json::PrintSettings settings;
+    settings.is_pretty = false;
+    if (is_exact)
+        settings.precision = json::PrintSettings::ROUND_TRIP;
+    return settings;
+}
+
+void WritePayload(const int socket, const std::string& payload) {
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+    WriteAll(socket, reinterpret_cast<const char*>(&size), sizeof(size));
+    WriteAll(socket, payload.data(), payload.size());
+}
+
+void WriteFrame(const int socket, const json::Node& node, const bool is_exact = false) {
+    std::ostringstream out;
+    json::Writer(out, GetFrameSettings(is_exact)).Value(node);
+    WritePayload(socket, out.str());
+}
+
+// The containers of each frame are laid out in its own arena, released with
+// the document
+std::optional<json::Document> ReadFrame(const int socket) {
+    uint32_t size = 0;
+    if (!ReadAll(socket, reinterpret_cast<char*>(&size), sizeof(size)))
+        return std::nullopt;
+
+    std::string payload(size, '\0');
+    if (!ReadAll(socket, payload.data(), size))
+        throw std::runtime_error("shard socket closed mid-frame");
+
+    return json::Load(payload, std::make_shared<json::Arena>());
+}
+
+// ---------- Shard requests ----------
+
+json::Array ConvertToNames(const Catalogue& db, const std::vector<size_t>& ids) {
+    json::Array names;
+    names.reserve(ids.size());
+    for (const size_t id : ids)
+        names.push_back(db.GetStop(id)->name);
+    return names;
+}
+
+json::Array ComputeDistances(const io::RequestHandler& handler,
+                             const json::Array& from,
+                             const json::Array& to) {
+    json::Array table;
+    table.reserve(from.size());
+    for (const json::Node& start : from) {
+        json::Array row;
+        row.reserve(to.size());
+        for (const json::Node& finish : to) {
+            const std::optional<domain::Route> route = handler.GetRoute(
+                start.AsString(),
+                finish.AsString()
+            );
+            if (route)
+                row.emplace_back(route->timedelta);
+            else
+                row.emplace_back(nullptr);
+        }
+        table.push_back(std::move(row));
+    }
+    return table;
+}
+
+json::Node ConstructInfoRequest(const io::RequestHandler& handler,
+                                const ShardInfo& info) {
+    const Catalogue& db = handler.GetCatalogue();
+
+    json::Array stops;
+    for (const StopPtr& stop_ptr : db.GetStops())
+        if (!db.IsRemoved(stop_ptr) && info.owners.at(stop_ptr->id) == info.index)
+            stops.push_back(stop_ptr->name);
+
+    // Bus requests go to the owner of the first stop
+    json::Array buses;
+    for (const BusPtr& bus_ptr : db.GetBuses())
+        if (!bus_ptr->stops.empty()
+         && info.owners.at(bus_ptr->stops.front()->id) == info.index)
+            buses.push_back(bus_ptr->name);
+
+    json::Array entries = ConvertToNames(db, info.entries);
+    json::Array exits = ConvertToNames(db, info.exits);
+    json::Array table = ComputeDistances(handler, entries, exits);
+
+    return json::Builder{}.StartDict()
+        .Key("buses").Value(std::move(buses))
+        .Key("entries").Value(std::move(entries))
+        .Key("exits").Value(std::move(exits))
+        .Key("stops").Value(std::move(stops))
+        .Key("table").Value(std::move(table))
+    .EndDict()
+    .Build();
+}
+
+// Returns false once told to shut down
+bool AnswerFrame(const int socket,
+                 const json::Dict& request,
+                 const io::RequestHandler& handler,
+                 const ShardInfo& info) {
+    if (request.count("stat_requests")) {
+        std::ostringstream out;
+        json::Writer writer(out, GetFrameSettings(false));
+        io::Search(handler, io::JsonReader(request), writer);
+        writer.Flush();
+        WritePayload(socket, out.str());
+        return true;
+    }
+
+    const std::string& type_value = request.at("type").AsString();
+    if (type_value == "Info") {
+        WriteFrame(socket, ConstructInfoRequest(handler, info), true);
+    } else if (type_value == "Distances") {
+        WriteFrame(socket, ComputeDistances(
+            handler,
+            request.at("from").AsArray(),
+            request.at("to").AsArray()
+        ), true);
+    } else if (type_value == "Shutdown") {
+        return false;
+    } else {
+        throw std::invalid_argument("unknown shard request '" + type_value + "'");
+    }
+    return true;
+}
+
+} // namespace
+
+// ---------- Partition ---------------
+
+std::vector<Shard> Partition(const Catalogue& db, const size_t shard_count) {
+    if (!shard_count)
+        throw std::invalid_argument("shard count must be positive");
+
+    std::vector<size_t> ids;
+    ids.reserve(db.GetStopCount());
+    for (const StopPtr& stop_ptr : db.GetStops())
+        if (!db.IsRemoved(stop_ptr))
+            ids.push_back(stop_ptr->id);
+
+    std::vector<uint32_t> owners(db.GetStopCount(), 0);
+    Bisect(db, ids.begin(), ids.end(), 0, shard_count, owners);
+
+    // Shards keep owned stops and every stop of the buses serving them
+    std::vector<std::vector<bool>> is_included(
+        shard_count,
+        std::vector<bool>(db.GetStopCount(), false)
+    );
+    for (const size_t id : ids)
+        is_included[owners[id]][id] = true;
+
+    std::vector<std::vector<BusPtr>> shard_buses(shard_count);
+    for (const BusPtr& bus_ptr : db.GetBuses()) {
+        std::set<uint32_t> served;
+        for (const StopPtr& stop_ptr : bus_ptr->stops)
+            served.insert(owners[stop_ptr->id]);
+
+        for (const uint32_t shard : served) {
+            shard_buses[shard].push_back(bus_ptr);
+            for (const StopPtr& stop_ptr : bus_ptr->stops)
+                is_included[shard][stop_ptr->id] = true;
+        }
+    }
+
+    std::vector<std::set<size_t>> entries(shard_count);
+    std::vector<std::set<size_t>> exits(shard_count);
+    for (const BusPtr& bus_ptr : db.GetBuses())
+        ForEachCrossing(bus_ptr, owners, [&](const StopPtr& stop_ptr, const uint32_t shard) {
+            entries[owners[stop_ptr->id]].insert(stop_ptr->id);
+            exits[shard].insert(stop_ptr->id);
+        });
+
+    std::vector<Shard> shards(shard_count);
+    for (size_t index = 0; index < shard_count; ++index) {
+        Shard& shard = shards[index];
+        const std::vector<bool>& included = is_included[index];
+
+        std::vector<size_t> local_ids(db.GetStopCount(), 0);
+        std::vector<domain::Stop> stops;
+        for (size_t id = 0; id < db.GetStopCount(); ++id)
+            if (included[id]) {
+                const StopPtr& stop_ptr = db.GetStop(id);
+                local_ids[id] = stops.size();
+                stops.push_back({stop_ptr->name, stop_ptr->coords, stop_ptr->wait_time});
+                shard.info.owners.push_back(owners[id]);
+            }
+        shard.catalogue.AddStops(std::move(stops));
+
+        std::vector<Catalogue::Distance> distances;
+        for (size_t id = 0; id < db.GetStopCount(); ++id)
+            if (included[id])
+                for (const Catalogue::Adjacent& adjacent : db.GetAdjacent(id))
+                    if (adjacent.is_explicit && included[adjacent.id])
+                        distances.push_back({
+                            local_ids[id],
+                            local_ids[adjacent.id],
+                            adjacent.distance
+                        });
+        shard.catalogue.MakeAdjacent(distances);
+
+        std::vector<domain::Bus> buses;
+        buses.reserve(shard_buses[index].size());
+        for (const BusPtr& bus_ptr : shard_buses[index]) {
+            std::vector<StopPtr> bus_stops;
+            bus_stops.reserve(bus_ptr->stops.size());
+            for (const StopPtr& stop_ptr : bus_ptr->stops)
+                bus_stops.push_back(shard.catalogue.GetStop(local_ids[stop_ptr->id]));
+
+            buses.push_back({
+                bus_ptr->name,
+                std::move(bus_stops),
+                bus_ptr->is_roundtrip,
+                bus_ptr->velocity
+            });
+        }
+        shard.catalogue.AddBuses(std::move(buses));
+
+        shard.info.index = index;
+        shard.info.count = shard_count;
+        for (const size_t id : entries[index])
+            shard.info.entries.push_back(local_ids[id]);
+        for (const size_t id : exits[index])
+            shard.info.exits.push_back(local_ids[id]);
+    }
+
+    return shards;
+}
+
+std::string GetShardFileName(const std::string& file_name, const size_t index) {
+    return file_name + '.' + std::to_string(index);
+}
+
+std::string GetShardSocketName(const std::string& file_name, const size_t index) {
+    return GetShardFileName(file_name, index) + ".sock";
+}
+
+namespace io {
+
+// ---------- Shard server ------------
+
+void ServeShard(const std::string& socket_name,
+                const RequestHandler& handler,
+                const ShardInfo& info) {
+    const int listener = Listen(socket_name);
+
+    bool is_running = true;
+    while (is_running) {
+        const int socket = ::accept(listener, nullptr, nullptr);
+        if (socket < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        try {
+            while (const std::optional<json::Document> frame = ReadFrame(socket)) {
+                // A request that fails gets an error frame and the next one
+                // is read, as the frames are complete either way
+                try {
+                    if (!AnswerFrame(socket, frame->GetRoot().AsDict(), handler, info)) {
+                        is_running = false;
+                        break;
+                    }
+                } catch (const std::exception& e) {
+                    WriteFrame(socket, json::Builder{}.StartDict()
+                        .Key("error_message").Value(std::string(e.what()))
+                    .EndDict()
+                    .Build());
+                }
+            }
+        } catch (const std::exception&) {
+            // The coordinator is gone, the next one may connect
+        }
+        ::close(socket);
+    }
+
+    ::close(listener);
+    ::unlink(socket_name.c_str());
+}
+
+// ---------- Coordinator -------------
+
+Coordinator::Coordinator(const std::string& file_name, const size_t shard_count)
+        : regions_(shard_count) {
+    for (size_t shard = 0; shard < shard_count; ++shard) {
+        Region& region = regions_[shard];
+        region.socket = Connect(GetShardSocketName(file_name, shard));
+
+        const json::Node info = Send(shard, json::Builder{}.StartDict()
+            .Key("type").Value("Info")
+        .EndDict()
+        .Build());
+        const json::Dict& dict = info.AsDict();
+
+        for (const json::Node& name : dict.at("stops").AsArray())
+            stop_owners_.emplace(name.AsString(), shard);
+        for (const json::Node& name : dict.at("buses").AsArray())
+            bus_owners_.emplace(name.AsString(), shard);
+        for (const json::Node& name : dict.at("entries").AsArray())
+            region.entries.push_back(name.AsString());
+        for (const json::Node& name : dict.at("exits").AsArray())
+            region.exits.push_back(name.AsString());
+
+        for (const json::Node& row : dict.at("table").AsArray()) {
+            std::vector<std::optional<double>>& distances = region.table.emplace_back();
+            for (const json::Node& distance : row.AsArray())
+                distances.push_back(
+                    distance.IsNull() ? std::nullopt : std::make_optional(distance.AsDouble())
+                );
+        }
+    }
+}
+
+Coordinator::~Coordinator() {
+    for (const Region& region : regions_)
+        if (region.socket >= 0)
+            ::close(region.socket);
+}
+
+void Coordinator::Shutdown() const {
+    for (const Region& region : regions_)
+        WriteFrame(region.socket, json::Builder{}.StartDict()
+            .Key("type").Value("Shutdown")
+        .EndDict()
+        .Build());
+}
+
+json::Node Coordinator::Send(const size_t shard, const json::Node& request) const {
+    const int socket = regions_.at(shard).socket;
+    WriteFrame(socket, request);
+    const std::optional<json::Document> response = ReadFrame(socket);
+    if (!response)
+        throw std::runtime_error("shard " + std::to_string(shard) + " closed the connection");
+
+    const json::Node& root = response->GetRoot();
+    if (root.IsDict() && root.AsDict().count("error_message"))
+        throw std::runtime_error(
+            "shard " + std::to_string(shard) + ": "
+            + root.AsDict().at("error_message").AsString()
+        );
+    return root;
+}
+
+Coordinator::Table Coordinator::GetDistances(
+    const size_t shard,
+    const std::vector<std::string>& from,
+    const std::vector<std::string>& to
+) const {
+    const json::Node response = Send(shard, json::Builder{}.StartDict()
+        .Key("from").Value(json::Array(from.begin(), from.end()))
+        .Key("to").Value(json::Array(to.begin(), to.end()))
+        .Key("type").Value("Distances")
+    .EndDict()
+    .Build());
+
+    Table table;
+    for (const json::Node& row : response.AsArray()) {
+        std::vector<std::optional<double>>& distances = table.emplace_back();
+        for (const json::Node& distance : row.AsArray())
+            distances.push_back(
+                distance.IsNull() ? std::nullopt : std::make_optional(distance.AsDouble())
+            );
+    }
+    return table;
+}
+
+json::Node Coordinator::FindRoute(const int id,
+                                  const std::string& from,
+                                  const std::string& to) const {
+    const json::Node not_found = json::Builder{}.StartDict()
+        .Key("error_message").Value("not found")
+        .Key("request_id").Value(id)
+    .EndDict()
+    .Build();
+
+    const auto from_owner = stop_owners_.find(from);
+    const auto to_owner = stop_owners_.find(to);
+    if (from_owner == stop_owners_.end() || to_owner == stop_owners_.end())
+        return not_found;
+
+    // Overlay graph over the boundary stops, the route's start and finish
+    struct Arc {
+        size_t to;
+        double weight;
+        size_t shard;
+    };
+    std::unordered_map<std::string, size_t> node_ids{{from, 0}};
+    std::vector<std::string> names{from};
+    std::vector<std::vector<Arc>> arcs(1);
+    const auto get_node = [&](const std::string& name) {
+        const auto [it, is_inserted] = node_ids.emplace(name, names.size());
+        if (is_inserted) {
+            names.push_back(name);
+            arcs.emplace_back();
+        }
+        return it->second;
+    };
+    const auto add_arcs = [&](const size_t shard,
+                              const std::vector<std::string>& sources,
+                              const std::vector<std::string>& targets,
+                              const Table& table) {
+        for (size_t i = 0; i < sources.size(); ++i)
+            for (size_t j = 0; j < targets.size(); ++j)
+                if (table[i][j]) {
+                    const size_t source = get_node(sources[i]);
+                    const size_t target = get_node(targets[j]);
+                    arcs[source].push_back({target, *table[i][j], shard});
+                }
+    };
+
+    const size_t first_shard = from_owner->second;
+    const size_t last_shard = to_owner->second;
+
+    std::vector<std::string> first_targets = regions_[first_shard].exits;
+    if (first_shard == last_shard)
+        first_targets.push_back(to);
+    add_arcs(first_shard, {from}, first_targets,
+             GetDistances(first_shard, {from}, first_targets));
+
+    for (size_t shard = 0; shard < regions_.size(); ++shard)
+        add_arcs(shard, regions_[shard].entries, regions_[shard].exits,
+                 regions_[shard].table);
+
+    const std::vector<std::string>& last_entries = regions_[last_shard].entries;
+    add_arcs(last_shard, last_entries, {to},
+             GetDistances(last_shard, last_entries, {to}));
+
+    const size_t target = get_node(to);
+
+    // Dijkstra from the start
+    static const double INF = std::numeric_limits<double>::infinity();
+    struct Step {
+        size_t from;
+        size_t shard;
+    };
+    std::vector<double> distances(names.size(), INF);
+    std::vector<std::optional<Step>> previous(names.size());
+    using Item = std::pair<double, size_t>;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+    distances[0] = 0;
+    queue.push({0, 0});
+    while (!queue.empty()) {
+        const auto [distance, node] = queue.top();
+        queue.pop();
+        if (distance > distances[node] || node == target)
+            continue;
+
+        for (const Arc& arc : arcs[node])
+            if (distance + arc.weight < distances[arc.to]) {
+                distances[arc.to] = distance + arc.weight;
+                previous[arc.to] = Step{node, arc.shard};
+                queue.push({distances[arc.to], arc.to});
+            }
+    }
+
+    if (distances[target] == INF)
+        return not_found;
+
+    // Legs in travel order are answered by their shards
+    std::vector<std::pair<size_t, Step>> legs; // finish and its step
+    for (size_t node = target; previous[node]; node = previous[node]->from)
+        legs.push_back({node, *previous[node]});
+    std::reverse(legs.begin(), legs.end());
+
+    json::Array items;
+    for (const auto& [finish, step] : legs) {
+        const json::Node response = Send(step.shard, json::Builder{}.StartDict()
+            .Key("stat_requests").StartArray()
+                .StartDict()
+                    .Key("from").Value(names[step.from])
+                    .Key("id").Value(id)
+                    .Key("to").Value(names[finish])
+                    .Key("type").Value("Route")
+                .EndDict()
+            .EndArray()
+        .EndDict()
+        .Build());
+
+        const json::Dict& route = response.AsArray().front().AsDict();
+        if (!route.count("items"))
+            return not_found;
+        for (const json::Node& item : route.at("items").AsArray())
+            items.push_back(item);
+    }
+
+    return json::Builder{}.StartDict()
+        .Key("items").Value(std::move(items))
+        .Key("request_id").Value(id)
+        .Key("total_time").Value(distances[target])
+    .EndDict()
+    .Build();
+}
+
+void Coordinator::Search(const JsonReader& reader, json::Writer& writer) const {
+    writer.StartArray();
+    for (const StatRequest& request : reader.GetStats()) {
+        const int id = request.id;
+
+        if (const auto* route = std::get_if<StatRequest::Route>(&request.query)) {
+            writer.Value(FindRoute(id, route->from, route->to));
+            continue;
+        }
+
+        const std::unordered_map<std::string, size_t>* owners = nullptr;
+        const std::string* name = nullptr;
+        if (const auto* bus = std::get_if<StatRequest::Bus>(&request.query)) {
+            owners = &bus_owners_;
+            name = &bus->name;
+        } else if (const auto* stop = std::get_if<StatRequest::Stop>(&request.query)) {
+            owners = &stop_owners_;
+            name = &stop->name;
+        }
+
+        const auto owner = owners
+                           ? owners->find(*name)
+                           : std::unordered_map<std::string, size_t>::const_iterator{};
+        if (!owners || owner == owners->end()) {
+            writer.StartDict()
+                .Key("error_message").String(owners ? "not found" : "not supported by shards")
+                .Key("request_id").Int(id)
+            .EndDict();
+            continue;
+        }
+
+        const json::Node response = Send(owner->second, json::Builder{}.StartDict()
+            .Key("stat_requests").Value(json::Array{ConvertToNode(request)})
+        .EndDict()
+        .Build());
+        writer.Value(response.AsArray().front());
+    }
+    writer.EndArray();
+}
+
+} // namespace io
+} // namespace transport
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "catalogue.h"
+#include "json_reader.h"
+#include "request_handler.h"
+
+namespace transport {
+
+// ---------- ShardInfo ---------------
+
+// Region of a sharded catalogue. Besides the owned stops the shard catalogue
+// holds every stop of the buses serving them, so each bus ride starting in
+// the region stays inside its graph and a cross-shard route splits at the
+// arrivals to foreign stops
+struct ShardInfo {
+    size_t index = 0;
+    size_t count = 1;
+    std::vector<uint32_t> owners; // owning shard by stop id
+    std::vector<size_t> entries; // owned stops reached from other shards
+    std::vector<size_t> exits; // foreign stops reached from owned ones
+};
+
+struct Shard {
+    Catalogue catalogue;
+    ShardInfo info;
+};
+
+// Splits live stops into shard_count regions by recursive coordinate bisection
+std::vector<Shard> Partition(const Catalogue& db, const size_t shard_count);
+
+std::string GetShardFileName(const std::string& file_name, const size_t index);
+
+std::string GetShardSocketName(const std::string& file_name, const size_t index);
+
+namespace io {
+
+// Answers coordinator requests on a local Unix socket until told to shut down.
+// A request that fails gets an error_message frame, which the coordinator
+// raises as an error
+void ServeShard(const std::string& socket_name,
+                const RequestHandler& handler,
+                const ShardInfo& info);
+
+// ---------- Coordinator -------------
+
+// Sends Bus and Stop requests to the owning shards and combines Route ones
+// from the shards' boundary distance tables
+class Coordinator {
+public:
+    Coordinator(const std::string& file_name, const size_t shard_count);
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    ~Coordinator();
+
+    // Writes the responses as an array, each one as soon as it is answered
+    void Search(const JsonReader& reader, json::Writer& writer) const;
+
+    // Stops the shard processes
+    void Shutdown() const;
+
+private:
+    using Table = std::vector<std::vector<std::optional<double>>>;
+
+    struct Region {
+        int socket = -1;
+        std::vector<std::string> entries;
+        std::vector<std::string> exits;
+        Table table; // entries to exits
+    };
+
+    std::vector<Region> regions_;
+    std::unordered_map<std::string, size_t> stop_owners_;
+    std::unordered_map<std::string, size_t> bus_owners_;
+
+    json::Node Send(const size_t shard, const json::Node& request) const;
+
+    Table GetDistances(const size_t shard,
+                       const std::vector<std::string>& from,
+                       const std::vector<std::string>& to) const;
+
+    json::Node FindRoute(const int id,
+                         const std::string& from,
+                         const std::string& to) const;
+};
+
+} // namespace io
+} // namespace transport
@@ -0,0 +1,32 @@
+#include "snapshot.h"
+
+namespace transport {
+
+// ---------- VersionedCatalogue ------
+
+SnapshotPtr VersionedCatalogue::Publish(Catalogue db) {
+    std::lock_guard<std::mutex> guard(writer_mutex_);
+    return PublishLocked(std::move(db));
+}
+
+SnapshotPtr VersionedCatalogue::PublishLocked(Catalogue db) {
+    const SnapshotPtr previous = Pin();
+
+    // The expensive part is built before readers can see the new version
+    db.EnsureIndexed();
+    std::shared_ptr<const Router> router
+        = (db.GetRouteStamp() == previous->catalogue.GetRouteStamp())
+        ? previous->handler.ShareRouter()
+        : std::make_shared<const Router>(db);
+    SnapshotPtr next = std::make_shared<const Snapshot>(
+        std::move(db),
+        previous->handler.GetRendererSettings(),
+        std::move(router),
+        previous->version + 1
+    );
+
+    std::atomic_store_explicit(&current_, next, std::memory_order_release);
+    return next;
+}
+
+} // namespace transport
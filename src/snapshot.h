@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "catalogue.h"
+#include "map_renderer.h"
+#include "request_handler.h"
+
+namespace transport {
+
+// ---------- Snapshot ----------------
+
+// Immutable catalogue version together with the structures derived from it.
+// Copies of the catalogue share every index they leave unchanged with their
+// ancestors, which is why the catalogue is indexed before it is published
+struct Snapshot {
+    Snapshot(Catalogue db, renderer::Settings settings, const uint64_t number)
+        : catalogue(std::move(db))
+        , handler(catalogue, std::move(settings))
+        , version(number) {
+        catalogue.EnsureIndexed();
+    }
+
+    Snapshot(Catalogue db,
+             renderer::Settings settings,
+             std::shared_ptr<const Router> router,
+             const uint64_t number)
+        : catalogue(std::move(db))
+        , handler(catalogue, std::move(settings), std::move(router))
+        , version(number) {
+        catalogue.EnsureIndexed();
+    }
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    const Catalogue catalogue;
+    const io::RequestHandler handler;
+    const uint64_t version;
+};
+using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+// ---------- VersionedCatalogue ------
+
+// Readers pin the current snapshot and keep it alive for as long as they use
+// it, writers are serialised and publish the next version atomically.
+// An old snapshot is released as soon as its last reader unpins it
+class VersionedCatalogue {
+public:
+    VersionedCatalogue(Catalogue db, renderer::Settings settings)
+        : current_(std::make_shared<const Snapshot>(
+              std::move(db), std::move(settings), 0
+          )) {
+    }
+
+    explicit VersionedCatalogue(SnapshotPtr snapshot)
+        : current_(std::move(snapshot)) {
+    }
+
+    inline SnapshotPtr Pin() const {
+        return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+    }
+
+    inline uint64_t GetVersion() const {
+        return Pin()->version;
+    }
+
+    // Applies modifier to a copy of the latest catalogue and publishes it.
+    // The router is rebuilt, which takes all-pairs routes and dominates the
+    // update, only if the stops or buses changed; otherwise the new version
+    // shares the previous one's. Writers wait for each other meanwhile
+    template <typename Modifier>
+    SnapshotPtr Update(Modifier modifier);
+
+    SnapshotPtr Publish(Catalogue db);
+
+private:
+    SnapshotPtr current_;
+    std::mutex writer_mutex_;
+
+    SnapshotPtr PublishLocked(Catalogue db);
+};
+
+template <typename Modifier>
+SnapshotPtr VersionedCatalogue::Update(Modifier modifier) {
+    std::lock_guard<std::mutex> guard(writer_mutex_);
+
+    Catalogue next = Pin()->catalogue;
+    modifier(next);
+    return PublishLocked(std::move(next));
+}
+
+} // namespace transport
@@ -0,0 +1,146 @@
+#include "socket.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace transport {
+namespace io {
+
+namespace {
+
+sockaddr_un MakeAddress(const std::string& socket_name) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_name.size() >= sizeof(address.sun_path))
+        throw std::invalid_argument("socket path is too long: " + socket_name);
+    std::strcpy(address.sun_path, socket_name.c_str());
+    return address;
+}
+
+int OpenSocket() {
+    const int socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0)
+        throw std::runtime_error("unable to open socket: "
+                                 + std::string(std::strerror(errno)));
+    return socket;
+}
+
+} // namespace
+
+// ---------- Unix sockets ------------
+
+int Listen(const std::string& socket_name) {
+    const sockaddr_un address = MakeAddress(socket_name);
+    const int listener = OpenSocket();
+    ::unlink(socket_name.c_str());
+    if (::bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+     || ::listen(listener, SOMAXCONN) != 0) {
+        ::close(listener);
+        throw std::runtime_error("unable to listen on " + socket_name + ": "
+                                 + std::string(std::strerror(errno)));
+    }
+    return listener;
+}
+
+int Connect(const std::string& socket_name) {
+    static const int ATTEMPT_COUNT = 300;
+    static const std::chrono::milliseconds RETRY_DELAY{100};
+
+    const sockaddr_un address = MakeAddress(socket_name);
+    for (int attempt = 0; attempt < ATTEMPT_COUNT; ++attempt) {
+        const int socket = OpenSocket();
+        if (::connect(socket, reinterpret_cast<const sockaddr*>(&address),
+                      sizeof(address)) == 0)
+            return socket;
+
+        ::close(socket);
+        std::this_thread::sleep_for(RETRY_DELAY);
+    }
+    throw std::runtime_error("unable to connect to " + socket_name);
+}
+
+void WriteAll(const int socket, const char* data, size_t size) {
+    while (size) {
+        const ssize_t written = ::send(socket, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            throw std::runtime_error("unable to write to socket: "
+                                     + std::string(std::strerror(errno)));
+        data += written;
+        size -= written;
+    }
+}
+
+bool ReadAll(const int socket, char* data, size_t size) {
+    while (size) {
+        const ssize_t read = ::read(socket, data, size);
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read < 0)
+            throw std::runtime_error("unable to read from socket: "
+                                     + std::string(std::strerror(errno)));
+        if (read == 0)
+            return false;
+        data += read;
+        size -= read;
+    }
+    return true;
+}
+
+// ---------- SocketBuffer ------------
+
+SocketBuffer::SocketBuffer(const int socket)
+    : socket_(socket)
+    , input_(BUFFER_SIZE)
+    , output_(BUFFER_SIZE) {
+    setg(input_.data(), input_.data(), input_.data());
+    setp(output_.data(), output_.data() + output_.size());
+}
+
+SocketBuffer::~SocketBuffer() {
+    sync();
+}
+
+SocketBuffer::int_type SocketBuffer::underflow() {
+    while (true) {
+        const ssize_t read = ::read(socket_, input_.data(), input_.size());
+        if (read < 0 && errno == EINTR)
+            continue;
+        if (read <= 0)
+            return traits_type::eof();
+
+        setg(input_.data(), input_.data(), input_.data() + read);
+        return traits_type::to_int_type(*gptr());
+    }
+}
+
+SocketBuffer::int_type SocketBuffer::overflow(const int_type c) {
+    if (sync() != 0)
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int SocketBuffer::sync() {
+    try {
+        WriteAll(socket_, pbase(), pptr() - pbase());
+    } catch (const std::runtime_error&) {
+        return -1;
+    }
+    setp(output_.data(), output_.data() + output_.size());
+    return 0;
+}
+
+} // namespace io
+} // namespace transport
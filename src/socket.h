@@ -0,0 +1,52 @@
+#pragma once
+
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace transport {
+namespace io {
+
+// ---------- Unix sockets ------------
+
+// Binds a stream socket to the path, replacing a stale one, and listens on it
+int Listen(const std::string& socket_name);
+
+// Retries for a while, as the listening side may still be starting up
+int Connect(const std::string& socket_name);
+
+void WriteAll(const int socket, const char* data, size_t size);
+
+// Returns false if the peer closes the connection first
+bool ReadAll(const int socket, char* data, size_t size);
+
+// ---------- SocketBuffer ------------
+
+// Stream buffer over a connected socket: reads and writes go in blocks, a
+// write to a closed connection fails the stream instead of raising SIGPIPE
+class SocketBuffer : public std::streambuf {
+public:
+    explicit SocketBuffer(const int socket);
+
+    SocketBuffer(const SocketBuffer&) = delete;
+    SocketBuffer& operator=(const SocketBuffer&) = delete;
+
+    ~SocketBuffer() override;
+
+protected:
+    int_type underflow() override;
+
+    int_type overflow(int_type c) override;
+
+    int sync() override;
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    int socket_;
+    std::vector<char> input_;
+    std::vector<char> output_;
+};
+
+} // namespace io
+} // namespace transport
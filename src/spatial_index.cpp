@@ -0,0 +1,264 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace transport {
+
+namespace {
+
+static const double DR = M_PI/180.;
+static const double MIN_EXTENT = 1e-6; // [deg]
+static const double GROWTH_MARGIN = 0.5; // of the extent on each side
+
+} // namespace
+
+// ---------- SpatialIndex ------------
+
+SpatialIndex::SpatialIndex(std::vector<geo::Coordinates> points)
+        : points_(std::move(points))
+        , is_removed_(points_.size(), false) {
+    AddColumns();
+    Build();
+}
+
+SpatialIndex::SpatialIndex(std::vector<geo::Coordinates> points, Grid grid)
+        : points_(std::move(points))
+        , is_removed_(points_.size(), false)
+        , grid_(std::move(grid)) {
+    AddColumns();
+    UpdateCellSizes();
+    if (!IsValid())
+        Build();
+}
+
+void SpatialIndex::AddColumns() {
+    columns_.Reserve(points_.size());
+    for (const geo::Coordinates& point : points_)
+        columns_.Add(point);
+}
+
+bool SpatialIndex::IsValid() const {
+    if (grid_.cells.size() != grid_.rows*grid_.columns
+     || (points_.empty() != grid_.cells.empty()))
+        return false;
+
+    // Each point is listed once, in the cell it falls in
+    std::vector<bool> is_listed(points_.size(), false);
+    size_t point_count = 0;
+    for (size_t i = 0; i < grid_.cells.size(); ++i)
+        for (const size_t id : grid_.cells[i]) {
+            if (id >= points_.size() || is_listed[id] || GetCell(points_[id]) != i)
+                return false;
+            is_listed[id] = true;
+            ++point_count;
+        }
+    return point_count == points_.size();
+}
+
+void SpatialIndex::Build(const double margin) {
+    grid_ = {};
+    if (points_.empty())
+        return;
+
+    const auto [bottom_it, top_it] = std::minmax_element(
+        points_.begin(), points_.end(),
+        [](const auto& lhs, const auto& rhs) { return lhs.lat < rhs.lat; }
+    );
+    const auto [left_it, right_it] = std::minmax_element(
+        points_.begin(), points_.end(),
+        [](const auto& lhs, const auto& rhs) { return lhs.lng < rhs.lng; }
+    );
+    const double lat_margin = MIN_EXTENT + margin*(top_it->lat - bottom_it->lat);
+    const double lng_margin = MIN_EXTENT + margin*(right_it->lng - left_it->lng);
+    grid_.bounds = {
+        {bottom_it->lat - lat_margin, left_it->lng - lng_margin},
+        {top_it->lat + lat_margin, right_it->lng + lng_margin}
+    };
+
+    const size_t cell_count = (points_.size() + POINTS_PER_CELL - 1)/POINTS_PER_CELL;
+    grid_.rows = grid_.columns = static_cast<size_t>(
+        std::ceil(std::sqrt(static_cast<double>(cell_count)))
+    );
+    UpdateCellSizes();
+
+    std::vector<size_t> sizes(grid_.rows*grid_.columns, 0);
+    for (size_t id = 0; id < points_.size(); ++id)
+        if (!is_removed_[id])
+            ++sizes[GetCell(points_[id])];
+
+    grid_.cells.resize(sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i)
+        grid_.cells[i].reserve(sizes[i]);
+    for (size_t id = 0; id < points_.size(); ++id)
+        if (!is_removed_[id])
+            grid_.cells[GetCell(points_[id])].push_back(id);
+}
+
+void SpatialIndex::UpdateCellSizes() {
+    if (!grid_.rows || !grid_.columns)
+        return;
+
+    cell_height_ = (grid_.bounds.max.lat - grid_.bounds.min.lat)/grid_.rows;
+    cell_width_ = (grid_.bounds.max.lng - grid_.bounds.min.lng)/grid_.columns;
+}
+
+void SpatialIndex::Insert(geo::Coordinates point) {
+    points_.push_back(point);
+    columns_.Add(point);
+    is_removed_.push_back(false);
+
+    // Grow the grid and its bounds geometrically, so that inserting points
+    // one by one rebuilds it a logarithmic number of times
+    if (!Contains(point)
+     || points_.size() > 4*POINTS_PER_CELL*grid_.cells.size())
+        Build(GROWTH_MARGIN);
+    else
+        grid_.cells[GetCell(point)].push_back(points_.size() - 1);
+}
+
+void SpatialIndex::Remove(const size_t id) {
+    if (is_removed_.at(id))
+        return;
+
+    is_removed_[id] = true;
+    if (grid_.cells.empty())
+        return;
+
+    std::vector<size_t>& cell = grid_.cells[GetCell(points_[id])];
+    cell.erase(std::remove(cell.begin(), cell.end(), id), cell.end());
+}
+
+bool SpatialIndex::Contains(geo::Coordinates point) const {
+    return !grid_.cells.empty()
+        && grid_.bounds.min.lat <= point.lat && point.lat <= grid_.bounds.max.lat
+        && grid_.bounds.min.lng <= point.lng && point.lng <= grid_.bounds.max.lng;
+}
+
+size_t SpatialIndex::GetByteSize() const {
+    size_t size = points_.capacity()*sizeof(geo::Coordinates)
+                + columns_.GetByteSize()
+                + is_removed_.capacity()/8
+                + grid_.cells.capacity()*sizeof(std::vector<size_t>);
+    for (const std::vector<size_t>& cell : grid_.cells)
+        size += cell.capacity()*sizeof(size_t);
+    return size;
+}
+
+size_t SpatialIndex::GetCell(geo::Coordinates point) const {
+    return GetRow(point.lat)*grid_.columns + GetColumn(point.lng);
+}
+
+size_t SpatialIndex::GetRow(const double lat) const {
+    const double row = std::floor((lat - grid_.bounds.min.lat)/cell_height_);
+    return static_cast<size_t>(
+        std::clamp(row, 0., static_cast<double>(grid_.rows - 1))
+    );
+}
+
+size_t SpatialIndex::GetColumn(const double lng) const {
+    const double column = std::floor((lng - grid_.bounds.min.lng)/cell_width_);
+    return static_cast<size_t>(
+        std::clamp(column, 0., static_cast<double>(grid_.columns - 1))
+    );
+}
+
+std::vector<SpatialIndex::Neighbour> SpatialIndex::FindNearest(
+    geo::Coordinates point,
+    const size_t count
+) const {
+    std::vector<Neighbour> neighbours;
+    if (grid_.cells.empty() || !count)
+        return neighbours;
+
+    // Cosine of the latitude closest to a pole bounds the longitude spans
+    const double min_cos = std::cos(DR*std::max({
+        std::abs(point.lat),
+        std::abs(grid_.bounds.min.lat),
+        std::abs(grid_.bounds.max.lat)
+    }));
+    const auto get_ring_distance = [&](const size_t ring) {
+        const double lat_span = DR*ring*cell_height_;
+        const double lng_span = std::min(M_PI, DR*ring*cell_width_);
+        return geo::EARTH_RADIUS*std::min(
+            lat_span,
+            2*std::asin(std::min(1., min_cos*std::sin(lng_span/2)))
+        );
+    };
+
+    const auto by_distance = [](const Neighbour& lhs, const Neighbour& rhs) {
+        return lhs.distance < rhs.distance
+            || (lhs.distance == rhs.distance && lhs.id < rhs.id);
+    };
+
+    const long center_row = static_cast<long>(GetRow(point.lat));
+    const long center_column = static_cast<long>(GetColumn(point.lng));
+    const long rows = static_cast<long>(grid_.rows);
+    const long columns = static_cast<long>(grid_.columns);
+    const long last_ring = std::max(rows, columns);
+
+    // Candidates of a ring are scored together by the batch kernel
+    std::vector<size_t> ring_ids;
+    std::vector<double> distances;
+    for (long ring = 0; ring <= last_ring; ++ring) {
+        ring_ids.clear();
+        for (long row = center_row - ring; row <= center_row + ring; ++row) {
+            if (row < 0 || row >= rows)
+                continue;
+
+            const bool is_edge = (row == center_row - ring || row == center_row + ring);
+            const long step = (is_edge || !ring) ? 1 : 2*ring;
+            for (long column = center_column - ring;
+                 column <= center_column + ring;
+                 column += step) {
+                if (column < 0 || column >= columns)
+                    continue;
+
+                const std::vector<size_t>& cell = grid_.cells[row*columns + column];
+                ring_ids.insert(ring_ids.end(), cell.begin(), cell.end());
+            }
+        }
+
+        distances.resize(ring_ids.size());
+        columns_.ComputeDistances(point, ring_ids.data(), ring_ids.size(), distances.data());
+        for (size_t i = 0; i < ring_ids.size(); ++i)
+            neighbours.push_back({ring_ids[i], distances[i]});
+
+        if (neighbours.size() >= count) {
+            std::nth_element(
+                neighbours.begin(), neighbours.begin() + (count - 1), neighbours.end(),
+                by_distance
+            );
+            if (neighbours[count - 1].distance <= get_ring_distance(ring))
+                break;
+        }
+    }
+
+    std::sort(neighbours.begin(), neighbours.end(), by_distance);
+    if (neighbours.size() > count)
+        neighbours.resize(count);
+    return neighbours;
+}
+
+std::vector<size_t> SpatialIndex::FindInBox(Box box) const {
+    std::vector<size_t> ids;
+    if (grid_.cells.empty()
+     || box.max.lat < grid_.bounds.min.lat || box.min.lat > grid_.bounds.max.lat
+     || box.max.lng < grid_.bounds.min.lng || box.min.lng > grid_.bounds.max.lng)
+        return ids;
+
+    const size_t last_row = GetRow(box.max.lat);
+    const size_t last_column = GetColumn(box.max.lng);
+    for (size_t row = GetRow(box.min.lat); row <= last_row; ++row)
+        for (size_t column = GetColumn(box.min.lng); column <= last_column; ++column)
+            for (const size_t id : grid_.cells[row*grid_.columns + column]) {
+                const geo::Coordinates& point = points_[id];
+                if (box.min.lat <= point.lat && point.lat <= box.max.lat
+                 && box.min.lng <= point.lng && point.lng <= box.max.lng)
+                    ids.push_back(id);
+            }
+
+    return ids;
+}
+
+} // namespace transport
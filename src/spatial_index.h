@@ -0,0 +1,87 @@
+#pragma once
+#include <geo/geo.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace transport {
+
+// Uniform latitude/longitude grid over points identified by their index
+class SpatialIndex {
+public:
+    struct Box {
+        geo::Coordinates min;
+        geo::Coordinates max;
+    };
+
+    struct Grid {
+        Box bounds = {{0., 0.}, {0., 0.}};
+        size_t columns = 0;
+        size_t rows = 0;
+        std::vector<std::vector<size_t>> cells; // row-major
+    };
+
+    struct Neighbour {
+        size_t id;
+        double distance; // [m]
+    };
+
+public:
+    SpatialIndex() = default;
+
+    explicit SpatialIndex(std::vector<geo::Coordinates> points);
+
+    // Restores the grid built earlier over the same points, it is rebuilt
+    // unless it lists each of them once in the right cell
+    SpatialIndex(std::vector<geo::Coordinates> points, Grid grid);
+
+    inline size_t GetPointCount() const {
+        return points_.size();
+    }
+
+    inline const Grid& GetGrid() const {
+        return grid_;
+    }
+
+    size_t GetByteSize() const;
+
+    void Insert(geo::Coordinates point);
+
+    // Removed points keep their ids but are never found again
+    void Remove(const size_t id);
+
+    // Up to count points ordered by the great-circle distance
+    std::vector<Neighbour> FindNearest(geo::Coordinates point,
+                                       const size_t count) const;
+
+    std::vector<size_t> FindInBox(Box box) const;
+
+private:
+    static constexpr size_t POINTS_PER_CELL = 4;
+
+    std::vector<geo::Coordinates> points_;
+    geo::PointColumns columns_; // of the points, scores FindNearest candidates
+    std::vector<bool> is_removed_; // indexed by point id
+    Grid grid_;
+    double cell_height_ = 0; // [deg]
+    double cell_width_ = 0; // [deg]
+
+    void AddColumns();
+
+    // Bounds are widened by the margin times their extent on each side
+    void Build(const double margin = 0.);
+
+    bool IsValid() const;
+
+    void UpdateCellSizes();
+
+    bool Contains(geo::Coordinates point) const;
+
+    size_t GetCell(geo::Coordinates point) const;
+
+    size_t GetRow(const double lat) const;
+
+    size_t GetColumn(const double lng) const;
+};
+
+} // namespace transport